@@ -0,0 +1,504 @@
+#include "../tensor.h"
+#include "../mesh.h"
+#include "../marching_cubes.h"
+#include "../marching_cubes_extractor.h"
+#include "../incremental_marching_cubes.h"
+#include "../thread_pool.h"
+#include "../vertex_welder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <sys/resource.h>
+
+// Sweeps the polygonizers over synthetic fields, element types, grid sizes and thread counts,
+// and prints one JSON document with the timings to stdout (progress goes to stderr).
+//
+// cd benchmark && g++ -Wall -O2 --std=c++14 -pthread benchmark.cpp $(ls ../*.cpp | grep -v /main.cpp) -o benchmark
+// ./benchmark --sizes 64,128,256,512,1024 --types uint8,uint16,float --threads 1,8 --repeat 3
+
+namespace {
+  using clock_type = std::chrono::steady_clock;
+
+  const double PI = 3.14159265358979323846;
+
+  double seconds_since(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+  }
+
+  // Process wide high water mark, in kilobytes
+  long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+  }
+
+  std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+      if (!item.empty()) items.push_back(item);
+    }
+    return items;
+  }
+
+  std::vector<size_t> split_sizes(const std::string& list) {
+    std::vector<size_t> sizes;
+    for (const auto& item : split(list)) sizes.push_back(std::stoul(item));
+    return sizes;
+  }
+
+  // All fields are built in [0,1] with the surface at 0.5 and the inside above it
+  double clamp01(double v) { return std::min(1.0, std::max(0.0, v)); }
+
+  double sphere(double x, double y, double z) {
+    const double dx = x - 0.5, dy = y - 0.5, dz = z - 0.5;
+    return clamp01(0.5 + 2.0 * (0.35 - std::sqrt(dx*dx + dy*dy + dz*dz)));
+  }
+
+  double gyroid(double x, double y, double z) {
+    const double s = 2.0 * PI * 4.0;
+    const double g = std::sin(s*x)*std::cos(s*y) + std::sin(s*y)*std::cos(s*z) + std::sin(s*z)*std::cos(s*x);
+    return clamp01(0.5 + g / 3.0);
+  }
+
+  double torus(double x, double y, double z) {
+    const double dx = x - 0.5, dy = y - 0.5, dz = z - 0.5;
+    const double ring = std::sqrt(dx*dx + dy*dy) - 0.3;
+    return clamp01(0.5 + 2.0 * (0.1 - std::sqrt(ring*ring + dz*dz)));
+  }
+
+  // Value noise on an integer lattice, hashed so it needs no tables
+  double lattice(int64_t i, int64_t j, int64_t k, uint64_t seed) {
+    uint64_t h = seed ^ (uint64_t(i) * 0x9E3779B97F4A7C15ull) ^ (uint64_t(j) * 0xC2B2AE3D27D4EB4Full) ^ (uint64_t(k) * 0x165667B19E3779F9ull);
+    h ^= h >> 33; h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33; h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return double(h >> 11) / double(uint64_t(1) << 53);
+  }
+
+  double value_noise(double x, double y, double z, uint64_t seed) {
+    const double fx = std::floor(x), fy = std::floor(y), fz = std::floor(z);
+    const int64_t i = int64_t(fx), j = int64_t(fy), k = int64_t(fz);
+    const auto smooth = [](double t) { return t * t * (3.0 - 2.0 * t); };
+    const double u = smooth(x - fx), v = smooth(y - fy), w = smooth(z - fz);
+
+    double value = 0.0;
+    for (int corner = 0; corner < 8; ++corner) {
+      const int di = corner & 1, dj = (corner >> 1) & 1, dk = (corner >> 2) & 1;
+      const double weight = (di ? u : 1 - u) * (dj ? v : 1 - v) * (dk ? w : 1 - w);
+      value += weight * lattice(i + di, j + dj, k + dk, seed);
+    }
+    return value;
+  }
+
+  double noise(double x, double y, double z) {
+    double value = 0.0, amplitude = 0.5, total = 0.0, frequency = 4.0;
+    for (uint64_t octave = 0; octave < 4; ++octave) {
+      value += amplitude * value_noise(x * frequency, y * frequency, z * frequency, octave + 1);
+      total += amplitude;
+      amplitude *= 0.5;
+      frequency *= 2.0;
+    }
+    return value / total;
+  }
+
+  template <typename T>
+  T to_value(double v) {
+    return std::is_integral<T>::value ? T(std::lround(v * std::numeric_limits<T>::max())) : T(v);
+  }
+
+  // A few dozen small gaussian blobs in otherwise empty space, so most bricks can be skipped
+  template <typename T>
+  void fill_blobs(Tensor<T,3>& tensor, ThreadPool& pool) {
+    struct Blob { double x, y, z, radius; };
+    std::mt19937 generator(12345);
+    std::uniform_real_distribution<double> position(0.1, 0.9), radius(0.01, 0.04);
+    std::vector<Blob> blobs(32);
+    for (auto& blob : blobs) blob = {position(generator), position(generator), position(generator), radius(generator)};
+
+    const auto& size = tensor.size();
+    T* data = tensor.data();
+    std::fill(data, data + size.prod(), to_value<T>(0.0));
+
+    pool.parallel_for(size(2), [&](size_t k) {
+      const double z = (k + 0.5) / size(2);
+      for (const auto& blob : blobs) {
+        // Outside three radii the blob adds nothing visible
+        const double reach = 3.0 * blob.radius;
+        if (std::abs(z - blob.z) > reach) continue;
+
+        const size_t j0 = size_t(std::max(0.0, (blob.y - reach) * size(1)));
+        const size_t j1 = size_t(std::min(double(size(1)), (blob.y + reach) * size(1) + 1));
+        const size_t i0 = size_t(std::max(0.0, (blob.x - reach) * size(0)));
+        const size_t i1 = size_t(std::min(double(size(0)), (blob.x + reach) * size(0) + 1));
+
+        for (size_t j = j0; j < j1; ++j) {
+          const double y = (j + 0.5) / size(1);
+          for (size_t i = i0; i < i1; ++i) {
+            const double x = (i + 0.5) / size(0);
+            const double d2 = ((x-blob.x)*(x-blob.x) + (y-blob.y)*(y-blob.y) + (z-blob.z)*(z-blob.z)) / (blob.radius*blob.radius);
+            T& value = data[i + size(0) * (j + size(1) * k)];
+            value = to_value<T>(clamp01(double(value) / double(to_value<T>(1.0)) + std::exp(-d2)));
+          }
+        }
+      }
+    });
+  }
+
+  template <typename T>
+  void fill_field(Tensor<T,3>& tensor, const std::string& field, ThreadPool& pool) {
+    if (field == "blobs") {
+      fill_blobs(tensor, pool);
+      return;
+    }
+
+    double (*f)(double, double, double);
+    if      (field == "sphere") f = sphere;
+    else if (field == "gyroid") f = gyroid;
+    else if (field == "torus")  f = torus;
+    else if (field == "noise")  f = noise;
+    else throw std::runtime_error("Unknown field " + field);
+
+    const auto& size = tensor.size();
+    T* data = tensor.data();
+    pool.parallel_for(size(2), [&](size_t k) {
+      const double z = (k + 0.5) / size(2);
+      for (size_t j = 0; j < size(1); ++j) {
+        const double y = (j + 0.5) / size(1);
+        for (size_t i = 0; i < size(0); ++i) {
+          data[i + size(0) * (j + size(1) * k)] = to_value<T>(f((i + 0.5) / size(0), y, z));
+        }
+      }
+    });
+  }
+
+  struct Options {
+    std::vector<std::string> fields    = {"sphere", "gyroid", "torus", "noise", "blobs"};
+    std::vector<std::string> types     = {"uint8", "uint16", "float"};
+    std::vector<std::string> functions = {"polygonize_tensor", "polygonize_isosurface", "mesh_weld_sorted", "mesh_weld_first_seen"};
+    std::vector<size_t> sizes          = {64, 128, 256};
+    std::vector<size_t> threads        = {1, 0};
+    size_t repeat = 1;
+  };
+
+  // Best time per phase over the repeats
+  struct Result {
+    std::vector<std::pair<std::string,double>> phases;
+    size_t triangles = 0;
+    size_t vertexes = 0;
+    // PipelineStats::write_json() of each repeat, for the functions that collect stats
+    std::vector<std::string> pipeline_runs;
+
+    void record(const std::string& phase, double seconds) {
+      for (auto& p : phases) {
+        if (p.first == phase) {
+          p.second = std::min(p.second, seconds);
+          return;
+        }
+      }
+      phases.emplace_back(phase, seconds);
+    }
+
+    double total() const {
+      double sum = 0.0;
+      for (const auto& p : phases) sum += p.second;
+      return sum;
+    }
+  };
+
+  class Report {
+    private:
+      std::ostream& os_;
+      bool first_ = true;
+
+    public:
+      explicit Report(std::ostream& os) : os_(os) {
+        os_ << "{\n  \"benchmark\": \"marching_cubes\",\n";
+        os_ << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+        os_ << "  \"results\": [";
+      }
+
+      ~Report() {
+        os_ << "\n  ]\n}\n";
+      }
+
+      void add(
+        const std::string& field, const std::string& type, size_t size, size_t threads,
+        const std::string& function, double generate_seconds, const Result& result
+      ) {
+        const double cubes = double(size - 1) * double(size - 1) * double(size - 1);
+        const double seconds = result.total();
+
+        os_ << (first_ ? "\n" : ",\n");
+        first_ = false;
+        os_ << "    {\"field\": \"" << field << "\", \"type\": \"" << type << "\", \"size\": " << size
+            << ", \"threads\": " << threads << ", \"function\": \"" << function << "\""
+            << ", \"cubes\": " << size_t(cubes) << ", \"triangles\": " << result.triangles
+            << ", \"vertexes\": " << result.vertexes << ", \"seconds\": " << seconds
+            << ", \"cubes_per_second\": " << (seconds > 0 ? cubes / seconds : 0.0)
+            << ", \"triangles_per_second\": " << (seconds > 0 ? result.triangles / seconds : 0.0)
+            << ", \"peak_rss_kb\": " << peak_rss_kb() << ", \"phases\": {\"generate\": " << generate_seconds;
+        for (const auto& phase : result.phases) os_ << ", \"" << phase.first << "\": " << phase.second;
+        os_ << "}";
+        if (!result.pipeline_runs.empty()) {
+          os_ << ", \"pipeline_runs\": [";
+          for (size_t r = 0; r < result.pipeline_runs.size(); ++r) os_ << (r ? ", " : "") << result.pipeline_runs[r];
+          os_ << "]";
+        }
+        os_ << "}";
+        os_.flush();
+      }
+  };
+
+  // Mesh sink that only counts what it is handed, to time streamed extraction without output
+  struct CountingSink {
+    size_t vertexes = 0;
+    size_t faces = 0;
+
+    void begin(bool) {}
+    void add_vertexes(const Mesh::vertex_type*, const Mesh::vertex_type*, size_t n) { vertexes += n; }
+    void add_faces(const Mesh::face_type*, size_t n) { faces += n; }
+    void end() {}
+  };
+
+  // The tensor is reordered untimed, and its pyramid is built as part of the run
+  template <typename T, typename Layout>
+  void run_layout(const Tensor<T,3>& volume, T iso, ThreadPool& pool, Result& result) {
+    const LayoutTensor<T,Layout> tensor(volume);
+
+    auto start = clock_type::now();
+    tensor.min_max_pyramid(&pool);
+    result.record("pyramid", seconds_since(start));
+
+    start = clock_type::now();
+    Mesh mesh = MarchingCubes::polygonize_isosurface(tensor, iso, pool);
+    result.record("extract", seconds_since(start));
+    result.triangles = mesh.faces().size();
+    result.vertexes = mesh.vertexes().size();
+  }
+
+  template <typename T>
+  Result run_function(const std::string& function, Tensor<T,3>& tensor, T iso, ThreadPool& pool, size_t repeat) {
+    Result result;
+    // Kept across the repeats, so only the first one allocates slab buffers
+    MarchingCubes::Scratch scratch;
+    MarchingCubesExtractor<T> extractor(&pool);
+    Mesh extracted;
+
+    for (size_t r = 0; r < repeat; ++r) {
+      // Drops the cached pyramid so every repeat pays for it again
+      tensor.data();
+      const Tensor<T,3>& volume = tensor;
+
+      if (function == "polygonize_tensor") {
+        auto start = clock_type::now();
+        Mesh mesh = MarchingCubes::polygonize_tensor<T>(volume, [iso](T v) { return v > iso; }, pool);
+        result.record("extract", seconds_since(start));
+        result.triangles = mesh.faces().size();
+        result.vertexes = mesh.vertexes().size();
+      }
+      else if (function == "polygonize_isosurface") {
+        auto start = clock_type::now();
+        volume.min_max_pyramid(&pool);
+        result.record("pyramid", seconds_since(start));
+
+        start = clock_type::now();
+        Mesh mesh = MarchingCubes::polygonize_isosurface<T>(volume, iso, pool);
+        result.record("extract", seconds_since(start));
+        result.triangles = mesh.faces().size();
+        result.vertexes = mesh.vertexes().size();
+      }
+      else if (function == "polygonize_isosurface_compact") {
+        auto start = clock_type::now();
+        volume.min_max_pyramid(&pool);
+        result.record("pyramid", seconds_since(start));
+
+        start = clock_type::now();
+        CompactMesh mesh;
+        MarchingCubes::polygonize_isosurface<T>(volume, iso, pool, mesh);
+        result.record("extract", seconds_since(start));
+        result.triangles = mesh.faces().size();
+        result.vertexes = mesh.vertexes().size();
+      }
+      else if (function == "polygonize_isosurface_scratch") {
+        auto start = clock_type::now();
+        volume.min_max_pyramid(&pool);
+        result.record("pyramid", seconds_since(start));
+
+        start = clock_type::now();
+        Mesh mesh = MarchingCubes::polygonize_isosurface<T>(volume, iso, pool, scratch);
+        result.record("extract", seconds_since(start));
+        result.triangles = mesh.faces().size();
+        result.vertexes = mesh.vertexes().size();
+      }
+      else if (function == "polygonize_isosurface_stats") {
+        // Timing inside the slab tasks slows extraction down, so the per-phase times of each
+        // repeat (classification, interpolation, emission, welding) are only collected here
+        PipelineStats stats;
+        auto start = clock_type::now();
+        Mesh mesh = MarchingCubes::polygonize_isosurface<T>(volume, iso, pool, stats);
+        result.record("extract", seconds_since(start));
+        result.triangles = mesh.faces().size();
+        result.vertexes = mesh.vertexes().size();
+
+        std::stringstream json;
+        stats.write_json(json);
+        result.pipeline_runs.push_back(json.str());
+      }
+      else if (function == "incremental_update") {
+        // A full build, then a stroke of 10 voxels through the middle of the volume flipped to
+        // the other side of the surface
+        Tensor<T,3> edited(tensor);
+        auto start = clock_type::now();
+        IncrementalMarchingCubes<T> incremental(edited, iso, &pool);
+        result.record("build", seconds_since(start));
+
+        const size_t middle = volume.size()(0) / 2;
+        const T low = volume.min();
+        const T high = volume.max();
+        for (size_t n = 0; n < 10 && middle + n < volume.size()(0); ++n) {
+          const MarchingCubes::index_type point(middle + n, volume.size()(1) / 2, volume.size()(2) / 2);
+          edited(point) = volume(point) < iso ? high : low;
+        }
+
+        start = clock_type::now();
+        const Mesh& mesh = incremental.update();
+        result.record("update", seconds_since(start));
+        result.triangles = mesh.faces().size();
+        result.vertexes = mesh.vertexes().size();
+      }
+      else if (function == "polygonize_isosurface_bricked") {
+        run_layout<T,BrickedLayout<8>>(volume, iso, pool, result);
+      }
+      else if (function == "polygonize_isosurface_morton") {
+        run_layout<T,MortonLayout>(volume, iso, pool, result);
+      }
+      else if (function == "polygonize_isosurface_extractor") {
+        // Builds its own pyramid and refills the same mesh every repeat
+        auto start = clock_type::now();
+        extractor.polygonize_isosurface(volume, iso, extracted);
+        result.record("extract", seconds_since(start));
+        result.triangles = extracted.faces().size();
+        result.vertexes = extracted.vertexes().size();
+      }
+      else if (function == "polygonize_isosurface_sink") {
+        auto start = clock_type::now();
+        volume.min_max_pyramid(&pool);
+        result.record("pyramid", seconds_since(start));
+
+        start = clock_type::now();
+        CountingSink sink;
+        MarchingCubes::polygonize_isosurface<T>(volume, iso, pool, sink);
+        result.record("extract", seconds_since(start));
+        result.triangles = sink.faces;
+        result.vertexes = sink.vertexes;
+      }
+      else if (function == "mesh_weld_sorted" || function == "mesh_weld_first_seen") {
+        // The soup comes from an already welded mesh; only the Mesh constructor is timed
+        std::vector<Mesh::triangle_type> triangles;
+        {
+          Mesh mesh = MarchingCubes::polygonize_isosurface<T>(volume, iso, pool);
+          triangles.reserve(mesh.faces().size());
+          for (size_t i = 0; i < mesh.faces().size(); ++i) triangles.push_back(mesh.triangle(i));
+        }
+
+        const auto order = function == "mesh_weld_sorted" ? VertexWelder::Order::sorted : VertexWelder::Order::first_seen;
+        auto start = clock_type::now();
+        Mesh mesh(triangles, VertexWelder(order, &pool));
+        result.record("weld", seconds_since(start));
+        result.triangles = mesh.faces().size();
+        result.vertexes = mesh.vertexes().size();
+      }
+      else {
+        throw std::runtime_error("Unknown function " + function);
+      }
+    }
+
+    return result;
+  }
+
+  template <typename T>
+  void run_type(const Options& options, const std::string& type, Report& report) {
+    ThreadPool generator_pool;
+    const T iso = to_value<T>(0.5);
+
+    for (size_t size : options.sizes) {
+      for (const auto& field : options.fields) {
+        Tensor<T,3> tensor(Size<size_t,3>(size, size, size));
+
+        auto start = clock_type::now();
+        fill_field(tensor, field, generator_pool);
+        const double generate_seconds = seconds_since(start);
+
+        for (size_t threads : options.threads) {
+          ThreadPool pool(threads);
+          for (const auto& function : options.functions) {
+            std::cerr << field << " " << type << " " << size << "^3 threads=" << pool.size() << " " << function << std::endl;
+            const Result result = run_function(function, tensor, iso, pool, options.repeat);
+            report.add(field, type, size, pool.size(), function, generate_seconds, result);
+          }
+        }
+      }
+    }
+  }
+
+  void usage() {
+    std::cerr
+      << "usage: benchmark [--fields sphere,gyroid,torus,noise,blobs] [--types uint8,uint16,float]\n"
+      << "                 [--sizes 64,128,256] [--threads 1,0] [--repeat 1]\n"
+      << "                 [--functions polygonize_tensor,polygonize_isosurface,polygonize_isosurface_compact,\n"
+      << "                              polygonize_isosurface_scratch,polygonize_isosurface_sink,\n"
+      << "                              polygonize_isosurface_stats,polygonize_isosurface_extractor,\n"
+      << "                              polygonize_isosurface_bricked,polygonize_isosurface_morton,\n"
+      << "                              incremental_update,mesh_weld_sorted,mesh_weld_first_seen]\n"
+      << "A thread count of 0 uses one thread per hardware core.\n";
+  }
+}
+
+int main(int argc, char** argv) {
+  Options options;
+
+  for (int a = 1; a < argc; ++a) {
+    const std::string arg = argv[a];
+    if (a + 1 >= argc) {
+      usage();
+      return 1;
+    }
+    const std::string value = argv[++a];
+
+    if      (arg == "--fields")    options.fields = split(value);
+    else if (arg == "--types")     options.types = split(value);
+    else if (arg == "--functions") options.functions = split(value);
+    else if (arg == "--sizes")     options.sizes = split_sizes(value);
+    else if (arg == "--threads")   options.threads = split_sizes(value);
+    else if (arg == "--repeat")    options.repeat = std::max<size_t>(1, std::stoul(value));
+    else {
+      usage();
+      return 1;
+    }
+  }
+
+  Report report(std::cout);
+  for (const auto& type : options.types) {
+    if      (type == "uint8")  run_type<uint8_t>(options, type, report);
+    else if (type == "uint16") run_type<uint16_t>(options, type, report);
+    else if (type == "float")  run_type<float>(options, type, report);
+    else std::cerr << "Skipping unknown type " << type << std::endl;
+  }
+
+  return 0;
+}
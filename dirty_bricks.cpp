@@ -0,0 +1,69 @@
+#include "dirty_bricks.h"
+
+#include <algorithm>
+
+constexpr size_t DirtyBricks::BRICK_SIZE;
+
+namespace {
+  size_t bricks_for(size_t n_points) {
+    return n_points < 2 ? 0 : (n_points - 1 + DirtyBricks::BRICK_SIZE - 1) / DirtyBricks::BRICK_SIZE;
+  }
+}
+
+DirtyBricks::DirtyBricks() : enabled_(false) {}
+
+DirtyBricks::DirtyBricks(const size_type& size)
+  : size_(size), bricks_(bricks_for(size(0)), bricks_for(size(1)), bricks_for(size(2))),
+    dirty_(bricks_.prod(), false), enabled_(true)
+{
+  mark_all();
+}
+
+void DirtyBricks::mark_all() {
+  if (!enabled_) return;
+
+  list_.clear();
+  for (size_t b = 0; b < dirty_.size(); ++b) {
+    dirty_[b] = true;
+    list_.push_back(b);
+  }
+}
+
+std::vector<size_t> DirtyBricks::take() {
+  std::vector<size_t> list;
+  list.swap(list_);
+  for (size_t b : list) dirty_[b] = false;
+  std::sort(list.begin(), list.end());
+  return list;
+}
+
+void DirtyBricks::mark_point(size_t absolute_index) {
+  if (dirty_.empty()) return;
+
+  const size_t point[3] = {
+    absolute_index % size_(0),
+    (absolute_index / size_(0)) % size_(1),
+    absolute_index / (size_(0) * size_(1))
+  };
+
+  // The point is a corner of cubes point-1 and point along each axis (where they exist), and the
+  // cube at point+1 holds the vertex of a neighbouring grid point the iso surface passes through
+  size_t lo[3], hi[3];
+  for (size_t d = 0; d < 3; ++d) {
+    const size_t last_cube = size_(d) - 2;
+    lo[d] = std::min(point[d] == 0 ? 0 : point[d] - 1, last_cube) / BRICK_SIZE;
+    hi[d] = std::min(point[d] + 1, last_cube) / BRICK_SIZE;
+  }
+
+  for (size_t bz = lo[2]; bz <= hi[2]; ++bz) {
+    for (size_t by = lo[1]; by <= hi[1]; ++by) {
+      for (size_t bx = lo[0]; bx <= hi[0]; ++bx) {
+        const size_t b = bricks_.absolute_index_for({bx, by, bz});
+        if (!dirty_[b]) {
+          dirty_[b] = true;
+          list_.push_back(b);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "size.h"
+
+// Bricks of cubes of a 3D grid whose corner values were written since they were last taken.
+// Brick (bx,by,bz) holds the BRICK_SIZE^3 cubes whose lowest corner lies in
+// [BRICK_SIZE*bx, BRICK_SIZE*(bx+1)) and so on.  A grid point is a corner of the cubes one below
+// it as well, so writing a point on a brick face also marks the neighbouring brick.  The cubes
+// one above it are marked too, as their bricks hold the vertexes of the neighbouring grid points.
+//
+// A default constructed tracker is disabled and ignores every mark.
+class DirtyBricks {
+  public:
+    static constexpr size_t BRICK_SIZE = 8;
+
+    using size_type = Size<size_t,3>;
+
+  private:
+    size_type size_;
+    size_type bricks_;
+    std::vector<bool> dirty_;
+    std::vector<size_t> list_;
+    bool enabled_;
+
+  public:
+    DirtyBricks();
+
+    // Tracks a grid of the given number of points, with every brick starting out dirty
+    explicit DirtyBricks(const size_type& size);
+
+    bool enabled() const { return enabled_; }
+
+    const size_type& bricks() const { return bricks_; }
+
+    // Marks the bricks of the cubes within one of the point at the given absolute index
+    void mark(size_t absolute_index) {
+      if (enabled_) mark_point(absolute_index);
+    }
+
+    void mark_all();
+
+    // Absolute indexes of the dirty bricks in ascending order.  Clears them.
+    std::vector<size_t> take();
+
+  private:
+    void mark_point(size_t absolute_index);
+};
@@ -0,0 +1,71 @@
+#include "edge_cache.h"
+
+#include <algorithm>
+
+constexpr size_t EdgeCache::npos;
+
+EdgeCache::EdgeCache(size_t nx, size_t ny)
+  : nx_(nx),
+    x_edges_{{std::vector<size_t>(nx*ny, npos), std::vector<size_t>(nx*ny, npos)}},
+    y_edges_{{std::vector<size_t>(nx*ny, npos), std::vector<size_t>(nx*ny, npos)}},
+    z_edges_(nx*ny, npos),
+    points_{{std::vector<size_t>(nx*ny, npos), std::vector<size_t>(nx*ny, npos)}}
+{}
+
+void EdgeCache::advance() {
+  std::swap(x_edges_[0], x_edges_[1]);
+  std::swap(y_edges_[0], y_edges_[1]);
+  std::swap(points_[0], points_[1]);
+
+  // The new upper plane was filled as the lower plane of this layer and the upper plane of the
+  // one before
+  for (const auto* rows : {&previous_rows_, &rows_}) {
+    clear_rows(x_edges_[1], *rows);
+    clear_rows(y_edges_[1], *rows);
+    clear_rows(points_[1], *rows);
+  }
+  clear_rows(z_edges_, rows_);
+
+  std::swap(previous_rows_, rows_);
+  rows_.clear();
+}
+
+void EdgeCache::clear() {
+  for (const auto* rows : {&previous_rows_, &rows_}) {
+    clear_rows(x_edges_[0], *rows);
+    clear_rows(y_edges_[0], *rows);
+    clear_rows(points_[0], *rows);
+  }
+  clear_rows(x_edges_[1], rows_);
+  clear_rows(y_edges_[1], rows_);
+  clear_rows(points_[1], rows_);
+  clear_rows(z_edges_, rows_);
+
+  rows_.clear();
+  previous_rows_.clear();
+}
+
+void EdgeCache::resize(size_t nx, size_t ny) {
+  if (nx == nx_ && nx*ny == z_edges_.size()) {
+    clear();
+    return;
+  }
+
+  nx_ = nx;
+  for (auto& edges : x_edges_) edges.assign(nx*ny, npos);
+  for (auto& edges : y_edges_) edges.assign(nx*ny, npos);
+  z_edges_.assign(nx*ny, npos);
+  for (auto& points : points_) points.assign(nx*ny, npos);
+  rows_.clear();
+  previous_rows_.clear();
+}
+
+void EdgeCache::clear_rows(std::vector<size_t>& edges, const std::vector<size_t>& rows) const {
+  size_t next = 0;
+  for (size_t j : rows) {
+    const size_t begin = nx_*std::max(j, next);
+    const size_t end = std::min(nx_*(j+2), edges.size());
+    std::fill(edges.begin() + begin, edges.begin() + end, npos);
+    next = j + 2;
+  }
+}
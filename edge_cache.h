@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+// Rolling cache of mesh vertex indexes for the edges touched by one layer of cubes.  Holds the
+// x and y directed edges on the lower and upper vertex planes of the layer, and the z directed
+// edges between them.  Each edge is keyed by its lowest grid point, so neighbouring cubes that
+// share an edge also share the cache slot.
+//
+// The grid points of both planes have slots too, for vertexes that land exactly on a grid point
+// (where a value equals the iso value).  Every edge crossing at that point shares one vertex.
+class EdgeCache {
+  public:
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+  private:
+    size_t nx_;
+
+    // Index 0 is the lower vertex plane of the current layer, index 1 the upper one
+    std::array<std::vector<size_t>,2> x_edges_;
+    std::array<std::vector<size_t>,2> y_edges_;
+    std::vector<size_t> z_edges_;
+    std::array<std::vector<size_t>,2> points_;
+
+    // Rows of cubes that filled slots in the current layer and in the one before, ascending.
+    // Only the rows of points next to them are reset.
+    std::vector<size_t> rows_;
+    std::vector<size_t> previous_rows_;
+
+  public:
+    explicit EdgeCache(size_t nx, size_t ny);
+
+    // Slot for an edge starting at grid point (i,j) on the given plane (0 = lower, 1 = upper)
+    size_t& x_edge(size_t i, size_t j, size_t plane) { return x_edges_[plane][i + nx_*j]; }
+    size_t& y_edge(size_t i, size_t j, size_t plane) { return y_edges_[plane][i + nx_*j]; }
+    size_t& z_edge(size_t i, size_t j)               { return z_edges_[i + nx_*j]; }
+
+    // Slot for a vertex at grid point (i,j) of the given plane
+    size_t& point(size_t i, size_t j, size_t plane)  { return points_[plane][i + nx_*j]; }
+
+    // Slot for the given edge (0 to 11, see MarchingCubes::EDGE_TABLE) of cube (i,j)
+    size_t& operator()(size_t i, size_t j, size_t edge) {
+      switch (edge) {
+        case 0:  return x_edge(i,   j,   0);
+        case 1:  return y_edge(i+1, j,   0);
+        case 2:  return x_edge(i,   j+1, 0);
+        case 3:  return y_edge(i,   j,   0);
+        case 4:  return x_edge(i,   j,   1);
+        case 5:  return y_edge(i+1, j,   1);
+        case 6:  return x_edge(i,   j+1, 1);
+        case 7:  return y_edge(i,   j,   1);
+        case 8:  return z_edge(i,   j);
+        case 9:  return z_edge(i+1, j);
+        case 10: return z_edge(i+1, j+1);
+        default: return z_edge(i,   j+1);
+      }
+    }
+
+    // Records that cubes in row j of the current layer may fill slots.  Must be called, in
+    // ascending order of j, for every row that does, so that advance() only resets the rows of
+    // points next to them instead of whole planes.
+    void touch_row(size_t j) {
+      if (rows_.empty() || rows_.back() != j) rows_.push_back(j);
+    }
+
+    // Rows of points of the current layer whose slots may be filled, ascending
+    template <typename Function>
+    void for_each_point_row(const Function& f) const {
+      size_t next = 0;
+      for (size_t j : rows_) {
+        for (size_t y = std::max(j, next); y <= j + 1; ++y) f(y);
+        next = j + 2;
+      }
+    }
+
+    // Move on to the next layer of cubes: the upper plane becomes the lower plane, and the new
+    // upper plane and z edges are cleared.
+    void advance();
+
+    // Forget all cached vertexes
+    void clear();
+
+    size_t bytes() const {
+      return sizeof(size_t) * (x_edges_[0].capacity() + x_edges_[1].capacity() + y_edges_[0].capacity() + y_edges_[1].capacity() + z_edges_.capacity()
+                               + points_[0].capacity() + points_[1].capacity());
+    }
+
+    // Reuses the cache for a grid of nx by ny points, with every slot empty
+    void resize(size_t nx, size_t ny);
+
+  private:
+    // Empties the slots of the rows of points next to the given rows of cubes
+    void clear_rows(std::vector<size_t>& edges, const std::vector<size_t>& rows) const;
+};
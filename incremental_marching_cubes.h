@@ -0,0 +1,505 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include "marching_cubes.h"
+#include "dirty_bricks.h"
+
+// Keeps the iso surface of a Tensor up to date as the tensor is edited.  The surface is held as
+// one fragment per brick of cubes (see DirtyBricks), and update() re-polygonizes only the bricks
+// written since the last update, then patches their vertexes and faces into the Mesh in place.
+// Each fragment keeps the slots of the mesh arrays its vertexes and faces sit in, and a fragment
+// that shrinks hands its spare slots to ones that grow, or has them filled with the last elements
+// of the arrays, so the mesh stays compact and an update costs the size of the edit, not of the
+// mesh.
+//
+// Each edge crossing belongs to exactly one brick (the one holding the cube at the edge's lowest
+// point, clamped to the last brick), which holds its vertex.  A crossing that lands exactly on a
+// grid point (a corner equal to the iso value) instead shares one vertex with every edge ending
+// there, held by the brick of the cube at that point.  Faces reach vertexes of neighbouring
+// bricks by key.  Vertexes are interpolated exactly as by MarchingCubes::polygonize_isosurface, so
+// the surface is the same, though in a different order.
+//
+// The tensor must outlive the extractor, and is switched to dirty brick tracking.
+template <typename T>
+class IncrementalMarchingCubes {
+  public:
+    using vertex_type = MarchingCubes::vertex_type;
+    using size_type   = MarchingCubes::size_type;
+    using index_type  = MarchingCubes::index_type;
+
+    static constexpr size_t BRICK_SIZE = DirtyBricks::BRICK_SIZE;
+
+  private:
+    // Surface inside one brick.  Face corners below vertexes.size() index the brick's own
+    // vertexes (held in ascending key order), and the rest index its foreign vertexes, owned by
+    // neighbouring bricks.  Edges are keyed 3*point + axis for their lowest point, and grid point
+    // vertexes 3*n_points + point after them.
+    struct Fragment {
+      std::vector<vertex_type> vertexes;
+      std::vector<size_t> keys;
+      std::vector<std::array<size_t,3>> faces;
+
+      std::vector<size_t> foreign_keys;
+      std::vector<size_t> foreign_bricks;
+      std::vector<size_t> foreign_indexes;
+
+      // Where the vertexes and faces sit in the mesh
+      std::vector<size_t> vertex_slots;
+      std::vector<size_t> face_slots;
+    };
+
+    // Buffers of one polygonize_brick task, kept from brick to brick and update to update
+    struct BrickScratch {
+      std::vector<std::pair<size_t,vertex_type>> owned;
+      // Three edge slots and then a grid point slot per point of a brick, all npos between
+      // bricks, and the ones set for the current brick
+      std::vector<size_t> slots;
+      std::vector<size_t> touched;
+      std::vector<size_t> order;
+      std::vector<size_t> renumbered;
+    };
+
+    // Brick holding a mesh vertex or face, and its index there
+    using Owner = std::pair<size_t,size_t>;
+
+    Tensor<T,3>& tensor_;
+    const T iso_value_;
+    ThreadPool* pool_;
+
+    size_type bricks_;
+    std::vector<Fragment> fragments_;
+    std::vector<BrickScratch> scratch_;
+    std::vector<bool> marked_;
+    size_t bricks_updated_;
+
+    Mesh mesh_;
+    std::vector<Owner> vertex_owners_;
+    std::vector<Owner> face_owners_;
+
+  public:
+    // Polygonizes the whole tensor
+    IncrementalMarchingCubes(Tensor<T,3>& tensor, const T iso_value, ThreadPool* pool = nullptr)
+      : tensor_(tensor), iso_value_(iso_value), pool_(pool), bricks_updated_(0),
+        mesh_(std::vector<vertex_type>(), std::vector<Mesh::face_type>())
+    {
+      tensor_.track_dirty_bricks();
+      bricks_ = tensor_.dirty_bricks().bricks();
+      fragments_.resize(bricks_.prod());
+      scratch_.resize(pool ? pool->size() : 1);
+      marked_.assign(bricks_.prod(), false);
+      update();
+    }
+
+    const Mesh& mesh() const { return mesh_; }
+
+    // Number of bricks re-polygonized by the last update
+    size_t bricks_updated() const { return bricks_updated_; }
+
+    // Re-polygonizes the bricks written since the last update and patches them into the mesh
+    const Mesh& update() {
+      const std::vector<size_t> dirty = tensor_.take_dirty_bricks();
+      bricks_updated_ = dirty.size();
+      if (dirty.empty()) return mesh_;
+
+      ThreadPool serial(1);
+      ThreadPool& pool = pool_ ? *pool_ : serial;
+
+      // When everything is dirty, the tensor's min/max pyramid (same bricks) is worth building to
+      // skip the bricks the surface cannot pass through
+      const Tensor<T,3>& volume = tensor_;
+      const bool everything = dirty.size() == fragments_.size();
+      const MinMaxPyramid<T>* pyramid = everything ? &volume.min_max_pyramid(&pool) : nullptr;
+
+      // One task per scratch, each taking the next dirty brick until none are left
+      std::atomic<size_t> next(0);
+      pool.parallel_for(scratch_.size(), [&](size_t t) {
+        for (size_t n = next++; n < dirty.size(); n = next++) polygonize_brick(dirty[n], pyramid, scratch_[t]);
+      });
+
+      // Vertex indexes inside the dirty bricks changed, so the foreign edges of their
+      // neighbours must be looked up again, and their faces rewritten
+      std::vector<size_t> affected;
+      for (size_t b : dirty) mark_neighbourhood(b, affected);
+
+      pool.parallel_for(affected.size(), [&](size_t n) { resolve_foreign_edges(affected[n]); });
+
+      if (everything) rebuild(pool);
+      else patch(dirty, affected, pool);
+
+      for (size_t b : affected) marked_[b] = false;
+      return mesh_;
+    }
+
+  private:
+    index_type brick_index(size_t b) const {
+      return index_type(b % bricks_(0), (b / bricks_(0)) % bricks_(1), b / (bricks_(0) * bricks_(1)));
+    }
+
+    // Adds b and the bricks around it to bricks, skipping ones already marked
+    void mark_neighbourhood(size_t b, std::vector<size_t>& bricks) {
+      const index_type brick = brick_index(b);
+      for (size_t z = brick(2) > 0 ? brick(2) - 1 : 0; z <= std::min(brick(2) + 1, bricks_(2) - 1); ++z) {
+        for (size_t y = brick(1) > 0 ? brick(1) - 1 : 0; y <= std::min(brick(1) + 1, bricks_(1) - 1); ++y) {
+          for (size_t x = brick(0) > 0 ? brick(0) - 1 : 0; x <= std::min(brick(0) + 1, bricks_(0) - 1); ++x) {
+            const size_t neighbour = bricks_.absolute_index_for({x, y, z});
+            if (!marked_[neighbour]) {
+              marked_[neighbour] = true;
+              bricks.push_back(neighbour);
+            }
+          }
+        }
+      }
+    }
+
+    size_t owner_of(const index_type& point) const {
+      return bricks_.absolute_index_for({
+        std::min(point(0) / BRICK_SIZE, bricks_(0) - 1),
+        std::min(point(1) / BRICK_SIZE, bricks_(1) - 1),
+        std::min(point(2) / BRICK_SIZE, bricks_(2) - 1)
+      });
+    }
+
+    void polygonize_brick(size_t b, const MinMaxPyramid<T>* pyramid, BrickScratch& scratch) {
+      static constexpr size_t npos = std::numeric_limits<size_t>::max();
+      // Edges (lowest point in [0, BRICK_SIZE] per axis, three axes) touched by the brick's cubes
+      static constexpr size_t SPAN = BRICK_SIZE + 1;
+
+      const Tensor<T,3>& volume = tensor_;
+      const T* data = volume.data();
+      const size_type& size = volume.size();
+      const size_t n_points = size.prod();
+
+      // Emptied in place, keeping the arrays' memory and the mesh slots
+      Fragment& fragment = fragments_[b];
+      fragment.vertexes.clear();
+      fragment.keys.clear();
+      fragment.faces.clear();
+      fragment.foreign_keys.clear();
+      fragment.foreign_bricks.clear();
+
+      const index_type brick = brick_index(b);
+      // A brick at the iso value may still hold grid point vertexes of crossings next to it
+      if (pyramid && !pyramid->brick_crosses(brick(0), brick(1), brick(2), iso_value_) &&
+          !(pyramid->min(brick(0), brick(1), brick(2)) == iso_value_)) {
+        return;
+      }
+
+      const index_type first(BRICK_SIZE*brick(0), BRICK_SIZE*brick(1), BRICK_SIZE*brick(2));
+      const index_type last(
+        std::min(first(0) + BRICK_SIZE, size(0) - 1),
+        std::min(first(1) + BRICK_SIZE, size(1) - 1),
+        std::min(first(2) + BRICK_SIZE, size(2) - 1)
+      );
+
+      auto& owned = scratch.owned;
+      auto& slots = scratch.slots;
+      auto& touched = scratch.touched;
+      owned.clear();
+      std::array<size_t,12> edge_refs;
+
+      // Owned vertexes are numbered up from 0, and foreign ones down from npos - 1 until the
+      // vertexes are counted
+      const auto reference = [&](size_t key, const index_type& point, const vertex_type& vertex) {
+        const size_t owner = owner_of(point);
+        if (owner == b) {
+          owned.emplace_back(key, vertex);
+          return owned.size() - 1;
+        }
+        fragment.foreign_keys.push_back(key);
+        fragment.foreign_bricks.push_back(owner);
+        return npos - fragment.foreign_keys.size();
+      };
+
+      // Cubes are walked by their absolute index in the volume and in the brick's slots
+      const MarchingCubes::CubeOffsets offsets(size(0), size(0)*size(1));
+      const MarchingCubes::CubeOffsets slot_offsets(SPAN, SPAN*SPAN);
+      std::array<size_t,12> axes;
+      for (size_t e = 0; e < axes.size(); ++e) {
+        const auto& delta0 = MarchingCubes::CUBE_INDEX_SHIFTS[MarchingCubes::ORDERED_EDGE_VERTEXES[e].first];
+        const auto& delta1 = MarchingCubes::CUBE_INDEX_SHIFTS[MarchingCubes::ORDERED_EDGE_VERTEXES[e].second];
+        axes[e] = delta1(0) != delta0(0) ? 0 : (delta1(1) != delta0(1) ? 1 : 2);
+      }
+
+      for (size_t k = first(2); k < last(2); ++k) {
+        for (size_t j = first(1); j < last(1); ++j) {
+          size_t cube = size.absolute_index_for(index_type(first(0), j, k));
+          size_t slot_cube = SPAN*((j - first(1)) + SPAN*(k - first(2)));
+
+          for (size_t i = first(0); i < last(0); ++i, ++cube, ++slot_cube) {
+            size_t cube_type = 0;
+            for (size_t c = 0; c < 8; ++c) {
+              if (data[cube + offsets.corners[c]] < iso_value_) cube_type |= (1 << c);
+            }
+
+            const auto& cube_case = MarchingCubes::CUBE_CASES[cube_type];
+            if (cube_case.n_edges == 0) continue;
+            if (slots.empty()) slots.assign(4 * SPAN*SPAN*SPAN, npos);
+
+            for (size_t n = 0; n < cube_case.n_edges; ++n) {
+              const size_t e = cube_case.edges[n];
+
+              const size_t axis = axes[e];
+
+              const size_t s = axis + 4*(slot_cube + slot_offsets.edges[e].first);
+              size_t& slot = slots[s];
+              if (slot == npos) {
+                touched.push_back(s);
+                const auto& delta0 = MarchingCubes::CUBE_INDEX_SHIFTS[MarchingCubes::ORDERED_EDGE_VERTEXES[e].first];
+                const auto& delta1 = MarchingCubes::CUBE_INDEX_SHIFTS[MarchingCubes::ORDERED_EDGE_VERTEXES[e].second];
+                const size_t point_index = cube + offsets.edges[e].first;
+
+                // Same interpolation as MarchingCubes::IsosurfaceLayer::edge_vertex
+                const double v0 = data[point_index];
+                const double v1 = data[cube + offsets.edges[e].second];
+                const double offset = (iso_value_ - v0) / (v1 - v0);
+
+                if (v0 == iso_value_ || v1 == iso_value_) {
+                  const bool upper = v1 == iso_value_;
+                  const index_type point = index_type(i, j, k) + (upper ? delta1 : delta0);
+                  const size_t end = upper ? offsets.edges[e].second : offsets.edges[e].first;
+                  const size_t slot_end = upper ? slot_offsets.edges[e].second : slot_offsets.edges[e].first;
+
+                  const size_t p = 3 + 4*(slot_cube + slot_end);
+                  size_t& point_slot = slots[p];
+                  if (point_slot == npos) {
+                    touched.push_back(p);
+                    point_slot = reference(3*n_points + cube + end, point, vertex_type() + point);
+                  }
+                  slot = point_slot;
+                }
+                else {
+                  slot = reference(3*point_index + axis, index_type(i, j, k) + delta0, (index_type(i, j, k) + delta0) + offset*(delta1 - delta0));
+                }
+              }
+              edge_refs[e] = slot;
+            }
+
+            for (size_t t = 0; t < 3 * size_t(cube_case.n_triangles); t += 3) {
+              fragment.faces.push_back({{
+                edge_refs[cube_case.triangles[t + 0]],
+                edge_refs[cube_case.triangles[t + 1]],
+                edge_refs[cube_case.triangles[t + 2]]
+              }});
+            }
+          }
+        }
+      }
+
+      // A crossing from a lower neighbouring brick can land on one of this brick's own grid points
+      // without reaching any of its cubes
+      const size_t strides[3] = {1, size(0), size(0)*size(1)};
+      index_type owned_end;
+      for (size_t a = 0; a < 3; ++a) owned_end(a) = brick(a) + 1 == bricks_(a) ? last(a) + 1 : last(a);
+
+      for (size_t a = 0; a < 3; ++a) {
+        if (first(a) == 0) continue;
+
+        index_type face_end = owned_end;
+        face_end(a) = first(a) + 1;
+        for (size_t k = first(2); k < face_end(2); ++k) {
+          for (size_t j = first(1); j < face_end(1); ++j) {
+            for (size_t i = first(0); i < face_end(0); ++i) {
+              const size_t point_index = size.absolute_index_for(index_type(i, j, k));
+              if (!(data[point_index] == iso_value_ && data[point_index - strides[a]] < iso_value_)) continue;
+
+              if (slots.empty()) slots.assign(4 * SPAN*SPAN*SPAN, npos);
+              const size_t p = 3 + 4*((i - first(0)) + SPAN*((j - first(1)) + SPAN*(k - first(2))));
+              size_t& point_slot = slots[p];
+              if (point_slot == npos) {
+                touched.push_back(p);
+                point_slot = reference(3*n_points + point_index, index_type(i, j, k), vertex_type() + index_type(i, j, k));
+              }
+            }
+          }
+        }
+      }
+
+      for (size_t s : touched) slots[s] = npos;
+      touched.clear();
+
+      // Own vertexes in key order, so neighbours can find them by binary search
+      auto& order = scratch.order;
+      order.resize(owned.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::sort(order.begin(), order.end(), [&](size_t a, size_t c) { return owned[a].first < owned[c].first; });
+
+      auto& renumbered = scratch.renumbered;
+      renumbered.resize(owned.size());
+      for (size_t n = 0; n < order.size(); ++n) {
+        renumbered[order[n]] = n;
+        fragment.keys.push_back(owned[order[n]].first);
+        fragment.vertexes.push_back(owned[order[n]].second);
+      }
+
+      for (auto& face : fragment.faces) {
+        for (auto& corner : face) {
+          corner = corner < owned.size() ? renumbered[corner] : owned.size() + (npos - 1 - corner);
+        }
+      }
+    }
+
+    void resolve_foreign_edges(size_t b) {
+      Fragment& fragment = fragments_[b];
+      fragment.foreign_indexes.resize(fragment.foreign_keys.size());
+
+      for (size_t n = 0; n < fragment.foreign_keys.size(); ++n) {
+        const auto& keys = fragments_[fragment.foreign_bricks[n]].keys;
+        fragment.foreign_indexes[n] = std::lower_bound(keys.begin(), keys.end(), fragment.foreign_keys[n]) - keys.begin();
+      }
+    }
+
+    // Lays the fragments out in brick order, as after a full update
+    void rebuild(ThreadPool& pool) {
+      std::vector<size_t> vertex_offsets(fragments_.size() + 1, 0);
+      std::vector<size_t> face_offsets(fragments_.size() + 1, 0);
+      for (size_t b = 0; b < fragments_.size(); ++b) {
+        vertex_offsets[b+1] = vertex_offsets[b] + fragments_[b].vertexes.size();
+        face_offsets[b+1] = face_offsets[b] + fragments_[b].faces.size();
+      }
+
+      // With room to grow, so that the first edits to add to the surface do not copy the mesh
+      std::vector<vertex_type> vertexes;
+      std::vector<Mesh::face_type> faces;
+      reserve_spare(vertexes, vertex_owners_, vertex_offsets.back());
+      reserve_spare(faces, face_owners_, face_offsets.back());
+
+      // A few ranges of bricks per thread, since most bricks are empty.  Faces are written once
+      // every brick has its vertex slots.
+      const size_t n_ranges = std::min(fragments_.size(), 8 * pool.size());
+      const auto for_each_brick = [&](const auto& f) {
+        pool.parallel_for(n_ranges, [&](size_t r) {
+          for (size_t b = fragments_.size() * r / n_ranges; b < fragments_.size() * (r + 1) / n_ranges; ++b) f(b);
+        });
+      };
+
+      for_each_brick([&](size_t b) {
+        Fragment& fragment = fragments_[b];
+        fragment.vertex_slots.resize(fragment.vertexes.size());
+        for (size_t v = 0; v < fragment.vertexes.size(); ++v) {
+          fragment.vertex_slots[v] = vertex_offsets[b] + v;
+          vertexes[vertex_offsets[b] + v] = fragment.vertexes[v];
+          vertex_owners_[vertex_offsets[b] + v] = Owner(b, v);
+        }
+        fragment.face_slots.resize(fragment.faces.size());
+        for (size_t f = 0; f < fragment.faces.size(); ++f) {
+          fragment.face_slots[f] = face_offsets[b] + f;
+          face_owners_[face_offsets[b] + f] = Owner(b, f);
+        }
+      });
+      for_each_brick([&](size_t b) { write_faces(b, faces); });
+
+      mesh_ = Mesh(std::move(vertexes), std::move(faces));
+    }
+
+    template <typename Element>
+    static void reserve_spare(std::vector<Element>& elements, std::vector<Owner>& owners, size_t size) {
+      elements.reserve(size + size / 8);
+      owners.reserve(size + size / 8);
+      elements.resize(size);
+      owners.resize(size);
+    }
+
+    // Writes the vertexes and faces of the dirty bricks into the mesh, and rewrites the faces of
+    // rewrite (the bricks around them) and of the bricks around any vertex moved to fill a gap
+    void patch(const std::vector<size_t>& dirty, std::vector<size_t>& rewrite, ThreadPool& pool) {
+      std::vector<vertex_type> vertexes;
+      std::vector<Mesh::face_type> faces;
+      std::vector<vertex_type> normals;
+      mesh_.swap_arrays(vertexes, faces, normals);
+
+      reassign_slots(dirty, &Fragment::vertex_slots, [](const Fragment& fragment) { return fragment.vertexes.size(); },
+                     vertexes, vertex_owners_, [&](size_t b) { mark_neighbourhood(b, rewrite); });
+      for (size_t b : dirty) {
+        const Fragment& fragment = fragments_[b];
+        for (size_t v = 0; v < fragment.vertexes.size(); ++v) vertexes[fragment.vertex_slots[v]] = fragment.vertexes[v];
+      }
+
+      // A moved face keeps pointing at the right vertexes, or belongs to a brick in rewrite
+      reassign_slots(dirty, &Fragment::face_slots, [](const Fragment& fragment) { return fragment.faces.size(); },
+                     faces, face_owners_, [](size_t) {});
+      pool.parallel_for(rewrite.size(), [&](size_t n) { write_faces(rewrite[n], faces); });
+
+      mesh_.swap_arrays(vertexes, faces, normals);
+    }
+
+    // Gives each dirty brick one slot of elements per element it now has: its old slots first,
+    // then ones other dirty bricks gave up, then new ones at the end.  Slots left over are filled
+    // with the last elements, calling moved(brick) for the brick of each.
+    template <typename Element, typename Count, typename Moved>
+    void reassign_slots(const std::vector<size_t>& dirty, std::vector<size_t> Fragment::* slots_of, const Count& count,
+                        std::vector<Element>& elements, std::vector<Owner>& owners, const Moved& moved) {
+      static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+      std::vector<size_t> freed;
+      for (size_t b : dirty) {
+        std::vector<size_t>& slots = fragments_[b].*slots_of;
+        const size_t n = count(fragments_[b]);
+        for (size_t s = n; s < slots.size(); ++s) {
+          freed.push_back(slots[s]);
+          owners[slots[s]] = Owner(npos, npos);
+        }
+        if (slots.size() > n) slots.resize(n);
+      }
+
+      for (size_t b : dirty) {
+        std::vector<size_t>& slots = fragments_[b].*slots_of;
+        const size_t n = count(fragments_[b]);
+        while (slots.size() < n) {
+          if (freed.empty()) {
+            slots.push_back(elements.size());
+            elements.emplace_back();
+            owners.emplace_back();
+          }
+          else {
+            slots.push_back(freed.back());
+            freed.pop_back();
+          }
+          owners[slots.back()] = Owner(b, slots.size() - 1);
+        }
+      }
+
+      // Lowest gap first, dropping gaps at the end as they come up
+      std::sort(freed.begin(), freed.end());
+      for (size_t gap : freed) {
+        while (!owners.empty() && owners.back().first == npos) {
+          owners.pop_back();
+          elements.pop_back();
+        }
+        if (gap >= owners.size()) break;
+
+        const Owner owner = owners.back();
+        elements[gap] = elements.back();
+        owners[gap] = owner;
+        (fragments_[owner.first].*slots_of)[owner.second] = gap;
+        owners.pop_back();
+        elements.pop_back();
+        moved(owner.first);
+      }
+      while (!owners.empty() && owners.back().first == npos) {
+        owners.pop_back();
+        elements.pop_back();
+      }
+    }
+
+    void write_faces(size_t b, std::vector<Mesh::face_type>& faces) const {
+      const Fragment& fragment = fragments_[b];
+      const auto global_index = [&](size_t corner) {
+        if (corner < fragment.vertexes.size()) return fragment.vertex_slots[corner];
+        const size_t n = corner - fragment.vertexes.size();
+        return fragments_[fragment.foreign_bricks[n]].vertex_slots[fragment.foreign_indexes[n]];
+      };
+
+      for (size_t f = 0; f < fragment.faces.size(); ++f) {
+        const auto& face = fragment.faces[f];
+        faces[fragment.face_slots[f]] = Mesh::face_type(global_index(face[0]), global_index(face[1]), global_index(face[2]));
+      }
+    }
+};
+
+template <typename T> constexpr size_t IncrementalMarchingCubes<T>::BRICK_SIZE;
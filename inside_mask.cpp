@@ -0,0 +1,75 @@
+#include "inside_mask.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace {
+  // Spreads the 8 bits of a byte over the 8 bytes of a word: byte b in memory holds bit b
+  const std::array<uint64_t,256>& spread_table() {
+    static const std::array<uint64_t,256> table = [] {
+      std::array<uint64_t,256> t;
+      for (size_t v = 0; v < t.size(); ++v) {
+        uint8_t bytes[8];
+        for (size_t b = 0; b < 8; ++b) bytes[b] = (v >> b) & 1;
+        std::memcpy(&t[v], bytes, sizeof(bytes));
+      }
+      return t;
+    }();
+    return table;
+  }
+}
+
+bool InsideMask::classify_row(size_t j, size_t k, uint8_t* cube_types) const {
+  const auto& spread = spread_table();
+
+  const size_t n_cubes = size_(0) - 1;
+
+  // Rows at (dy, dz) offsets (0,0), (1,0), (0,1), (1,1) from the cube row
+  const std::array<const uint64_t*,4> rows = {{row(j, k), row(j+1, k), row(j, k+1), row(j+1, k+1)}};
+
+  bool any = false;
+  for (size_t w = 0; w * 64 < n_cubes; ++w) {
+    // Outside bits of each corner for the 64 cubes starting at x = 64w.  Corners at dx = 1 read
+    // the row shifted down by one, with the low bit of the next word moved in on top.
+    std::array<uint64_t,8> outside;
+    for (size_t r = 0; r < rows.size(); ++r) {
+      const uint64_t plain = rows[r][w];
+      const uint64_t shifted = (plain >> 1) | (w + 1 < words_per_row_ ? rows[r][w+1] << 63 : 0);
+
+      // Corner numbering follows CUBE_INDEX_SHIFTS: corners 0,1,2,3 at dz = 0 and 4,5,6,7 at dz = 1
+      const size_t dz = r / 2;
+      if (r % 2 == 0) {
+        outside[4*dz + 0] = ~plain;
+        outside[4*dz + 1] = ~shifted;
+      }
+      else {
+        outside[4*dz + 2] = ~shifted;
+        outside[4*dz + 3] = ~plain;
+      }
+    }
+
+    const size_t begin = 64*w;
+    const size_t count = std::min<size_t>(64, n_cubes - begin);
+    const uint64_t valid = count == 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+
+    // All corners the same for every cube means all cubes are fully inside or outside
+    uint64_t differ = 0;
+    for (size_t c = 1; c < outside.size(); ++c) differ |= outside[c] ^ outside[0];
+    if ((differ & valid) == 0) {
+      std::memset(cube_types + begin, (outside[0] & 1) ? 0xFF : 0x00, count);
+      continue;
+    }
+    any = true;
+
+    for (size_t b = 0; b < count; b += 8) {
+      uint64_t types = 0;
+      for (size_t c = 0; c < outside.size(); ++c) {
+        types |= spread[(outside[c] >> b) & 0xFF] << c;
+      }
+      std::memcpy(cube_types + begin + b, &types, std::min<size_t>(8, count - b));
+    }
+  }
+
+  return any;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "size.h"
+#include "thread_pool.h"
+
+// Inside/outside state of every grid point of a volume, one bit each.  Rows of x values are
+// packed into 64 bit words (bit i % 64 of word i / 64), so whole runs of cubes can be classified
+// with a few word operations.
+class InsideMask {
+  public:
+    using size_type = Size<size_t,3>;
+
+  private:
+    size_type size_;
+    size_t words_per_row_;
+    std::vector<uint64_t> words_;
+
+  public:
+    // No points, until assigned
+    InsideMask() : words_per_row_(0) {}
+
+    // is_inside_at(i, j, k) gives the state of grid point (i, j, k).  Planes are filled in
+    // parallel on the pool.
+    template <typename InsideAt>
+    InsideMask(const size_type& size, const InsideAt& is_inside_at, ThreadPool& pool) {
+      assign(size, is_inside_at, pool);
+    }
+
+    // Refills the mask for another volume, reusing the memory of the last one
+    template <typename InsideAt>
+    void assign(const size_type& size, const InsideAt& is_inside_at, ThreadPool& pool) {
+      size_ = size;
+      words_per_row_ = (size(0) + 63) / 64;
+      words_.resize(words_per_row_ * size(1) * size(2));
+
+      pool.parallel_for(size(2), [&](size_t k) {
+        for (size_t j = 0; j < size_(1); ++j) {
+          uint64_t* words = row(j, k);
+          for (size_t w = 0; w < words_per_row_; ++w) {
+            const size_t begin = 64*w;
+            const size_t end = std::min(begin + 64, size_(0));
+
+            uint64_t word = 0;
+            for (size_t i = begin; i < end; ++i) {
+              word |= uint64_t(is_inside_at(i, j, k) ? 1 : 0) << (i - begin);
+            }
+            words[w] = word;
+          }
+        }
+      });
+    }
+
+    const size_type& size() const { return size_; }
+
+    const uint64_t* row(size_t j, size_t k) const { return words_.data() + words_per_row_ * (j + size_(1)*k); }
+
+    // Cube types (bit c set when corner c of MarchingCubes::CUBE_INDEX_SHIFTS is outside) of the
+    // size(0) - 1 cubes of row j in cube layer k.  Returns false if no cube in the row can have
+    // triangles.
+    bool classify_row(size_t j, size_t k, uint8_t* cube_types) const;
+
+  private:
+    uint64_t* row(size_t j, size_t k) { return words_.data() + words_per_row_ * (j + size_(1)*k); }
+};
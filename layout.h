@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "size.h"
+
+// Storage orders for 3D grids.  LinearLayout is the x-fastest order of a plain Tensor.  The other
+// layouts keep values that are close in space close in memory, so the 8 corners of a cube (and
+// neighbouring rows and planes) share cache lines and pages.
+//
+// Every layout here is separable: value (i,j,k) is stored at
+//
+//   axes[0][i] + axes[1][j] + axes[2][k]
+//
+// so an element's offset costs three small table lookups, and the tables for a row of cubes are
+// walked like arrays.
+
+struct LinearLayout {};
+
+struct AxisOffsets {
+  std::array<std::vector<size_t>,3> axes;
+  // Number of elements to store, including padding
+  size_t storage_size;
+};
+
+// Cubic bricks of B^3 values, each stored x-fastest, with the bricks themselves in x-fastest
+// order.  Partial bricks at the upper faces are padded to full bricks.
+template <size_t B>
+struct BrickedLayout {
+  static_assert(B >= 1, "Brick size must be at least 1");
+
+  static constexpr size_t BRICK_SIZE = B;
+
+  static AxisOffsets offsets(const Size<size_t,3>& size) {
+    const size_t brick_volume = B*B*B;
+    const std::array<size_t,3> bricks = {{(size(0) + B - 1) / B, (size(1) + B - 1) / B, (size(2) + B - 1) / B}};
+
+    // Stride of one brick and of one value inside a brick, along each axis
+    const std::array<size_t,3> brick_strides = {{brick_volume, brick_volume*bricks[0], brick_volume*bricks[0]*bricks[1]}};
+    const std::array<size_t,3> inner_strides = {{1, B, B*B}};
+
+    AxisOffsets offsets;
+    for (size_t d = 0; d < 3; ++d) {
+      offsets.axes[d].resize(size(d));
+      for (size_t i = 0; i < size(d); ++i) {
+        offsets.axes[d][i] = (i / B) * brick_strides[d] + (i % B) * inner_strides[d];
+      }
+    }
+    offsets.storage_size = brick_volume * bricks[0] * bricks[1] * bricks[2];
+    return offsets;
+  }
+};
+
+template <size_t B> constexpr size_t BrickedLayout<B>::BRICK_SIZE;
+
+// Z-order: the bits of i, j and k are interleaved (x lowest), for as many bits as each axis
+// needs.  Each axis is padded up to a power of two.
+struct MortonLayout {
+  static AxisOffsets offsets(const Size<size_t,3>& size) {
+    std::array<size_t,3> bits;
+    for (size_t d = 0; d < 3; ++d) {
+      bits[d] = 0;
+      while ((size_t(1) << bits[d]) < size(d)) ++bits[d];
+    }
+
+    // Storage bit position of each bit of each axis
+    std::array<std::vector<size_t>,3> positions;
+    size_t position = 0;
+    for (size_t bit = 0; bit < *std::max_element(bits.begin(), bits.end()); ++bit) {
+      for (size_t d = 0; d < 3; ++d) {
+        if (bit < bits[d]) positions[d].push_back(position++);
+      }
+    }
+
+    AxisOffsets offsets;
+    for (size_t d = 0; d < 3; ++d) {
+      offsets.axes[d].resize(size(d));
+      for (size_t i = 0; i < size(d); ++i) {
+        size_t offset = 0;
+        for (size_t bit = 0; bit < bits[d]; ++bit) {
+          offset |= ((i >> bit) & 1) << positions[d][bit];
+        }
+        offsets.axes[d][i] = offset;
+      }
+    }
+    offsets.storage_size = size_t(1) << position;
+    return offsets;
+  }
+};
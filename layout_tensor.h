@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "size.h"
+#include "point.h"
+#include "layout.h"
+#include "min_max_pyramid.h"
+#include "summary_cache.h"
+#include "tensor.h"
+
+// 3D tensor stored in one of the separable layouts of layout.h.  Tensor<T,3,Layout> is this class
+// for every layout other than LinearLayout, so bricked or Z-ordered storage is picked with the
+// layout parameter, e.g. Tensor<float,3,BrickedLayout<8>>.
+//
+// Values are reached through per-axis offset tables (see AxisOffsets).  row() gives a row of x
+// values in place, walked by an iterator whose neighbours along x are one table lookup away, and
+// the neighbours along y and z are in the rows next to it.  This is how MarchingCubes reads these
+// tensors, four rows at a time for a row of cubes.
+template <typename T, typename Layout>
+class LayoutTensor {
+  public:
+    using size_type            = Size<size_t,3>;
+    using index_type           = Point<size_t,3>;
+    using reference_type       = typename std::vector<T>::reference;
+    using const_reference_type = typename std::vector<T>::const_reference;
+
+    // Values of row (j, k) in x order
+    class ConstRow {
+      public:
+        // Random access along the row, it[n] being the value n places further along x
+        class const_iterator {
+          public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type        = T;
+            using difference_type   = ptrdiff_t;
+            using pointer           = const T*;
+            using reference         = const T&;
+
+          private:
+            const T* base_;
+            const size_t* x_offset_;
+
+          public:
+            const_iterator(const T* base, const size_t* x_offset) : base_(base), x_offset_(x_offset) {}
+
+            const T& operator*() const { return base_[*x_offset_]; }
+            const T& operator[](difference_type n) const { return base_[x_offset_[n]]; }
+
+            const_iterator& operator++() { ++x_offset_; return *this; }
+            const_iterator operator++(int) { const_iterator it = *this; ++x_offset_; return it; }
+            const_iterator& operator--() { --x_offset_; return *this; }
+            const_iterator operator--(int) { const_iterator it = *this; --x_offset_; return it; }
+            const_iterator& operator+=(difference_type n) { x_offset_ += n; return *this; }
+            const_iterator& operator-=(difference_type n) { x_offset_ -= n; return *this; }
+            const_iterator operator+(difference_type n) const { return const_iterator(base_, x_offset_ + n); }
+            const_iterator operator-(difference_type n) const { return const_iterator(base_, x_offset_ - n); }
+            difference_type operator-(const const_iterator& other) const { return x_offset_ - other.x_offset_; }
+
+            bool operator==(const const_iterator& other) const { return x_offset_ == other.x_offset_; }
+            bool operator!=(const const_iterator& other) const { return x_offset_ != other.x_offset_; }
+            bool operator<(const const_iterator& other) const { return x_offset_ < other.x_offset_; }
+        };
+
+      private:
+        const T* base_;
+        const size_t* x_offsets_;
+        size_t size_;
+
+      public:
+        ConstRow(const T* base, const size_t* x_offsets, size_t size) : base_(base), x_offsets_(x_offsets), size_(size) {}
+
+        const T& operator[](size_t i) const { return base_[x_offsets_[i]]; }
+        size_t size() const { return size_; }
+
+        const_iterator begin() const { return const_iterator(base_, x_offsets_); }
+        const_iterator end() const { return const_iterator(base_, x_offsets_ + size_); }
+    };
+
+  private:
+    const size_type size_;
+    AxisOffsets offsets_;
+    std::vector<T> data_;
+
+    SummaryCache<std::pair<T,T>> min_max_;
+    SummaryCache<MinMaxPyramid<T>> min_max_pyramid_;
+
+  public:
+    explicit LayoutTensor(size_type size)
+      : size_(size), offsets_(Layout::offsets(size)), data_(offsets_.storage_size)
+    {}
+
+    explicit LayoutTensor(size_type size, const T& fill)
+      : size_(size), offsets_(Layout::offsets(size)), data_(offsets_.storage_size, fill)
+    {}
+
+    // Reorders the values of a linear tensor
+    explicit LayoutTensor(const Tensor<T,3>& tensor) : LayoutTensor(tensor.size()) {
+      const T* values = tensor.data();
+      for (size_t k = 0; k < size_(2); ++k) {
+        for (size_t j = 0; j < size_(1); ++j) {
+          T* row = data_.data() + offsets_.axes[1][j] + offsets_.axes[2][k];
+          for (size_t i = 0; i < size_(0); ++i) {
+            row[offsets_.axes[0][i]] = *values++;
+          }
+        }
+      }
+    }
+
+    const_reference_type operator()(size_t i, size_t j, size_t k) const {
+      return data_[offset(i, j, k)];
+    }
+    // Drops the cached min/max and pyramid
+    reference_type operator()(size_t i, size_t j, size_t k) {
+      reset_summaries();
+      return data_[offset(i, j, k)];
+    }
+
+    const_reference_type operator()(const index_type& index) const {
+      return data_[offset(index(0), index(1), index(2))];
+    }
+    reference_type operator()(const index_type& index) {
+      reset_summaries();
+      return data_[offset(index(0), index(1), index(2))];
+    }
+
+    size_t offset(size_t i, size_t j, size_t k) const {
+      return offsets_.axes[0][i] + offsets_.axes[1][j] + offsets_.axes[2][k];
+    }
+
+    ConstRow row(size_t j, size_t k) const {
+      return ConstRow(data_.data() + offsets_.axes[1][j] + offsets_.axes[2][k], offsets_.axes[0].data(), size_(0));
+    }
+
+    // Copies the size(0) values of row (j, k) into values, in x order
+    void read_row(size_t j, size_t k, T* values) const {
+      const ConstRow source = row(j, k);
+      std::copy(source.begin(), source.end(), values);
+    }
+
+    // Copy in plain x-fastest order
+    Tensor<T,3> to_linear() const {
+      Tensor<T,3> tensor(size_);
+      T* values = tensor.data();
+      for (size_t k = 0; k < size_(2); ++k) {
+        for (size_t j = 0; j < size_(1); ++j) {
+          read_row(j, k, values);
+          values += size_(0);
+        }
+      }
+      return tensor;
+    }
+
+    T min() const { return min_max().first; }
+    T max() const { return min_max().second; }
+
+    // Per-brick min/max for skipping empty regions, built on first use and cached (as for Tensor)
+    const MinMaxPyramid<T>& min_max_pyramid(ThreadPool* pool = nullptr) const {
+      return min_max_pyramid_.get([&]() {
+        auto pyramid = std::make_shared<MinMaxPyramid<T>>();
+        pyramid->assign_rows([this](size_t j, size_t k) { return row(j, k); }, size_, pool);
+        return std::shared_ptr<const MinMaxPyramid<T>>(std::move(pyramid));
+      });
+    }
+
+    const size_type& size() const { return size_; }
+    const AxisOffsets& offsets() const { return offsets_; }
+
+  private:
+    void reset_summaries() {
+      min_max_.reset();
+      min_max_pyramid_.reset();
+    }
+
+    // Padding is skipped, and NaN values are folded in as for Tensor
+    const std::pair<T,T>& min_max() const {
+      return min_max_.get([&]() {
+        T min = std::numeric_limits<T>::max();
+        T max = std::numeric_limits<T>::lowest();
+
+        if (size_.prod() > 0) min = max = row(0, 0)[0];
+        for (size_t k = 0; k < size_(2); ++k) {
+          for (size_t j = 0; j < size_(1); ++j) {
+            for (const auto& val : row(j, k)) {
+              MinMaxPyramid<T>::lower(val, min);
+              MinMaxPyramid<T>::raise(val, max);
+            }
+          }
+        }
+
+        return std::make_shared<const std::pair<T,T>>(min, max);
+      });
+    }
+};
+
+template <typename T, size_t B>
+class Tensor<T,3,BrickedLayout<B>> : public LayoutTensor<T,BrickedLayout<B>> {
+  public:
+    using LayoutTensor<T,BrickedLayout<B>>::LayoutTensor;
+};
+
+template <typename T>
+class Tensor<T,3,MortonLayout> : public LayoutTensor<T,MortonLayout> {
+  public:
+    using LayoutTensor<T,MortonLayout>::LayoutTensor;
+};
@@ -7,7 +7,7 @@
 #include <iostream>
 #include <fstream>
 
-// g++ -Wall --std=c++14 -g *.cpp -o main && ./main
+// g++ -Wall --std=c++14 -pthread -g *.cpp -o main && ./main
 int main() {
   Tensor<uint8_t,3> tensor({5u, 5u, 5u}, 0);
 
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "size.h"
+#include "point.h"
+#include "npy_file.h"
+#include "min_max_pyramid.h"
+#include "summary_cache.h"
+
+// Read-only Tensor backed by a memory mapped .npy file, so the data is never copied.  The header
+// is checked against T and N.  Either memory order maps onto the x-fastest layout of Tensor: a C
+// ordered array of shape (nz, ny, nx) and a Fortran ordered array of shape (nx, ny, nz) both give
+// size (nx, ny, nz).
+template <typename T, size_t N>
+class MappedTensor {
+  static_assert(N >= 1, "N must be at least 1 for MappedTensor");
+
+  public:
+    using size_type            = Size<size_t,N>;
+    using index_type           = Point<size_t,N>;
+    using const_reference_type = const T&;
+
+  private:
+    std::shared_ptr<const MappedFile> file_;
+    size_type size_;
+    const T* data_;
+
+    SummaryCache<std::pair<T,T>> min_max_;
+    SummaryCache<MinMaxPyramid<T>> min_max_pyramid_;
+
+  public:
+    // Throws std::runtime_error if the file cannot be mapped or does not hold an N dimensional
+    // array of T
+    explicit MappedTensor(const std::string& path)
+      : file_(std::make_shared<const MappedFile>(path)), data_(nullptr)
+    {
+      const NpyHeader header = NpyHeader::parse(file_->data(), file_->size());
+
+      if (!header.has_type(NpyType<T>::code())) {
+        throw std::runtime_error(path + ": dtype " + header.descr + " does not match " + NpyType<T>::code());
+      }
+      if (header.shape.size() != N) {
+        throw std::runtime_error(path + ": array has " + std::to_string(header.shape.size()) + " dimensions, expected " + std::to_string(N));
+      }
+
+      for (size_t i = 0; i < N; ++i) {
+        size_(i) = header.fortran_order ? header.shape[i] : header.shape[N-1-i];
+      }
+
+      if (header.data_offset + sizeof(T) * size_.prod() > file_->size()) {
+        throw std::runtime_error(path + ": file is shorter than its shape");
+      }
+      if ((header.data_offset % alignof(T)) != 0) {
+        throw std::runtime_error(path + ": array data is not aligned");
+      }
+
+      data_ = reinterpret_cast<const T*>(file_->data() + header.data_offset);
+    }
+
+    const_reference_type operator()(size_t i) const {
+      return data_[i];
+    }
+
+    const_reference_type operator()(const index_type& index) const {
+      return data_[size_.absolute_index_for(index)];
+    }
+
+    template <typename ... Args>
+    const_reference_type operator()(const Args& ... args) const {
+      static_assert(sizeof...(args) == N, "Variable argument pack size in operator() must match N");
+      return data_[size_.absolute_index_for(index_type(args...))];
+    }
+
+    // min(), max() and the pyramid are built on first use, safely from several threads at once
+    T min() const { return min_max().first; }
+    T max() const { return min_max().second; }
+
+    const MinMaxPyramid<T>& min_max_pyramid(ThreadPool* pool = nullptr) const {
+      static_assert(N == 3, "min_max_pyramid() is only available when N == 3");
+      return min_max_pyramid_.get([&]() { return std::make_shared<const MinMaxPyramid<T>>(data_, size_, pool); });
+    }
+
+    const size_type& size() const { return size_; }
+
+    // Elements in x-fastest order
+    const T* data() const { return data_; }
+
+    const T* begin() const { return data_; }
+    const T* end()   const { return data_ + size_.prod(); }
+
+  private:
+    // NaN values are folded in as for Tensor
+    const std::pair<T,T>& min_max() const {
+      return min_max_.get([&]() {
+        T min = std::numeric_limits<T>::max();
+        T max = std::numeric_limits<T>::lowest();
+
+        if (size_.prod() > 0) min = max = data_[0];
+        for (const auto& val : *this) {
+          MinMaxPyramid<T>::lower(val, min);
+          MinMaxPyramid<T>::raise(val, max);
+        }
+
+        return std::make_shared<const std::pair<T,T>>(min, max);
+      });
+    }
+};
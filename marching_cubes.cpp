@@ -1,7 +1,215 @@
 #include "marching_cubes.h"
 
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
 constexpr std::array<MarchingCubes::index_type,8>    MarchingCubes::CUBE_INDEX_SHIFTS;
 constexpr std::array<MarchingCubes::vertex_type, 12> MarchingCubes::CUBE_EDGE_SHIFTS;
 constexpr std::array<std::pair<size_t,size_t>, 12>   MarchingCubes::EDGE_VERTEXES;
+constexpr std::array<std::pair<size_t,size_t>, 12>   MarchingCubes::ORDERED_EDGE_VERTEXES;
 constexpr std::array<int,256>                        MarchingCubes::EDGE_TABLE;
 constexpr std::array<std::array<int, 16>, 256>       MarchingCubes::TRIANGLE_TABLE;
+constexpr size_t                                     MarchingCubes::SLAB_DEPTH;
+
+namespace {
+  constexpr MarchingCubes::CubeCase make_cube_case(size_t cube_type) {
+    MarchingCubes::CubeCase cube_case{};
+
+    for (size_t e = 0; e < 12; ++e) {
+      if (MarchingCubes::EDGE_TABLE[cube_type] & (1 << e)) cube_case.edges[cube_case.n_edges++] = e;
+    }
+
+    size_t t = 0;
+    for (; MarchingCubes::TRIANGLE_TABLE[cube_type][t] != -1; ++t) {
+      cube_case.triangles[t] = MarchingCubes::TRIANGLE_TABLE[cube_type][t];
+    }
+    cube_case.n_triangles = t / 3;
+
+    return cube_case;
+  }
+
+  template <size_t ... CubeTypes>
+  constexpr std::array<MarchingCubes::CubeCase,256> make_cube_cases(std::index_sequence<CubeTypes...>) {
+    return {{make_cube_case(CubeTypes)...}};
+  }
+}
+
+constexpr std::array<MarchingCubes::CubeCase,256> MarchingCubes::CUBE_CASES = make_cube_cases(std::make_index_sequence<256>());
+
+static_assert(sizeof(MarchingCubes::CubeCase) == 32, "CubeCase should fill half a cache line");
+static_assert(MarchingCubes::CUBE_CASES[1].n_edges == 3 && MarchingCubes::CUBE_CASES[1].n_triangles == 1, "CUBE_CASES must be built from the tables");
+
+namespace {
+  // Storage for the stitched vertexes and faces of each mesh form, filled in parallel by index
+  template <typename MeshType> class MeshAssembler;
+
+  template <typename S, typename I>
+  class MeshAssembler<BasicMesh<S,I>> {
+    private:
+      std::vector<typename BasicMesh<S,I>::vertex_type> vertexes_;
+      std::vector<typename BasicMesh<S,I>::face_type> faces_;
+      std::vector<typename BasicMesh<S,I>::vertex_type> normals_;
+
+    public:
+      // Builds in the arrays of mesh, which is emptied
+      MeshAssembler(BasicMesh<S,I>& mesh, size_t n_vertexes, size_t n_faces, bool normals) {
+        mesh.release_arrays(vertexes_, faces_, normals_);
+        vertexes_.resize(n_vertexes);
+        faces_.resize(n_faces);
+        normals_.resize(normals ? n_vertexes : 0);
+      }
+
+      void set_vertex(size_t v, const MarchingCubes::vertex_type& vertex) {
+        vertexes_[v] = typename BasicMesh<S,I>::vertex_type(S(vertex.x()), S(vertex.y()), S(vertex.z()));
+      }
+      void set_normal(size_t v, const MarchingCubes::vertex_type& normal) {
+        normals_[v] = typename BasicMesh<S,I>::vertex_type(S(normal.x()), S(normal.y()), S(normal.z()));
+      }
+      void set_face(size_t f, size_t a, size_t b, size_t c) {
+        faces_[f] = typename BasicMesh<S,I>::face_type(I(a), I(b), I(c));
+      }
+
+      BasicMesh<S,I> take() { return BasicMesh<S,I>(std::move(vertexes_), std::move(faces_), std::move(normals_)); }
+  };
+
+  template <typename S, typename I>
+  class MeshAssembler<MeshArrays<S,I>> {
+    private:
+      std::vector<S> x_, y_, z_;
+      std::vector<I> indexes_;
+      std::vector<S> normal_x_, normal_y_, normal_z_;
+
+    public:
+      MeshAssembler(MeshArrays<S,I>& mesh, size_t n_vertexes, size_t n_faces, bool normals) {
+        mesh.release_arrays(x_, y_, z_, indexes_, normal_x_, normal_y_, normal_z_);
+        for (auto* array : {&x_, &y_, &z_}) array->resize(n_vertexes);
+        for (auto* array : {&normal_x_, &normal_y_, &normal_z_}) array->resize(normals ? n_vertexes : 0);
+        indexes_.resize(3 * n_faces);
+      }
+
+      void set_vertex(size_t v, const MarchingCubes::vertex_type& vertex) {
+        x_[v] = S(vertex.x());
+        y_[v] = S(vertex.y());
+        z_[v] = S(vertex.z());
+      }
+      void set_normal(size_t v, const MarchingCubes::vertex_type& normal) {
+        normal_x_[v] = S(normal.x());
+        normal_y_[v] = S(normal.y());
+        normal_z_[v] = S(normal.z());
+      }
+      void set_face(size_t f, size_t a, size_t b, size_t c) {
+        indexes_[3*f + 0] = I(a);
+        indexes_[3*f + 1] = I(b);
+        indexes_[3*f + 2] = I(c);
+      }
+
+      MeshArrays<S,I> take() {
+        return MeshArrays<S,I>(std::move(x_), std::move(y_), std::move(z_), std::move(indexes_), std::move(normal_x_), std::move(normal_y_), std::move(normal_z_));
+      }
+  };
+}
+
+// Both slabs next to a shared vertex plane create the vertexes on it.  The copy in the lower
+// slab (on its top plane) is dropped and its faces are pointed at the upper slab's copy.
+template <typename MeshType>
+void MarchingCubes::stitch_slabs(std::vector<Slab>& slabs, ThreadPool& pool, MeshType& mesh) {
+  const size_t n_slabs = slabs.size();
+
+  // mesh_indexes[v] of slab s starts as the index of slab vertex v among the kept vertexes of
+  // slab s, or npos if it is dropped.  seams pairs each dropped vertex with its copy in slab s+1.
+  pool.parallel_for(n_slabs, [&](size_t s) {
+    auto& index = slabs[s].mesh_indexes;
+    index.assign(slabs[s].vertexes.size(), 0);
+
+    if (s + 1 < n_slabs) {
+      auto top = slabs[s].top_edges.begin();
+      auto bottom = slabs[s+1].bottom_edges.begin();
+
+      while (top != slabs[s].top_edges.end() && bottom != slabs[s+1].bottom_edges.end()) {
+        if (top->first < bottom->first) {
+          ++top;
+        }
+        else if (bottom->first < top->first) {
+          ++bottom;
+        }
+        else {
+          slabs[s].seams.emplace_back(top->second, bottom->second);
+          index[top->second] = EdgeCache::npos;
+          ++top;
+          ++bottom;
+        }
+      }
+    }
+
+    size_t n_kept = 0;
+    for (auto& i : index) {
+      if (i != EdgeCache::npos) i = n_kept++;
+    }
+
+    slabs[s].vertex_offset = n_kept;
+    slabs[s].face_offset = slabs[s].faces.size();
+  });
+
+  size_t n_vertexes = 0, n_faces = 0;
+  for (auto& slab : slabs) {
+    n_vertexes += slab.vertex_offset;
+    n_faces += slab.face_offset;
+    slab.vertex_offset = n_vertexes - slab.vertex_offset;
+    slab.face_offset = n_faces - slab.face_offset;
+  }
+
+  // Resolve dropped vertexes to their mesh index in the next slab
+  pool.parallel_for(n_slabs, [&](size_t s) {
+    if (s + 1 == n_slabs) return;
+    for (auto& seam : slabs[s].seams) {
+      seam.second = slabs[s+1].vertex_offset + slabs[s+1].mesh_indexes[seam.second];
+    }
+  });
+
+  if (n_vertexes > size_t(std::numeric_limits<typename MeshType::vertex_index_type>::max())) {
+    throw std::runtime_error("Mesh has too many vertexes for its index type");
+  }
+
+  const bool normals = std::any_of(slabs.begin(), slabs.end(), [](const Slab& slab) { return !slab.normals.empty(); });
+  MeshAssembler<MeshType> assembler(mesh, n_vertexes, n_faces, normals);
+
+  pool.parallel_for(n_slabs, [&](size_t s) {
+    auto& slab = slabs[s];
+    auto& index = slab.mesh_indexes;
+
+    for (size_t v = 0; v < index.size(); ++v) {
+      if (index[v] == EdgeCache::npos) continue;
+      index[v] += slab.vertex_offset;
+      assembler.set_vertex(index[v], slab.vertexes[v]);
+      if (normals) assembler.set_normal(index[v], slab.normals[v]);
+    }
+    for (const auto& seam : slab.seams) {
+      index[seam.first] = seam.second;
+    }
+
+    for (size_t f = 0; f < slab.faces.size(); ++f) {
+      assembler.set_face(
+        slab.face_offset + f,
+        index[std::get<0>(slab.faces[f])],
+        index[std::get<1>(slab.faces[f])],
+        index[std::get<2>(slab.faces[f])]
+      );
+    }
+
+    slab.clear();
+  });
+
+  mesh = assembler.take();
+}
+
+template void MarchingCubes::stitch_slabs(std::vector<Slab>&, ThreadPool&, BasicMesh<double,size_t>&);
+template void MarchingCubes::stitch_slabs(std::vector<Slab>&, ThreadPool&, BasicMesh<double,uint32_t>&);
+template void MarchingCubes::stitch_slabs(std::vector<Slab>&, ThreadPool&, BasicMesh<float,size_t>&);
+template void MarchingCubes::stitch_slabs(std::vector<Slab>&, ThreadPool&, BasicMesh<float,uint32_t>&);
+
+template void MarchingCubes::stitch_slabs(std::vector<Slab>&, ThreadPool&, MeshArrays<double,size_t>&);
+template void MarchingCubes::stitch_slabs(std::vector<Slab>&, ThreadPool&, MeshArrays<double,uint32_t>&);
+template void MarchingCubes::stitch_slabs(std::vector<Slab>&, ThreadPool&, MeshArrays<float,size_t>&);
+template void MarchingCubes::stitch_slabs(std::vector<Slab>&, ThreadPool&, MeshArrays<float,uint32_t>&);
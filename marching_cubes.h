@@ -25,12 +25,35 @@
 
 #include <vector>
 #include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
 #include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 
 #include "tensor.h"
+#include "sparse_volume.h"
+#include "mapped_tensor.h"
+#include "tensor_view.h"
+#include "layout_tensor.h"
 #include "mesh.h"
+#include "edge_cache.h"
+#include "inside_mask.h"
+#include "thread_pool.h"
+#include "row_classifier.h"
+#include "pipeline_stats.h"
+
+template <typename T> class StreamingMarchingCubes;
+template <typename T, typename MeshType> class MarchingCubesExtractor;
 
 class MarchingCubes {
+  template <typename T> friend class StreamingMarchingCubes;
+  template <typename T, typename MeshType> friend class MarchingCubesExtractor;
+
   public:
     using triangle_type = Mesh::triangle_type;
     using vertex_type   = Mesh::vertex_type;
@@ -78,6 +101,42 @@ class MarchingCubes {
       {3, 7}
     }};
 
+    // Same edges as EDGE_VERTEXES, but always running from the cube corner with the smaller
+    // coordinates to the larger one.  Interpolating every edge in the same direction means cubes
+    // sharing an edge compute bit-identical vertexes for it.
+    static constexpr std::array<std::pair<size_t,size_t>, 12> ORDERED_EDGE_VERTEXES = {{
+      {0, 1},
+      {1, 2},
+      {3, 2},
+      {0, 3},
+      {4, 5},
+      {5, 6},
+      {7, 6},
+      {4, 7},
+      {0, 4},
+      {1, 5},
+      {2, 6},
+      {3, 7}
+    }};
+
+    // Absolute index offsets of the corners of a cube from its lowest corner, in values with the
+    // given row and plane strides, and of the two ends of each edge (as in ORDERED_EDGE_VERTEXES).
+    // Lets the loops over cubes work on one linear offset per cube instead of grid points.
+    struct CubeOffsets {
+      std::array<ptrdiff_t,8> corners;
+      std::array<std::pair<ptrdiff_t,ptrdiff_t>,12> edges;
+
+      CubeOffsets(ptrdiff_t row_stride, ptrdiff_t plane_stride) {
+        for (size_t c = 0; c < corners.size(); ++c) {
+          const auto& shift = CUBE_INDEX_SHIFTS[c];
+          corners[c] = ptrdiff_t(shift(0)) + row_stride*ptrdiff_t(shift(1)) + plane_stride*ptrdiff_t(shift(2));
+        }
+        for (size_t e = 0; e < edges.size(); ++e) {
+          edges[e] = {corners[ORDERED_EDGE_VERTEXES[e].first], corners[ORDERED_EDGE_VERTEXES[e].second]};
+        }
+      }
+    };
+
     // Credit: http://paulbourke.net/geometry/polygonise/
     /*
        int edgeTable[256].  It corresponds to the 2^8 possible combinations of
@@ -429,92 +488,1652 @@ class MarchingCubes {
       {{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}}
     }};
 
-    // Could speed up by using absolute indexes instead of index_type objects everywhere.
+    // EDGE_TABLE and TRIANGLE_TABLE packed into one 32 byte entry per cube type (8KB in all),
+    // built at compile time in marching_cubes.cpp.  Cubes are emitted by exact counts, rather
+    // than by testing all 12 edge bits and scanning triangles up to a -1.
+    struct alignas(32) CubeCase {
+      uint8_t n_edges;
+      uint8_t n_triangles;
+      // Edges with a vertex, in ascending order
+      uint8_t edges[12];
+      // Three edges per triangle, as in TRIANGLE_TABLE
+      uint8_t triangles[15];
+    };
+
+    static const std::array<CubeCase,256> CUBE_CASES;
+
+    // Number of cube layers in each slab of the volume that is polygonized as one task.  It is
+    // fixed, rather than derived from the thread count, so the output is the same no matter how
+    // many threads run the slabs.
+    static constexpr size_t SLAB_DEPTH = 16;
+
+    enum class Normals {
+      none,
+      // Interpolated from central-difference gradients of the values, and pointing down them,
+      // to the same side as the faces' winding
+      gradient
+    };
+
+    // Reusable working memory for the polygonizers (defined below)
+    class Scratch;
+
+    // is_inside(value) is called once per grid point.  Any callable works (a std::function as
+    // well), but lambdas and function objects can be inlined into the loop that fills the mask.
+    template <typename T, typename Predicate>
+    static Mesh polygonize_tensor(const Tensor<T,3>& tensor, const Predicate& is_inside) {
+      ThreadPool serial(1);
+      return polygonize_tensor(tensor, is_inside, serial);
+    }
+
+    template <typename T, typename Predicate>
+    static Mesh polygonize_tensor(const Tensor<T,3>& tensor, const Predicate& is_inside, ThreadPool& pool) {
+      return polygonize_inside<Mesh>(tensor, is_inside, pool);
+    }
+
+    // The overloads taking a mesh argument build any BasicMesh or MeshArrays (see mesh.h), such as
+    // a CompactMesh, straight from the slabs rather than converting a Mesh afterwards
+    template <typename T, typename Predicate, typename MeshType>
+    static void polygonize_tensor(const Tensor<T,3>& tensor, const Predicate& is_inside, ThreadPool& pool, MeshType& mesh) {
+      mesh = polygonize_inside<MeshType>(tensor, is_inside, pool);
+    }
+
+    template <typename T, typename Predicate>
+    static Mesh polygonize_tensor(const MappedTensor<T,3>& tensor, const Predicate& is_inside, ThreadPool& pool) {
+      return polygonize_inside<Mesh>(tensor, is_inside, pool);
+    }
+
+    template <typename T, typename Predicate, typename MeshType>
+    static void polygonize_tensor(const MappedTensor<T,3>& tensor, const Predicate& is_inside, ThreadPool& pool, MeshType& mesh) {
+      mesh = polygonize_inside<MeshType>(tensor, is_inside, pool);
+    }
+
+    // Vertexes are placed in the coordinates of the volume the view was taken from
+    template <typename T, typename Predicate>
+    static Mesh polygonize_tensor(const TensorView<T,3>& view, const Predicate& is_inside) {
+      ThreadPool serial(1);
+      return polygonize_tensor(view, is_inside, serial);
+    }
+
+    template <typename T, typename Predicate>
+    static Mesh polygonize_tensor(const TensorView<T,3>& view, const Predicate& is_inside, ThreadPool& pool) {
+      Mesh mesh;
+      polygonize_tensor(view, is_inside, pool, mesh);
+      return mesh;
+    }
+
+    template <typename T, typename Predicate, typename MeshType>
+    static void polygonize_tensor(const TensorView<T,3>& view, const Predicate& is_inside, ThreadPool& pool, MeshType& mesh) {
+      const InsideMask mask(view.size(), [&](size_t i, size_t j, size_t k) -> bool { return is_inside(view(i, j, k)); }, pool);
+      mesh = polygonize_slabs<MeshType>(view.size(), [&](size_t k) { return InsideLayer(mask, k); }, pool, view.origin());
+    }
+
+    // Bricked and Z-ordered tensors are read point by point into the inside mask
+    template <typename T, typename Layout, typename Predicate>
+    static Mesh polygonize_tensor(const LayoutTensor<T,Layout>& tensor, const Predicate& is_inside) {
+      ThreadPool serial(1);
+      return polygonize_tensor(tensor, is_inside, serial);
+    }
+
+    template <typename T, typename Layout, typename Predicate>
+    static Mesh polygonize_tensor(const LayoutTensor<T,Layout>& tensor, const Predicate& is_inside, ThreadPool& pool) {
+      Mesh mesh;
+      polygonize_tensor(tensor, is_inside, pool, mesh);
+      return mesh;
+    }
+
+    template <typename T, typename Layout, typename Predicate, typename MeshType>
+    static void polygonize_tensor(const LayoutTensor<T,Layout>& tensor, const Predicate& is_inside, ThreadPool& pool, MeshType& mesh) {
+      const InsideMask mask(tensor.size(), [&](size_t i, size_t j, size_t k) -> bool { return is_inside(tensor(i, j, k)); }, pool);
+      mesh = polygonize_slabs<MeshType>(tensor.size(), [&](size_t k) { return InsideLayer(mask, k); }, pool);
+    }
+
+    // Each edge crossing is interpolated only once and given a vertex index, which neighbouring
+    // cubes pick up through a rolling cache of the edges of the current layer of cubes.  Faces are
+    // then written straight into the mesh as vertex indexes.  For a Tensor or MappedTensor,
+    // Normals::gradient also gives the mesh a unit normal per vertex (see NormalIsosurfaceLayer).
     template <typename T>
-    static Mesh polygonize_tensor(const Tensor<T,3>& tensor, const std::function<bool(T)> is_inside) {
-      std::vector<triangle_type> triangles;
+    static Mesh polygonize_isosurface(const Tensor<T,3>& tensor, const T iso_value) {
+      ThreadPool serial(1);
+      return polygonize_isosurface(tensor, iso_value, serial);
+    }
 
-      // Determine which vertexes are inside
-      const auto inside_tensor = tensor.transformed(is_inside);
+    template <typename T>
+    static Mesh polygonize_isosurface(const Tensor<T,3>& tensor, const T iso_value, ThreadPool& pool, Normals normals = Normals::none) {
+      return polygonize_contiguous<Mesh>(tensor, iso_value, pool, normals);
+    }
 
-      // Get size with one smaller in each dimension, to count cubes not vertexes (i.e. the vertex
-      // with the smallest x,y,z coordinates out of all possible 8 on the cube corners).
-      const auto cube_size = size_type(inside_tensor.size()) - size_type(1u, 1u, 1u);
+    // As for polygonize_tensor, the mesh argument may be any BasicMesh or MeshArrays
+    template <typename T, typename MeshType, typename = typename MeshType::vertex_index_type>
+    static void polygonize_isosurface(const Tensor<T,3>& tensor, const T iso_value, ThreadPool& pool, MeshType& mesh, Normals normals = Normals::none) {
+      mesh = polygonize_contiguous<MeshType>(tensor, iso_value, pool, normals);
+    }
+
+    template <typename T>
+    static Mesh polygonize_isosurface(const MappedTensor<T,3>& tensor, const T iso_value, ThreadPool& pool, Normals normals = Normals::none) {
+      return polygonize_contiguous<Mesh>(tensor, iso_value, pool, normals);
+    }
+
+    template <typename T, typename MeshType, typename = typename MeshType::vertex_index_type>
+    static void polygonize_isosurface(const MappedTensor<T,3>& tensor, const T iso_value, ThreadPool& pool, MeshType& mesh, Normals normals = Normals::none) {
+      mesh = polygonize_contiguous<MeshType>(tensor, iso_value, pool, normals);
+    }
+
+    // Also add phase timings and counters to stats (see pipeline_stats.h).  Timing every cube
+    // slows the polygonizer down somewhat; the overloads without stats record nothing.
+    template <typename T>
+    static Mesh polygonize_isosurface(const Tensor<T,3>& tensor, const T iso_value, ThreadPool& pool, PipelineStats& stats, Normals normals = Normals::none) {
+      Mesh mesh;
+      polygonize_isosurface(tensor, iso_value, pool, mesh, stats, normals);
+      return mesh;
+    }
+
+    template <typename T, typename MeshType, typename = typename MeshType::vertex_index_type>
+    static void polygonize_isosurface(const Tensor<T,3>& tensor, const T iso_value, ThreadPool& pool, MeshType& mesh, PipelineStats& stats, Normals normals = Normals::none) {
+      PipelineStats::Timer timer(stats, PipelineStats::Phase::total);
+      mesh = polygonize_contiguous<MeshType>(tensor, iso_value, pool, normals, stats);
+    }
+
+    template <typename T>
+    static Mesh polygonize_isosurface(const MappedTensor<T,3>& tensor, const T iso_value, ThreadPool& pool, PipelineStats& stats, Normals normals = Normals::none) {
+      Mesh mesh;
+      polygonize_isosurface(tensor, iso_value, pool, mesh, stats, normals);
+      return mesh;
+    }
+
+    template <typename T, typename MeshType, typename = typename MeshType::vertex_index_type>
+    static void polygonize_isosurface(const MappedTensor<T,3>& tensor, const T iso_value, ThreadPool& pool, MeshType& mesh, PipelineStats& stats, Normals normals = Normals::none) {
+      PipelineStats::Timer timer(stats, PipelineStats::Phase::total);
+      mesh = polygonize_contiguous<MeshType>(tensor, iso_value, pool, normals, stats);
+    }
+
+    // Work in the slab buffers and edge caches held by scratch, which keeps them for the next
+    // call instead of freeing them, and sizes them exactly if it was made with exact_sizes
+    template <typename T>
+    static Mesh polygonize_isosurface(const Tensor<T,3>& tensor, const T iso_value, ThreadPool& pool, Scratch& scratch, Normals normals = Normals::none) {
+      Mesh mesh;
+      polygonize_isosurface(tensor, iso_value, pool, mesh, scratch, normals);
+      return mesh;
+    }
+
+    template <typename T, typename MeshType, typename = typename MeshType::vertex_index_type>
+    static void polygonize_isosurface(const Tensor<T,3>& tensor, const T iso_value, ThreadPool& pool, MeshType& mesh, Scratch& scratch, Normals normals = Normals::none) {
+      NoStats stats;
+      mesh = polygonize_contiguous<MeshType>(tensor, iso_value, pool, normals, stats, scratch);
+    }
+
+    template <typename T>
+    static Mesh polygonize_isosurface(const MappedTensor<T,3>& tensor, const T iso_value, ThreadPool& pool, Scratch& scratch, Normals normals = Normals::none) {
+      Mesh mesh;
+      polygonize_isosurface(tensor, iso_value, pool, mesh, scratch, normals);
+      return mesh;
+    }
+
+    template <typename T, typename MeshType, typename = typename MeshType::vertex_index_type>
+    static void polygonize_isosurface(const MappedTensor<T,3>& tensor, const T iso_value, ThreadPool& pool, MeshType& mesh, Scratch& scratch, Normals normals = Normals::none) {
+      NoStats stats;
+      mesh = polygonize_contiguous<MeshType>(tensor, iso_value, pool, normals, stats, scratch);
+    }
+
+    // Hands the mesh to sink in batches as the slabs are polygonized, instead of building it, so
+    // only a couple of slabs per thread are held at once (see mesh_sink.h for file writers).  Any
+    // object with these members works as a sink:
+    //
+    //   void begin(bool normals);
+    //   void add_vertexes(const vertex_type* vertexes, const vertex_type* normals, size_t n);
+    //   void add_faces(const Mesh::face_type* faces, size_t n);
+    //   void end();
+    //
+    // begin and end are called once each, around the batches.  Vertex indexes run on from one
+    // batch to the next, and faces only use vertexes already added.  normals is null unless
+    // begin was told there are normals.  The mesh has the same vertexes and faces as the other
+    // overloads give, but its vertexes can be in a different order.
+    //
+    // Batches are added while the next slabs are polygonized, so they come one at a time and in
+    // order but possibly on one of the pool's threads, and the sink must not use the pool.
+    template <typename T, typename Sink>
+    static auto polygonize_isosurface(const Tensor<T,3>& tensor, const T iso_value, ThreadPool& pool, Sink& sink, Normals normals = Normals::none) -> decltype(void(&Sink::add_faces)) {
+      stream_contiguous(tensor, iso_value, pool, normals, sink);
+    }
+
+    template <typename T, typename Sink>
+    static auto polygonize_isosurface(const MappedTensor<T,3>& tensor, const T iso_value, ThreadPool& pool, Sink& sink, Normals normals = Normals::none) -> decltype(void(&Sink::add_faces)) {
+      stream_contiguous(tensor, iso_value, pool, normals, sink);
+    }
+
+    // Vertexes are placed in the coordinates of the volume the view was taken from.  Rows with
+    // contiguous x values are read in place; otherwise the two vertex planes of each cube layer
+    // are first gathered into scratch buffers.  Views have no min/max pyramid, so no bricks are
+    // skipped.
+    template <typename T>
+    static Mesh polygonize_isosurface(const TensorView<T,3>& view, const T iso_value) {
+      ThreadPool serial(1);
+      return polygonize_isosurface(view, iso_value, serial);
+    }
+
+    template <typename T>
+    static Mesh polygonize_isosurface(const TensorView<T,3>& view, const T iso_value, ThreadPool& pool) {
+      Mesh mesh;
+      polygonize_isosurface(view, iso_value, pool, mesh);
+      return mesh;
+    }
+
+    template <typename T, typename MeshType>
+    static void polygonize_isosurface(const TensorView<T,3>& view, const T iso_value, ThreadPool& pool, MeshType& mesh) {
+      const size_t nx = view.size()(0);
+      const auto& strides = view.strides();
+
+      if (strides[0] == 1) {
+        mesh = polygonize_slabs<MeshType>(view.size(), [&](size_t k) {
+          return IsosurfaceLayer<T>(view.data() + strides[2]*ptrdiff_t(k), view.data() + strides[2]*ptrdiff_t(k+1), nx, strides[1], iso_value, k);
+        }, pool, view.origin());
+        return;
+      }
+
+      mesh = polygonize_slabs<MeshType>(view.size(), [&](size_t k) { return GatheredIsosurfaceLayer<T>(view, iso_value, k); }, pool, view.origin());
+    }
+
+    // Cubes are read in place through the tensor's rows, skipping the bricks of its cached
+    // min/max pyramid that the surface cannot pass through
+    template <typename T, typename Layout>
+    static Mesh polygonize_isosurface(const LayoutTensor<T,Layout>& tensor, const T iso_value) {
+      ThreadPool serial(1);
+      return polygonize_isosurface(tensor, iso_value, serial);
+    }
+
+    template <typename T, typename Layout>
+    static Mesh polygonize_isosurface(const LayoutTensor<T,Layout>& tensor, const T iso_value, ThreadPool& pool) {
+      Mesh mesh;
+      polygonize_isosurface(tensor, iso_value, pool, mesh);
+      return mesh;
+    }
+
+    template <typename T, typename Layout, typename MeshType>
+    static void polygonize_isosurface(const LayoutTensor<T,Layout>& tensor, const T iso_value, ThreadPool& pool, MeshType& mesh) {
+      const MinMaxPyramid<T>& pyramid = tensor.min_max_pyramid(&pool);
+      mesh = polygonize_slabs<MeshType>(tensor.size(), [&](size_t k) { return LayoutIsosurfaceLayer<T,Layout>(tensor, iso_value, k, pyramid); }, pool);
+    }
+
+    // Coarse preview from a level of the tensor's cached resolution pyramid (see
+    // resolution_pyramid.h): 1, 2 or 3 for 2x, 4x or 8x fewer points along each axis, or 0 for
+    // the full tensor.  Vertexes are in the tensor's own coordinates.  Only the first call for a
+    // kind of downsampling builds the pyramid; later calls at any level or iso value just march
+    // the coarse grid.
+    template <typename T>
+    static Mesh polygonize_isosurface(const Tensor<T,3>& tensor, const T iso_value, ThreadPool& pool, size_t level, Downsampling downsampling = Downsampling::average) {
+      Mesh mesh;
+      polygonize_isosurface(tensor, iso_value, pool, mesh, level, downsampling);
+      return mesh;
+    }
+
+    template <typename T, typename MeshType, typename = typename MeshType::vertex_index_type>
+    static void polygonize_isosurface(const Tensor<T,3>& tensor, const T iso_value, ThreadPool& pool, MeshType& mesh, size_t level, Downsampling downsampling = Downsampling::average) {
+      if (level == 0) {
+        polygonize_isosurface(tensor, iso_value, pool, mesh);
+        return;
+      }
+
+      const auto& levels = tensor.resolution_pyramid(downsampling, &pool);
+      const size_type& size = levels.size(level);
+      const T* data = levels.data(level);
+      const auto& pyramid = levels.min_max_pyramid(level);
+      const size_t plane_size = size(0) * size(1);
+      const double scale = double(size_t(1) << level);
+
+      mesh = polygonize_slabs<MeshType>(size, [&](size_t k) {
+        return ScaledLayer<IsosurfaceLayer<T>>(IsosurfaceLayer<T>(data + plane_size*k, data + plane_size*(k+1), size(0), size(0), iso_value, k, &pyramid), scale);
+      }, pool);
+    }
 
-      size_t cube_type;
+    // Same mesh as polygonize_isosurface or polygonize_tensor give for the dense tensor the
+    // volume stands for (see SparseVolume::to_tensor), vertex for vertex.  A cube with every
+    // corner in missing bricks is all background and has no triangles, so only the runs of cubes
+    // next to allocated bricks are classified, and rows of bricks with none are passed over.
+    template <typename T>
+    static Mesh polygonize_isosurface(const SparseVolume<T>& volume, const T iso_value, ThreadPool& pool) {
+      Mesh mesh;
+      polygonize_isosurface(volume, iso_value, pool, mesh);
+      return mesh;
+    }
+
+    template <typename T, typename MeshType, typename = typename MeshType::vertex_index_type>
+    static void polygonize_isosurface(const SparseVolume<T>& volume, const T iso_value, ThreadPool& pool, MeshType& mesh) {
+      mesh = polygonize_slabs<MeshType>(volume.size(), [&](size_t k) { return SparseIsosurfaceLayer<T>(volume, iso_value, k); }, pool);
+    }
+
+    template <typename T, typename Predicate>
+    static Mesh polygonize_tensor(const SparseVolume<T>& volume, const Predicate& is_inside, ThreadPool& pool) {
+      Mesh mesh;
+      polygonize_tensor(volume, is_inside, pool, mesh);
+      return mesh;
+    }
+
+    template <typename T, typename Predicate, typename MeshType>
+    static void polygonize_tensor(const SparseVolume<T>& volume, const Predicate& is_inside, ThreadPool& pool, MeshType& mesh) {
+      mesh = polygonize_slabs<MeshType>(volume.size(), [&](size_t k) { return SparseInsideLayer<T,Predicate>(volume, is_inside, k); }, pool);
+    }
+
+    // One mesh per iso value, from a single pass over the volume.  Each grid point is ranked by
+    // how many iso values it is at or above, each cube is classified against all levels at once
+    // from its corner ranks, and the vertexes of every level crossing an edge are interpolated
+    // together.  The meshes are the same as separate polygonize_isosurface calls would give.
+    // iso_values must be sorted ascending, with at most 255 of them.
+    template <typename T>
+    static std::vector<Mesh> polygonize_isosurfaces(const Tensor<T,3>& tensor, const std::vector<T>& iso_values) {
+      ThreadPool serial(1);
+      return polygonize_isosurfaces(tensor, iso_values, serial);
+    }
+
+    template <typename T>
+    static std::vector<Mesh> polygonize_isosurfaces(const Tensor<T,3>& tensor, const std::vector<T>& iso_values, ThreadPool& pool) {
+      return polygonize_levels(tensor.data(), tensor.size(), iso_values, pool);
+    }
+
+    template <typename T>
+    static std::vector<Mesh> polygonize_isosurfaces(const MappedTensor<T,3>& tensor, const std::vector<T>& iso_values, ThreadPool& pool) {
+      return polygonize_levels(tensor.data(), tensor.size(), iso_values, pool);
+    }
+
+  private:
+    // Shared by Tensor and MappedTensor, which both hold their values contiguously in x-fastest
+    // order and cache a min/max pyramid
+    template <typename MeshType, typename Volume, typename Predicate>
+    static MeshType polygonize_inside(const Volume& volume, const Predicate& is_inside, ThreadPool& pool) {
+      const size_t nx = volume.size()(0);
+      const size_t ny = volume.size()(1);
+
+      const InsideMask mask(volume.size(), [&](size_t i, size_t j, size_t k) -> bool { return is_inside(volume(i + nx*(j + ny*k))); }, pool);
+      return polygonize_slabs<MeshType>(volume.size(), [&](size_t k) { return InsideLayer(mask, k); }, pool);
+    }
+
+    template <typename MeshType, typename Volume, typename T>
+    static MeshType polygonize_contiguous(const Volume& volume, const T iso_value, ThreadPool& pool, Normals normals) {
+      NoStats stats;
+      return polygonize_contiguous<MeshType>(volume, iso_value, pool, normals, stats);
+    }
+
+    template <typename MeshType, typename Volume, typename T, typename Stats>
+    static MeshType polygonize_contiguous(const Volume& volume, const T iso_value, ThreadPool& pool, Normals normals, Stats& stats) {
+      Scratch scratch(false);
+      return polygonize_contiguous<MeshType>(volume, iso_value, pool, normals, stats, scratch);
+    }
+
+    template <typename MeshType, typename Volume, typename T, typename Stats>
+    static MeshType polygonize_contiguous(const Volume& volume, const T iso_value, ThreadPool& pool, Normals normals, Stats& stats, Scratch& scratch) {
+      // Bricks of cubes the iso value cannot cross are skipped without being classified
+      const MinMaxPyramid<T>* pyramid;
+      {
+        typename Stats::Timer timer(stats, PipelineStats::Phase::pyramid);
+        pyramid = &volume.min_max_pyramid(&pool);
+      }
+
+      return with_contiguous_layers(volume, iso_value, *pyramid, normals, [&](const auto& layer_at) {
+        return polygonize_slabs<MeshType>(volume.size(), layer_at, pool, index_type(), stats, scratch);
+      });
+    }
+
+    template <typename Volume, typename T, typename Sink>
+    static void stream_contiguous(const Volume& volume, const T iso_value, ThreadPool& pool, Normals normals, Sink& sink) {
+      const MinMaxPyramid<T>& pyramid = volume.min_max_pyramid(&pool);
+      with_contiguous_layers(volume, iso_value, pyramid, normals, [&](const auto& layer_at) {
+        stream_slabs(volume.size(), layer_at, pool, sink);
+      });
+    }
+
+    // Returns polygonize(layer_at), with layer_at(k) giving the layer of cubes k of contiguous
+    // x-fastest values
+    template <typename Volume, typename T, typename Polygonize>
+    static auto with_contiguous_layers(const Volume& volume, const T iso_value, const MinMaxPyramid<T>& pyramid, Normals normals, const Polygonize& polygonize) {
+      const size_t nx = volume.size()(0);
+      const size_t plane_size = nx * volume.size()(1);
+
+      if (normals == Normals::gradient) {
+        const size_t nz = volume.size()(2);
+        return polygonize([&](size_t k) {
+          return NormalIsosurfaceLayer<T>(
+            k > 0 ? volume.data() + plane_size*(k-1) : nullptr,
+            volume.data() + plane_size*k,
+            volume.data() + plane_size*(k+1),
+            k + 2 < nz ? volume.data() + plane_size*(k+2) : nullptr,
+            nx, volume.size()(1), nx, iso_value, k, &pyramid
+          );
+        });
+      }
+
+      return polygonize([&](size_t k) {
+        return IsosurfaceLayer<T>(volume.data() + plane_size*k, volume.data() + plane_size*(k+1), nx, nx, iso_value, k, &pyramid);
+      });
+    }
+
+  private:
+    // Cube types and edge vertexes for one layer of cubes, from a bit-packed inside mask
+    class InsideLayer {
+      private:
+        const InsideMask& mask_;
+        const size_t k_;
+
+      public:
+        InsideLayer(const InsideMask& mask, size_t k) : mask_(mask), k_(k) {}
+
+        // Returns false if no cube in the row can have triangles
+        bool classify_row(size_t j, uint8_t* cube_types) const {
+          return mask_.classify_row(j, k_, cube_types);
+        }
+
+        vertex_type edge_vertex(size_t i, size_t j, size_t edge) const {
+          return index_type(i, j, k_) + CUBE_EDGE_SHIFTS[edge];
+        }
+    };
+
+    // Classifies the runs of cubes of row (j, k) that lie in bricks the iso value may cross, with
+    // classify_cubes(begin, end), and gives the rest the type of a cube all inside (0) or all
+    // outside (0xff), as their brick is.  Returns false if there were no crossing bricks.
+    template <typename T, typename ClassifyCubes>
+    static bool classify_crossing_runs(const MinMaxPyramid<T>& pyramid, size_t j, size_t k, size_t nx, const T iso_value, uint8_t* cube_types, const ClassifyCubes& classify_cubes) {
+      constexpr size_t B = MinMaxPyramid<T>::BRICK_SIZE;
+      constexpr int CROSSES = -1;
+
+      const size_t n_bricks = pyramid.bricks()(0);
+      const size_t by = j / B;
+      const size_t bz = k / B;
+
+      // A brick the surface cannot cross is all below the iso value or all not below it
+      const auto brick_type = [&](size_t bx) {
+        if (pyramid.brick_crosses(bx, by, bz, iso_value)) return CROSSES;
+        return pyramid.max(bx, by, bz) < iso_value ? 0xff : 0;
+      };
+
+      bool any = false;
+      size_t bx = 0;
+      while (bx < n_bricks) {
+        const int type = brick_type(bx);
+        size_t bx_end = bx + 1;
+        while (bx_end < n_bricks && brick_type(bx_end) == type) ++bx_end;
+
+        const size_t begin = B*bx;
+        const size_t end = std::min(B*bx_end, nx - 1);
+        if (type == CROSSES) {
+          classify_cubes(begin, end);
+          any = true;
+        }
+        else {
+          std::fill(cube_types + begin, cube_types + end, uint8_t(type));
+        }
+
+        bx = bx_end;
+      }
+
+      return any;
+    }
 
-      for (const auto& cube_index : cube_size) {
-        cube_type = 0;
+    // Cube types and interpolated edge vertexes for one layer of cubes, against an iso value.
+    // Reads the two vertex planes of the layer (nx contiguous values per row, rows row_stride
+    // values apart) through raw pointers, so they can come from a tensor, a view or from slices
+    // streamed in one at a time.
+    template <typename T>
+    class IsosurfaceLayer {
+      private:
+        // Cubes classified at a time, so that their flags fit on the stack
+        static constexpr size_t RUN_LENGTH = 256;
+
+        const std::array<const T*,2> planes_;
+        const size_t nx_;
+        const ptrdiff_t row_stride_;
+        const T iso_value_;
+        const size_t k_;
+        const MinMaxPyramid<T>* pyramid_;
+        // Offsets within a plane; the two planes need not be in one allocation
+        const CubeOffsets offsets_;
 
-        for (size_t i = 0; i < CUBE_INDEX_SHIFTS.size(); ++i) {
-          if (!inside_tensor(cube_index + CUBE_INDEX_SHIFTS[i])) {
-            cube_type |= (1 << i);
+      public:
+        // Without a pyramid every row is classified in full.  Allocates nothing, since a layer is
+        // made for every layer of cubes.
+        IsosurfaceLayer(const T* lower_plane, const T* upper_plane, size_t nx, ptrdiff_t row_stride, const T iso_value, size_t k, const MinMaxPyramid<T>* pyramid = nullptr)
+          : planes_{{lower_plane, upper_plane}}, nx_(nx), row_stride_(row_stride), iso_value_(iso_value), k_(k), pyramid_(pyramid), offsets_(row_stride, 0)
+        {}
+
+        // Returns false if no cube in the row can have triangles.  With a pyramid, only runs of
+        // bricks the iso value may cross are classified, and the rest are marked empty.
+        bool classify_row(size_t j, uint8_t* cube_types) const {
+          if (!pyramid_) {
+            classify_cubes(j, 0, nx_ - 1, cube_types);
+            return true;
           }
+
+          return classify_crossing_runs(*pyramid_, j, k_, nx_, iso_value_, cube_types, [&](size_t begin, size_t end) {
+            classify_cubes(j, begin, end, cube_types);
+          });
         }
 
-        for (size_t i = 0; MarchingCubes::TRIANGLE_TABLE[cube_type][i] != -1; i += 3) {
-          triangles.emplace_back(
-            cube_index + CUBE_EDGE_SHIFTS[MarchingCubes::TRIANGLE_TABLE[cube_type][i + 0]],
-            cube_index + CUBE_EDGE_SHIFTS[MarchingCubes::TRIANGLE_TABLE[cube_type][i + 1]],
-            cube_index + CUBE_EDGE_SHIFTS[MarchingCubes::TRIANGLE_TABLE[cube_type][i + 2]]
-          );
+        vertex_type edge_vertex(size_t i, size_t j, size_t edge) const {
+          const auto& delta0 = CUBE_INDEX_SHIFTS[ORDERED_EDGE_VERTEXES[edge].first];
+          const auto& delta1 = CUBE_INDEX_SHIFTS[ORDERED_EDGE_VERTEXES[edge].second];
+
+          // Get interpolated vertex position (x0 = 0, x1 = 1)
+          /* offset = (iso_value - v0) * (x1 - x0) / (v1 - v0) + x0; */
+          const ptrdiff_t base = ptrdiff_t(i) + row_stride_*ptrdiff_t(j);
+          const double v0 = planes_[delta0(2)][base + offsets_.edges[edge].first];
+          const double v1 = planes_[delta1(2)][base + offsets_.edges[edge].second];
+          const double offset = (iso_value_ - v0) / (v1 - v0);
+
+          return (index_type(i, j, k_) + delta0) + offset*(delta1 - delta0);
+        }
+
+      private:
+        // Cube types of cubes [begin, end) of row j
+        void classify_cubes(size_t j, size_t begin, size_t end, uint8_t* cube_types) const {
+          const T* row00 = planes_[0] + row_stride_*ptrdiff_t(j);
+          const T* row01 = planes_[1] + row_stride_*ptrdiff_t(j);
+
+          std::array<uint8_t, 4*(RUN_LENGTH + 1)> flags;
+          for (size_t i = begin; i < end; i += RUN_LENGTH) {
+            const size_t n = std::min(RUN_LENGTH, end - i);
+            RowClassifier::classify(row00 + i, row00 + row_stride_ + i, row01 + i, row01 + row_stride_ + i, n + 1, iso_value_, cube_types + i, flags.data());
+          }
+        }
+    };
+
+    // Rows of cubes of one layer of a SparseVolume.  Only the runs of cubes with a corner in an
+    // allocated brick are classified, and the rest are marked empty.  flag(values, n, flags) sets
+    // flags[i] to 0xff for the values that count as outside (as RowClassifier::below does).  The
+    // four vertex rows of the last row classified are kept for placing its vertexes.
+    template <typename T, typename Flag>
+    class SparseRows {
+      private:
+        static constexpr size_t B = SparseVolume<T>::BRICK_SIZE;
+
+        const SparseVolume<T>& volume_;
+        const Flag flag_;
+        const size_t k_;
+        const size_t nx_;
+
+        // Values and flags of the vertex rows (dy,dz) = (0,0), (1,0), (0,1) and (1,1) from the
+        // cube row, nx each
+        mutable std::vector<T> values_;
+        mutable std::vector<uint8_t> flags_;
+        mutable size_t row_;
+
+        // Brick of each x for the row of bricks of each vertex row, and which rows those are
+        mutable std::array<std::vector<const T*>,4> bricks_;
+        mutable std::array<size_t,4> bricks_y_;
+
+      public:
+        SparseRows(const SparseVolume<T>& volume, const Flag& flag, size_t k)
+          : volume_(volume), flag_(flag), k_(k), nx_(volume.size()(0)),
+            values_(4 * nx_), flags_(4 * nx_), row_(std::numeric_limits<size_t>::max())
+        {
+          bricks_y_.fill(std::numeric_limits<size_t>::max());
+        }
+
+        bool classify_row(size_t j, uint8_t* cube_types) const {
+          const size_t n_cubes = nx_ - 1;
+          row_ = std::numeric_limits<size_t>::max();
+
+          bool allocated = false;
+          for (size_t r = 0; r < 4; ++r) {
+            if (volume_.row_allocated((j + r % 2) / B, (k_ + r / 2) / B)) allocated = true;
+          }
+          if (!allocated) return false;
+
+          for (size_t r = 0; r < 4; ++r) update_bricks(r, (j + r % 2) / B);
+          const auto active = [this](size_t bx) {
+            return bricks_[0][bx] || bricks_[1][bx] || bricks_[2][bx] || bricks_[3][bx];
+          };
+
+          // A cube is classified if a brick holding one of its corners is allocated, so runs of
+          // active bricks reach back one cube into the brick before
+          bool any = false;
+          size_t done = 0;
+          size_t bx = 0;
+          const size_t n_bricks = bricks_[0].size();
+          while (bx < n_bricks) {
+            if (!active(bx)) {
+              ++bx;
+              continue;
+            }
+            size_t bx_end = bx + 1;
+            while (bx_end < n_bricks && active(bx_end)) ++bx_end;
+
+            const size_t begin = bx > 0 ? B*bx - 1 : 0;
+            const size_t end = std::min(B*bx_end, n_cubes);
+            if (begin < end) {
+              std::fill(cube_types + done, cube_types + begin, 0);
+              for (size_t r = 0; r < 4; ++r) {
+                gather(r, j + r % 2, k_ + r / 2, begin, end + 1);
+                flag_(values_.data() + r*nx_ + begin, end + 1 - begin, flags_.data() + r*nx_ + begin);
+              }
+              RowClassifier::combine(
+                flags_.data() + begin, flags_.data() + nx_ + begin, flags_.data() + 2*nx_ + begin, flags_.data() + 3*nx_ + begin,
+                end + 1 - begin, cube_types + begin
+              );
+              done = end;
+              any = true;
+            }
+            bx = bx_end;
+          }
+          std::fill(cube_types + done, cube_types + n_cubes, 0);
+
+          row_ = j;
+          return any;
+        }
+
+        // Value at corner delta of cube (i,j)
+        double value(size_t i, size_t j, const index_type& delta) const {
+          if (j == row_) return values_[(delta(1) + 2*delta(2))*nx_ + i + delta(0)];
+          return volume_(i + delta(0), j + delta(1), k_ + delta(2));
+        }
+
+      private:
+        void update_bricks(size_t r, size_t by) const {
+          if (bricks_y_[r] == by) return;
+          bricks_y_[r] = by;
+
+          const size_t bz = (k_ + r / 2) / B;
+          auto& bricks = bricks_[r];
+          bricks.assign(volume_.bricks()(0), nullptr);
+          if (!volume_.row_allocated(by, bz)) return;
+          for (size_t bx = 0; bx < bricks.size(); ++bx) bricks[bx] = volume_.brick(bx, by, bz);
+        }
+
+        // Copies values x in [begin, end) of vertex row (y,z) into row r
+        void gather(size_t r, size_t y, size_t z, size_t begin, size_t end) const {
+          T* row = values_.data() + r*nx_;
+          const size_t offset = B*(y % B + B*(z % B));
+          for (size_t x = begin; x < end; ) {
+            const size_t bx = x / B;
+            const size_t x_end = std::min(B*(bx + 1), end);
+            const T* brick = bricks_[r][bx];
+            if (brick) std::copy(brick + offset + x % B, brick + offset + x % B + (x_end - x), row + x);
+            else std::fill(row + x, row + x_end, volume_.background());
+            x = x_end;
+          }
+        }
+    };
+
+    template <typename T>
+    struct BelowIsoValue {
+      T iso_value;
+      void operator()(const T* values, size_t n, uint8_t* flags) const { RowClassifier::below(values, n, iso_value, flags); }
+    };
+
+    template <typename Predicate>
+    struct NotInside {
+      const Predicate& is_inside;
+      template <typename T>
+      void operator()(const T* values, size_t n, uint8_t* flags) const {
+        for (size_t i = 0; i < n; ++i) flags[i] = is_inside(values[i]) ? 0 : 0xff;
+      }
+    };
+
+    // Cube types and interpolated edge vertexes of a SparseVolume, as IsosurfaceLayer gives for
+    // the dense values
+    template <typename T>
+    class SparseIsosurfaceLayer {
+      private:
+        SparseRows<T,BelowIsoValue<T>> rows_;
+        const T iso_value_;
+        const size_t k_;
+
+      public:
+        SparseIsosurfaceLayer(const SparseVolume<T>& volume, const T iso_value, size_t k)
+          : rows_(volume, BelowIsoValue<T>{iso_value}, k), iso_value_(iso_value), k_(k)
+        {}
+
+        bool classify_row(size_t j, uint8_t* cube_types) const { return rows_.classify_row(j, cube_types); }
+
+        vertex_type edge_vertex(size_t i, size_t j, size_t edge) const {
+          const auto& delta0 = CUBE_INDEX_SHIFTS[ORDERED_EDGE_VERTEXES[edge].first];
+          const auto& delta1 = CUBE_INDEX_SHIFTS[ORDERED_EDGE_VERTEXES[edge].second];
+
+          const double v0 = rows_.value(i, j, delta0);
+          const double v1 = rows_.value(i, j, delta1);
+          const double offset = (iso_value_ - v0) / (v1 - v0);
+
+          return (index_type(i, j, k_) + delta0) + offset*(delta1 - delta0);
+        }
+    };
+
+    // Cube types of a SparseVolume against a predicate, with vertexes at edge midpoints as
+    // InsideLayer gives for the dense values
+    template <typename T, typename Predicate>
+    class SparseInsideLayer {
+      private:
+        SparseRows<T,NotInside<Predicate>> rows_;
+        const size_t k_;
+
+      public:
+        SparseInsideLayer(const SparseVolume<T>& volume, const Predicate& is_inside, size_t k)
+          : rows_(volume, NotInside<Predicate>{is_inside}, k), k_(k)
+        {}
+
+        bool classify_row(size_t j, uint8_t* cube_types) const { return rows_.classify_row(j, cube_types); }
+
+        vertex_type edge_vertex(size_t i, size_t j, size_t edge) const {
+          return index_type(i, j, k_) + CUBE_EDGE_SHIFTS[edge];
+        }
+    };
+
+    // Another layer with its vertexes scaled, for grids coarser than the coordinates wanted
+    template <typename Layer>
+    class ScaledLayer {
+      private:
+        Layer layer_;
+        double scale_;
+
+      public:
+        ScaledLayer(Layer&& layer, double scale) : layer_(std::move(layer)), scale_(scale) {}
+
+        const Layer& layer() const { return layer_; }
+        double scale() const { return scale_; }
+
+        bool classify_row(size_t j, uint8_t* cube_types) const { return layer_.classify_row(j, cube_types); }
+        vertex_type edge_vertex(size_t i, size_t j, size_t edge) const { return layer_.edge_vertex(i, j, edge) * scale_; }
+    };
+
+    // IsosurfaceLayer over x-fastest copies of the two vertex planes of a view with strided x
+    // values
+    template <typename T>
+    class GatheredIsosurfaceLayer {
+      private:
+        std::vector<T> lower_plane_;
+        std::vector<T> upper_plane_;
+        IsosurfaceLayer<T> layer_;
+
+      public:
+        template <typename Volume>
+        GatheredIsosurfaceLayer(const Volume& volume, const T iso_value, size_t k)
+          : lower_plane_(gather_plane(volume, k)), upper_plane_(gather_plane(volume, k+1)),
+            layer_(lower_plane_.data(), upper_plane_.data(), volume.size()(0), volume.size()(0), iso_value, k)
+        {}
+
+        // Moving the planes keeps their buffers, so the layer's pointers stay valid
+        GatheredIsosurfaceLayer(GatheredIsosurfaceLayer&&) = default;
+        GatheredIsosurfaceLayer(const GatheredIsosurfaceLayer&) = delete;
+
+        bool classify_row(size_t j, uint8_t* cube_types) const { return layer_.classify_row(j, cube_types); }
+        vertex_type edge_vertex(size_t i, size_t j, size_t edge) const { return layer_.edge_vertex(i, j, edge); }
+
+      private:
+        static std::vector<T> gather_plane(const TensorView<T,3>& view, size_t k) {
+          const size_t nx = view.size()(0);
+          const auto& strides = view.strides();
+
+          std::vector<T> plane(nx * view.size()(1));
+          for (size_t j = 0; j < view.size()(1); ++j) {
+            const T* row = view.data() + ptrdiff_t(j)*strides[1] + ptrdiff_t(k)*strides[2];
+            for (size_t i = 0; i < nx; ++i) {
+              plane[i + nx*j] = row[ptrdiff_t(i)*strides[0]];
+            }
+          }
+          return plane;
+        }
+    };
+
+    // Cube types and edge vertexes for one layer of cubes of a tensor with a non-linear layout,
+    // read in place through the tensor's rows.  Only runs of bricks the iso value may cross are
+    // classified.  Each vertex row is flagged once for the layer: the upper rows of one row of
+    // cubes are kept as the lower rows of the next one in the same row of bricks.
+    template <typename T, typename Layout>
+    class LayoutIsosurfaceLayer {
+      private:
+        const LayoutTensor<T,Layout>& tensor_;
+        const T iso_value_;
+        const size_t k_;
+        const size_t nx_;
+        const MinMaxPyramid<T>& pyramid_;
+
+        // Flags of vertex row (y, z) at nx*(y % 2 + 2*(z - k)), and the last row of cubes
+        // classified
+        mutable std::vector<uint8_t> flags_;
+        mutable size_t row_;
+
+      public:
+        LayoutIsosurfaceLayer(const LayoutTensor<T,Layout>& tensor, const T iso_value, size_t k, const MinMaxPyramid<T>& pyramid)
+          : tensor_(tensor), iso_value_(iso_value), k_(k), nx_(tensor.size()(0)), pyramid_(pyramid),
+            flags_(4 * nx_), row_(std::numeric_limits<size_t>::max())
+        {}
+
+        bool classify_row(size_t j, uint8_t* cube_types) const {
+          // The runs of cubes are the same throughout a row of bricks
+          const bool lower_flagged = row_ + 1 == j && j % MinMaxPyramid<T>::BRICK_SIZE != 0;
+          row_ = j;
+
+          return classify_crossing_runs(pyramid_, j, k_, nx_, iso_value_, cube_types, [&](size_t begin, size_t end) {
+            for (size_t dz = 0; dz < 2; ++dz) {
+              if (!lower_flagged) flag(j, k_ + dz, begin, end + 1);
+              flag(j + 1, k_ + dz, begin, end + 1);
+            }
+            RowClassifier::combine(
+              row_flags(j, k_) + begin, row_flags(j + 1, k_) + begin, row_flags(j, k_ + 1) + begin, row_flags(j + 1, k_ + 1) + begin,
+              end + 1 - begin, cube_types + begin
+            );
+          });
+        }
+
+        vertex_type edge_vertex(size_t i, size_t j, size_t edge) const {
+          const auto& delta0 = CUBE_INDEX_SHIFTS[ORDERED_EDGE_VERTEXES[edge].first];
+          const auto& delta1 = CUBE_INDEX_SHIFTS[ORDERED_EDGE_VERTEXES[edge].second];
+
+          const double v0 = tensor_(i + delta0(0), j + delta0(1), k_ + delta0(2));
+          const double v1 = tensor_(i + delta1(0), j + delta1(1), k_ + delta1(2));
+          const double offset = (iso_value_ - v0) / (v1 - v0);
+
+          return (index_type(i, j, k_) + delta0) + offset*(delta1 - delta0);
+        }
+
+      private:
+        uint8_t* row_flags(size_t y, size_t z) const {
+          return flags_.data() + nx_*(y % 2 + 2*(z - k_));
+        }
+
+        // Flags points [begin, end) of vertex row (y, z) below the iso value
+        void flag(size_t y, size_t z, size_t begin, size_t end) const {
+          const auto values = tensor_.row(y, z).begin();
+          uint8_t* flags = row_flags(y, z);
+          for (size_t x = begin; x < end; ++x) flags[x] = values[x] < iso_value_ ? 0xff : 0;
+        }
+    };
+
+    // IsosurfaceLayer that also gives a unit normal at each vertex: the central-difference
+    // gradients at the two ends of the edge, interpolated with the vertex's own offset.  The
+    // gradients of a whole row of vertexes are taken at once, in loops the compiler vectorizes,
+    // the first time a vertex needs that row, and kept for the next row of cubes.  below_plane
+    // and above_plane are the vertex planes under and over the layer, or nullptr at the faces of
+    // the volume, where one-sided differences are used instead.
+    template <typename T>
+    class NormalIsosurfaceLayer {
+      private:
+        static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+        const IsosurfaceLayer<T> layer_;
+        // Vertex planes k-1 to k+2, with a missing outer plane replaced by its neighbour
+        const std::array<const T*,4> planes_;
+        const size_t nx_;
+        const size_t ny_;
+        const ptrdiff_t row_stride_;
+        const T iso_value_;
+        // Scale of the z difference for planes k and k+1
+        const std::array<float,2> z_scales_;
+        // Gradient x, y and z components of the last two rows used in each plane, by row parity
+        mutable std::array<std::array<std::array<std::vector<float>,3>,2>,2> gradients_;
+        mutable std::array<std::array<size_t,2>,2> gradient_rows_;
+
+      public:
+        NormalIsosurfaceLayer(
+          const T* below_plane, const T* lower_plane, const T* upper_plane, const T* above_plane,
+          size_t nx, size_t ny, ptrdiff_t row_stride, const T iso_value, size_t k, const MinMaxPyramid<T>* pyramid = nullptr
+        )
+          : layer_(lower_plane, upper_plane, nx, row_stride, iso_value, k, pyramid),
+            planes_{{below_plane ? below_plane : lower_plane, lower_plane, upper_plane, above_plane ? above_plane : upper_plane}},
+            nx_(nx), ny_(ny), row_stride_(row_stride), iso_value_(iso_value),
+            z_scales_{{below_plane ? 0.5f : 1.0f, above_plane ? 0.5f : 1.0f}},
+            gradient_rows_{{{{npos, npos}}, {{npos, npos}}}}
+        {}
+
+        bool classify_row(size_t j, uint8_t* cube_types) const { return layer_.classify_row(j, cube_types); }
+        vertex_type edge_vertex(size_t i, size_t j, size_t edge) const { return layer_.edge_vertex(i, j, edge); }
+
+        vertex_type edge_normal(size_t i, size_t j, size_t edge) const {
+          const auto& delta0 = CUBE_INDEX_SHIFTS[ORDERED_EDGE_VERTEXES[edge].first];
+          const auto& delta1 = CUBE_INDEX_SHIFTS[ORDERED_EDGE_VERTEXES[edge].second];
+
+          // Same offset as IsosurfaceLayer::edge_vertex
+          const double v0 = planes_[1 + delta0(2)][ptrdiff_t(i + delta0(0)) + row_stride_*ptrdiff_t(j + delta0(1))];
+          const double v1 = planes_[1 + delta1(2)][ptrdiff_t(i + delta1(0)) + row_stride_*ptrdiff_t(j + delta1(1))];
+          const double offset = (iso_value_ - v0) / (v1 - v0);
+
+          const auto& gradient0 = gradient_row(delta0(2), j + delta0(1));
+          const auto& gradient1 = gradient_row(delta1(2), j + delta1(1));
+
+          vertex_type normal;
+          for (size_t axis = 0; axis < 3; ++axis) {
+            const double g0 = gradient0[axis][i + delta0(0)];
+            const double g1 = gradient1[axis][i + delta1(0)];
+            normal(axis) = g0 + offset*(g1 - g0);
+          }
+
+          // Minus the gradient, to match the faces' winding
+          const double length = std::sqrt(normal.x()*normal.x() + normal.y()*normal.y() + normal.z()*normal.z());
+          if (length > 0) normal /= -length;
+          return normal;
+        }
+
+      private:
+        // Gradients of row j of vertex plane k + plane
+        const std::array<std::vector<float>,3>& gradient_row(size_t plane, size_t j) const {
+          auto& gradient = gradients_[plane][j % 2];
+          if (gradient_rows_[plane][j % 2] == j) return gradient;
+          gradient_rows_[plane][j % 2] = j;
+
+          for (auto& component : gradient) component.resize(nx_);
+          float* gx = gradient[0].data();
+          float* gy = gradient[1].data();
+          float* gz = gradient[2].data();
+
+          const T* row = planes_[1 + plane] + row_stride_*ptrdiff_t(j);
+          const T* back = j > 0 ? row - row_stride_ : row;
+          const T* front = j + 1 < ny_ ? row + row_stride_ : row;
+          const float y_scale = (j > 0 && j + 1 < ny_) ? 0.5f : 1.0f;
+          const T* below = planes_[plane] + row_stride_*ptrdiff_t(j);
+          const T* above = planes_[2 + plane] + row_stride_*ptrdiff_t(j);
+          const float z_scale = z_scales_[plane];
+
+          gx[0] = float(row[1]) - float(row[0]);
+          for (size_t i = 1; i + 1 < nx_; ++i) gx[i] = 0.5f * (float(row[i+1]) - float(row[i-1]));
+          gx[nx_-1] = float(row[nx_-1]) - float(row[nx_-2]);
+
+          for (size_t i = 0; i < nx_; ++i) gy[i] = y_scale * (float(front[i]) - float(back[i]));
+          for (size_t i = 0; i < nx_; ++i) gz[i] = z_scale * (float(above[i]) - float(below[i]));
+
+          return gradient;
+        }
+    };
+
+    // Output of one slab, with vertex indexes local to the slab
+    struct Slab {
+      std::vector<vertex_type> vertexes;
+      std::vector<Mesh::face_type> faces;
+      // One per vertex, or empty if the layers give no normals
+      std::vector<vertex_type> normals;
+
+      // (edge key, local vertex index) for the x and y edges on the bottom and top vertex planes
+      // of the slab, in ascending key order.  Neighbouring slabs share a plane, and both create
+      // the vertexes on it, so these are used to merge them.
+      std::vector<std::pair<size_t,size_t>> bottom_edges;
+      std::vector<std::pair<size_t,size_t>> top_edges;
+
+      // Used by stitch_slabs: the mesh index of each vertex, the vertexes dropped at the seam
+      // with the next slab paired with their copies there, and where the slab's kept vertexes
+      // and faces start in the mesh
+      std::vector<size_t> mesh_indexes;
+      std::vector<std::pair<size_t,size_t>> seams;
+      size_t vertex_offset = 0;
+      size_t face_offset = 0;
+
+      // Empties every buffer but keeps its memory
+      void clear() {
+        vertexes.clear();
+        faces.clear();
+        normals.clear();
+        bottom_edges.clear();
+        top_edges.clear();
+        mesh_indexes.clear();
+        seams.clear();
+      }
+
+      size_t bytes() const {
+        return sizeof(vertex_type) * (vertexes.capacity() + normals.capacity())
+             + sizeof(Mesh::face_type) * faces.capacity()
+             + sizeof(size_t) * mesh_indexes.capacity()
+             + sizeof(std::pair<size_t,size_t>) * (bottom_edges.capacity() + top_edges.capacity() + seams.capacity());
+      }
+    };
+
+    // Edge cache and row buffer of one slab task
+    struct Workspace {
+      EdgeCache edge_cache;
+      std::vector<uint8_t> cube_types;
+
+      Workspace() : edge_cache(0, 0) {}
+    };
+
+  public:
+    // Slab buffers and per-task workspaces, kept from one call to the next so that polygonizing
+    // many volumes of similar size stops allocating after the first.  Must not be used by two
+    // calls at once.
+    class Scratch {
+      friend class MarchingCubes;
+
+      private:
+        bool exact_sizes_;
+        std::vector<Slab> slabs_;
+        // Idle workspaces; each running slab task takes one
+        std::vector<std::unique_ptr<Workspace>> workspaces_;
+        std::mutex mutex_;
+
+      public:
+        // With exact_sizes, each slab task first counts the vertexes and faces of its layers
+        // (classifying every row twice) and allocates its buffers once at their exact size,
+        // rather than growing them as it goes.  Costs some speed on dense surfaces, but keeps
+        // the peak memory down and avoids copying large buffers as they grow.
+        explicit Scratch(bool exact_sizes = true) : exact_sizes_(exact_sizes) {}
+        Scratch(const Scratch&) = delete;
+        Scratch& operator=(const Scratch&) = delete;
+
+        // Bytes held between calls
+        size_t bytes() const {
+          size_t total = 0;
+          for (const auto& slab : slabs_) total += slab.bytes();
+          for (const auto& workspace : workspaces_) {
+            total += workspace->edge_cache.bytes() + workspace->cube_types.capacity();
+          }
+          return total;
+        }
+
+        // Frees everything
+        void release() {
+          std::vector<Slab>().swap(slabs_);
+          workspaces_.clear();
+        }
+
+      private:
+        std::unique_ptr<Workspace> take_workspace() {
+          std::lock_guard<std::mutex> lock(mutex_);
+          if (workspaces_.empty()) return std::unique_ptr<Workspace>(new Workspace());
+          auto workspace = std::move(workspaces_.back());
+          workspaces_.pop_back();
+          return workspace;
+        }
+
+        void return_workspace(std::unique_ptr<Workspace> workspace) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          workspaces_.push_back(std::move(workspace));
+        }
+    };
+
+  private:
+
+    // Number of vertexes and faces polygonize_layer adds to a slab for a layer of cubes, or more
+    // where edges share the vertex of a grid point at the iso value.  Each crossed edge is counted
+    // at one cube: the x, y and z edges at each cube's lowest corner, plus
+    // the far edges of the last cube in a row, of the last row and, for the last layer of the
+    // slab, of the top plane.  cube_types must hold a row of cubes.
+    template <typename Layer>
+    static void count_layer(const Layer& layer, const size_type& cube_size, bool last_layer, std::vector<uint8_t>& cube_types, size_t& n_vertexes, size_t& n_faces) {
+      for (size_t j = 0; j < cube_size(1); ++j) {
+        if (!layer.classify_row(j, cube_types.data())) continue;
+
+        const bool last_row = j + 1 == cube_size(1);
+        int owned = (1 << 0) | (1 << 3) | (1 << 8);
+        if (last_row) owned |= (1 << 2) | (1 << 11);
+        if (last_layer) owned |= (1 << 4) | (1 << 7);
+        if (last_row && last_layer) owned |= (1 << 6);
+
+        int last_owned = owned | (1 << 1) | (1 << 9);
+        if (last_row) last_owned |= (1 << 10);
+        if (last_layer) last_owned |= (1 << 5);
+
+        for (size_t i = 0; i < cube_size(0); ++i) {
+          if (i % 8 == 0 && i + 8 <= cube_size(0)) {
+            uint64_t run;
+            std::memcpy(&run, &cube_types[i], sizeof(run));
+            if (run == 0 || run == ~uint64_t(0)) {
+              i += 7;
+              continue;
+            }
+          }
+
+          const uint8_t cube_type = cube_types[i];
+          for (int edges = EDGE_TABLE[cube_type] & (i + 1 == cube_size(0) ? last_owned : owned); edges != 0; edges &= edges - 1) {
+            ++n_vertexes;
+          }
+          n_faces += CUBE_CASES[cube_type].n_triangles;
         }
       }
+    }
+
+    // Polygonizes cube layer k.  stats is a PipelineStats or NoStats.  cube_types must hold a row
+    // of cubes.
+    template <typename Layer, typename Stats>
+    static void polygonize_layer(const Layer& layer, size_t k, const size_type& cube_size, EdgeCache& edge_cache, std::vector<uint8_t>& cube_types, Slab& slab, Stats& stats) {
+      using Phase = PipelineStats::Phase;
+
+      std::array<size_t,12> edge_indexes;
+
+      for (size_t j = 0; j < cube_size(1); ++j) {
+        bool crossed;
+        {
+          typename Stats::Timer timer(stats, Phase::classification);
+          crossed = layer.classify_row(j, cube_types.data());
+        }
+        if (!crossed) {
+          stats.count_cubes(0, cube_size(0));
+          continue;
+        }
+        edge_cache.touch_row(j);
+
+        for (size_t i = 0; i < cube_size(0); ++i) {
+          // Skip runs of cubes that are all inside or all outside, 8 at a time
+          if (i % 8 == 0 && i + 8 <= cube_size(0)) {
+            uint64_t run;
+            std::memcpy(&run, &cube_types[i], sizeof(run));
+            if (run == 0 || run == ~uint64_t(0)) {
+              stats.count_cubes(0, 8);
+              stats.count_case(uint8_t(run), 8);
+              i += 7;
+              continue;
+            }
+          }
 
-      return Mesh(triangles);
+          stats.count_cubes(1, 0);
+          stats.count_case(cube_types[i]);
+          const CubeCase& cube_case = CUBE_CASES[cube_types[i]];
+
+          // No triangles
+          if (cube_case.n_edges == 0) continue;
+
+          {
+            typename Stats::Timer timer(stats, Phase::interpolation);
+            for (size_t n = 0; n < cube_case.n_edges; ++n) {
+              const size_t e = cube_case.edges[n];
+
+              size_t& index = edge_cache(i, j, e);
+              if (index == EdgeCache::npos) {
+                const vertex_type vertex = layer.edge_vertex(i, j, e);
+
+                // A vertex on a grid point is shared by every edge crossing there
+                size_t* point = nullptr;
+                const int end = edge_end(layer, i, j, k, e, vertex);
+                if (end >= 0) {
+                  const auto& corner = CUBE_INDEX_SHIFTS[end == 0 ? ORDERED_EDGE_VERTEXES[e].first : ORDERED_EDGE_VERTEXES[e].second];
+                  point = &edge_cache.point(i + corner(0), j + corner(1), corner(2));
+                }
+
+                if (point && *point != EdgeCache::npos) {
+                  index = *point;
+                }
+                else {
+                  index = slab.vertexes.size();
+                  slab.vertexes.push_back(vertex);
+                  add_normal(layer, i, j, e, slab);
+                  if (point) *point = index;
+                }
+              }
+              edge_indexes[e] = index;
+            }
+          }
+
+          typename Stats::Timer timer(stats, Phase::emission);
+          for (size_t t = 0; t < 3 * size_t(cube_case.n_triangles); t += 3) {
+            slab.faces.emplace_back(
+              edge_indexes[cube_case.triangles[t + 0]],
+              edge_indexes[cube_case.triangles[t + 1]],
+              edge_indexes[cube_case.triangles[t + 2]]
+            );
+          }
+        }
+      }
     }
 
-    // Could increase speed by computing the interpolated edge locations in advance.
-    // That should reduce number of interpolations by about 4 times.  Would need to
-    // create a mapping from {cube_index,edge_index} -> interpolated_vertex.
+    // Only NormalIsosurfaceLayer gives normals
+    template <typename Layer>
+    static void add_normal(const Layer&, size_t, size_t, size_t, Slab&) {}
+
     template <typename T>
-    static Mesh polygonize_isosurface(const Tensor<T,3>& tensor, const T iso_value) {
-      std::vector<triangle_type> triangles;
-      std::array<vertex_type,12> edge_vertexes;
+    static void add_normal(const NormalIsosurfaceLayer<T>& layer, size_t i, size_t j, size_t edge, Slab& slab) {
+      slab.normals.push_back(layer.edge_normal(i, j, edge));
+    }
 
+    template <typename Layer>
+    static constexpr bool gives_normals(const Layer*) { return false; }
+
+    template <typename T>
+    static constexpr bool gives_normals(const NormalIsosurfaceLayer<T>*) { return true; }
+
+    // Which end of edge e of cube (i,j,k) vertex lies exactly on: 0 for the first corner of
+    // ORDERED_EDGE_VERTEXES, 1 for the second, or -1 for neither.  An interpolated vertex lands on
+    // an end when that corner's value equals the iso value.
+    template <typename Layer>
+    static int edge_end(const Layer&, size_t i, size_t j, size_t k, size_t e, const vertex_type& vertex) {
+      return edge_end(i, j, k, e, vertex);
+    }
+
+    // Scales are powers of two, so dividing by them is exact
+    template <typename Layer>
+    static int edge_end(const ScaledLayer<Layer>& layer, size_t i, size_t j, size_t k, size_t e, const vertex_type& vertex) {
+      return edge_end(layer.layer(), i, j, k, e, vertex / layer.scale());
+    }
+
+    static int edge_end(size_t i, size_t j, size_t k, size_t e, const vertex_type& vertex) {
+      const auto& delta0 = CUBE_INDEX_SHIFTS[ORDERED_EDGE_VERTEXES[e].first];
+      const auto& delta1 = CUBE_INDEX_SHIFTS[ORDERED_EDGE_VERTEXES[e].second];
+      const index_type corner0 = index_type(i, j, k) + delta0;
+      const size_t axis = delta0(0) != delta1(0) ? 0 : delta0(1) != delta1(1) ? 1 : 2;
+
+      if (vertex(axis) == double(corner0(axis))) return 0;
+      if (vertex(axis) == double(corner0(axis) + 1)) return 1;
+      return -1;
+    }
+
+    // (key, slot) for the x and y edges and the grid points of a plane, with key
+    // 3*(i + size(0)*j) plus 0, 1 or 2, in ascending key order.  Only the rows next to cubes of
+    // the current layer that filled slots are looked at.
+    static void collect_plane_edges(EdgeCache& edge_cache, const size_type& size, size_t plane, std::vector<std::pair<size_t,size_t>>& edges) {
+      edge_cache.for_each_point_row([&](size_t j) {
+        for (size_t i = 0; i < size(0); ++i) {
+          const size_t key = 3*(i + size(0)*j);
+          if (edge_cache.x_edge(i, j, plane) != EdgeCache::npos) edges.emplace_back(key + 0, edge_cache.x_edge(i, j, plane));
+          if (edge_cache.y_edge(i, j, plane) != EdgeCache::npos) edges.emplace_back(key + 1, edge_cache.y_edge(i, j, plane));
+          if (edge_cache.point(i, j, plane) != EdgeCache::npos) edges.emplace_back(key + 2, edge_cache.point(i, j, plane));
+        }
+      });
+    }
+
+    // Polygonizes cube layers s*SLAB_DEPTH up to (s+1)*SLAB_DEPTH into slab, with a workspace
+    // from scratch
+    template <typename LayerAt, typename Stats>
+    static void polygonize_slab(const size_type& size, const LayerAt& layer_at, size_t s, const index_type& origin, Stats& stats, Scratch& scratch, Slab& slab) {
+      using Layer = decltype(layer_at(size_t(0)));
+
+      const auto cube_size = size_type(size) - size_type(1u, 1u, 1u);
+      const size_t k_begin = s * SLAB_DEPTH;
+      const size_t k_end = std::min(k_begin + SLAB_DEPTH, cube_size(2));
+
+      auto workspace = scratch.take_workspace();
+      EdgeCache& edge_cache = workspace->edge_cache;
+      edge_cache.resize(size(0), size(1));
+      workspace->cube_types.resize(cube_size(0));
+
+      slab.clear();
+
+      if (scratch.exact_sizes_) {
+        size_t n_vertexes = 0, n_faces = 0;
+        for (size_t k = k_begin; k < k_end; ++k) {
+          count_layer(layer_at(k), cube_size, k + 1 == k_end, workspace->cube_types, n_vertexes, n_faces);
+        }
+        slab.vertexes.reserve(n_vertexes);
+        slab.faces.reserve(n_faces);
+        if (gives_normals(static_cast<const Layer*>(nullptr))) slab.normals.reserve(n_vertexes);
+      }
+
+      for (size_t k = k_begin; k < k_end; ++k) {
+        polygonize_layer(layer_at(k), k, cube_size, edge_cache, workspace->cube_types, slab, stats);
+
+        if (k == k_begin) collect_plane_edges(edge_cache, size, 0, slab.bottom_edges);
+        if (k + 1 == k_end) collect_plane_edges(edge_cache, size, 1, slab.top_edges);
+        else edge_cache.advance();
+      }
+
+      if (origin != index_type()) {
+        for (auto& vertex : slab.vertexes) vertex += origin;
+      }
+
+      scratch.return_workspace(std::move(workspace));
+    }
+
+    // Polygonizes the volume in slabs of SLAB_DEPTH cube layers on the thread pool, then stitches
+    // the slabs together into a MeshType.  layer_at(k) gives the layer object for cube layer k, and
+    // vertexes are moved by origin.
+    template <typename MeshType, typename LayerAt>
+    static MeshType polygonize_slabs(const size_type& size, const LayerAt& layer_at, ThreadPool& pool, const index_type& origin = index_type()) {
+      NoStats stats;
+      Scratch scratch(false);
+      return polygonize_slabs<MeshType>(size, layer_at, pool, origin, stats, scratch);
+    }
+
+    // Each slab records into its own Stats, and these are merged into stats afterwards.  The
+    // slabs and the workspaces of the slab tasks come from scratch.
+    template <typename MeshType, typename LayerAt, typename Stats>
+    static MeshType polygonize_slabs(const size_type& size, const LayerAt& layer_at, ThreadPool& pool, const index_type& origin, Stats& stats, Scratch& scratch) {
+      MeshType mesh;
+      polygonize_slabs(size, layer_at, pool, origin, stats, scratch, mesh);
+      return mesh;
+    }
+
+    // Stitches into the arrays mesh already has (see stitch_slabs)
+    template <typename MeshType, typename LayerAt, typename Stats>
+    static void polygonize_slabs(const size_type& size, const LayerAt& layer_at, ThreadPool& pool, const index_type& origin, Stats& stats, Scratch& scratch, MeshType& mesh) {
       // Get size with one smaller in each dimension, to count cubes not vertexes (i.e. the vertex
       // with the smallest x,y,z coordinates out of all possible 8 on the cube corners).
-      const auto cube_size = size_type(tensor.size()) - size_type(1u, 1u, 1u);
+      const auto cube_size = size_type(size) - size_type(1u, 1u, 1u);
+
+      auto& slabs = scratch.slabs_;
+      slabs.resize((cube_size(2) + SLAB_DEPTH - 1) / SLAB_DEPTH);
+
+      if (!Stats::enabled) {
+        // Nothing is recorded, so the slabs can share stats
+        pool.parallel_for(slabs.size(), [&](size_t s) {
+          polygonize_slab(size, layer_at, s, origin, stats, scratch, slabs[s]);
+        });
+        stitch_slabs(slabs, pool, mesh);
+        return;
+      }
+
+      std::vector<Stats> slab_stats(slabs.size());
+      pool.parallel_for(slabs.size(), [&](size_t s) {
+        polygonize_slab(size, layer_at, s, origin, slab_stats[s], scratch, slabs[s]);
+      });
+
+      size_t slab_vertexes = 0, slab_bytes = 0;
+      for (size_t s = 0; s < slabs.size(); ++s) {
+        stats.merge(slab_stats[s]);
+        slab_vertexes += slabs[s].vertexes.size();
+        slab_bytes += slabs[s].bytes();
+      }
+
+      {
+        typename Stats::Timer timer(stats, PipelineStats::Phase::welding);
+        stitch_slabs(slabs, pool, mesh);
+      }
+      // Every slab is still held when the mesh is allocated, and freed as it is copied in
+      stats.count_welding(slab_vertexes, n_vertexes(mesh), mesh.size());
+      stats.note_bytes(slab_bytes + bytes(mesh));
+    }
+
+    // Polygonizes the slabs as polygonize_slabs does, but a round of one slab per thread at a time,
+    // and hands each round to sink (see the polygonize_isosurface overloads taking one) while the
+    // next round is polygonized.  Holds two rounds of slabs at most.
+    template <typename LayerAt, typename Sink>
+    static void stream_slabs(const size_type& size, const LayerAt& layer_at, ThreadPool& pool, Sink& sink, const index_type& origin = index_type()) {
+      using Layer = decltype(layer_at(size_t(0)));
 
-      size_t cube_type;
-      double v0, v1, offset;
-      index_type delta0, delta1;
+      const auto cube_size = size_type(size) - size_type(1u, 1u, 1u);
+      const size_t n_slabs = (cube_size(2) + SLAB_DEPTH - 1) / SLAB_DEPTH;
+      const size_t round_size = pool.size();
+      const size_t n_rounds = (n_slabs + round_size - 1) / round_size;
 
-      for (const auto& cube_index : cube_size) {
-        cube_type = 0;
+      NoStats stats;
+      Scratch scratch(false);
+      auto& slabs = scratch.slabs_;
+      slabs.resize(std::min(2*round_size, n_slabs));
+      StreamSeam seam;
 
-        for (size_t i = 0; i < CUBE_INDEX_SHIFTS.size(); ++i) {
-          if (tensor(cube_index + CUBE_INDEX_SHIFTS[i]) < iso_value) {
-            cube_type |= (1 << i);
+      sink.begin(gives_normals(static_cast<const Layer*>(nullptr)));
+
+      // Round r is polygonized into slabs of one half while round r-1 is added from the other.
+      // The first task adds, so it starts at once.
+      for (size_t round = 0; round <= n_rounds; ++round) {
+        const size_t first = round * round_size;
+        const size_t n_new = round < n_rounds ? std::min(round_size, n_slabs - first) : 0;
+        const size_t n_added = round > 0 ? 1 : 0;
+
+        pool.parallel_for(n_added + n_new, [&](size_t task) {
+          if (task < n_added) {
+            for (size_t s = first - round_size; s < std::min(first, n_slabs); ++s) stream_slab(slabs[s % (2*round_size)], seam, sink);
           }
+          else {
+            const size_t s = first + task - n_added;
+            polygonize_slab(size, layer_at, s, origin, stats, scratch, slabs[s % (2*round_size)]);
+          }
+        });
+      }
+
+      sink.end();
+    }
+
+    // Where the mesh handed to a sink so far ends
+    struct StreamSeam {
+      // (edge key, mesh index) for the top edges of the last slab added, in ascending key order
+      std::vector<std::pair<size_t,size_t>> top_edges;
+      size_t n_vertexes = 0;
+    };
+
+    // Adds the next slab to the mesh handed to sink.  The vertexes on its bottom plane were added
+    // with the slab below, so they are dropped here and its faces use the earlier copies.
+    template <typename Sink>
+    static void stream_slab(Slab& slab, StreamSeam& seam, Sink& sink) {
+      auto& index = slab.mesh_indexes;
+      index.assign(slab.vertexes.size(), EdgeCache::npos);
+
+      auto top = seam.top_edges.begin();
+      auto bottom = slab.bottom_edges.begin();
+      while (top != seam.top_edges.end() && bottom != slab.bottom_edges.end()) {
+        if (top->first < bottom->first) {
+          ++top;
+        }
+        else if (bottom->first < top->first) {
+          ++bottom;
+        }
+        else {
+          index[bottom->second] = top->second;
+          ++top;
+          ++bottom;
+        }
+      }
+
+      // Kept vertexes are moved to the front, in order
+      const bool normals = !slab.normals.empty();
+      size_t n_kept = 0;
+      for (size_t v = 0; v < index.size(); ++v) {
+        if (index[v] != EdgeCache::npos) continue;
+        index[v] = seam.n_vertexes + n_kept;
+        slab.vertexes[n_kept] = slab.vertexes[v];
+        if (normals) slab.normals[n_kept] = slab.normals[v];
+        ++n_kept;
+      }
+
+      for (auto& face : slab.faces) {
+        face = Mesh::face_type(index[std::get<0>(face)], index[std::get<1>(face)], index[std::get<2>(face)]);
+      }
+
+      seam.top_edges.clear();
+      for (const auto& edge : slab.top_edges) seam.top_edges.emplace_back(edge.first, index[edge.second]);
+      seam.n_vertexes += n_kept;
+
+      if (n_kept > 0) sink.add_vertexes(slab.vertexes.data(), normals ? slab.normals.data() : nullptr, n_kept);
+      if (!slab.faces.empty()) sink.add_faces(slab.faces.data(), slab.faces.size());
+    }
+
+    template <typename S, typename I>
+    static size_t n_vertexes(const BasicMesh<S,I>& mesh) { return mesh.vertexes().size(); }
+
+    template <typename S, typename I>
+    static size_t n_vertexes(const MeshArrays<S,I>& mesh) { return mesh.n_vertexes(); }
+
+    template <typename S, typename I>
+    static size_t bytes(const BasicMesh<S,I>& mesh) {
+      return sizeof(typename BasicMesh<S,I>::vertex_type) * (mesh.vertexes().capacity() + mesh.normals().capacity())
+           + sizeof(typename BasicMesh<S,I>::face_type) * mesh.faces().capacity();
+    }
+
+    template <typename S, typename I>
+    static size_t bytes(const MeshArrays<S,I>& mesh) {
+      return sizeof(S) * (3*mesh.x().capacity() + 3*mesh.normal_x().capacity()) + sizeof(I) * mesh.indexes().capacity();
+    }
+
+    // Contiguous x-fastest values.  Slabs are split as in polygonize_slabs, and each level is
+    // stitched on its own.
+    template <typename T>
+    static std::vector<Mesh> polygonize_levels(const T* data, const size_type& size, const std::vector<T>& iso_values, ThreadPool& pool) {
+      if (!std::is_sorted(iso_values.begin(), iso_values.end())) {
+        throw std::invalid_argument("Iso values must be sorted in ascending order");
+      }
+      if (iso_values.size() > std::numeric_limits<uint8_t>::max()) {
+        throw std::invalid_argument("At most 255 iso values can be polygonized in one pass");
+      }
+
+      const auto cube_size = size_type(size) - size_type(1u, 1u, 1u);
+      const size_t n_slabs = (cube_size(2) + SLAB_DEPTH - 1) / SLAB_DEPTH;
+
+      // Indexed by level, then slab
+      std::vector<std::vector<Slab>> slabs(iso_values.size(), std::vector<Slab>(n_slabs));
+
+      pool.parallel_for(n_slabs, [&](size_t s) {
+        polygonize_levels_slab(data, size, iso_values, s, slabs);
+      });
+
+      std::vector<Mesh> meshes;
+      meshes.reserve(iso_values.size());
+      for (auto& level_slabs : slabs) {
+        meshes.push_back(stitch_slabs<Mesh>(level_slabs, pool));
+        // Free each level's slabs as soon as it is stitched, to keep the peak memory down
+        std::vector<Slab>().swap(level_slabs);
+      }
+      return meshes;
+    }
+
+    template <typename T>
+    static void polygonize_levels_slab(const T* data, const size_type& size, const std::vector<T>& iso_values, size_t s, std::vector<std::vector<Slab>>& slabs) {
+      const size_t n_levels = iso_values.size();
+      const size_t nx = size(0);
+      const size_t plane_size = nx * size(1);
+      const auto cube_size = size_type(size) - size_type(1u, 1u, 1u);
+      const CubeOffsets offsets(nx, plane_size);
+
+      const size_t k_begin = s * SLAB_DEPTH;
+      const size_t k_end = std::min(k_begin + SLAB_DEPTH, cube_size(2));
+
+      // Number of iso values each grid point is at or above, so corner c of a cube is below
+      // level L exactly when its rank is at most L
+      std::array<std::vector<uint8_t>,2> ranks{{std::vector<uint8_t>(plane_size), std::vector<uint8_t>(plane_size)}};
+      std::vector<uint8_t> flags(nx);
+      const auto rank_plane = [&](size_t k, std::vector<uint8_t>& plane_ranks) {
+        for (size_t j = 0; j < size(1); ++j) {
+          RowClassifier::rank(data + plane_size*k + nx*j, nx, iso_values.data(), n_levels, plane_ranks.data() + nx*j, flags.data());
         }
+      };
+
+      // Every edge crossed by some level gets a run of consecutive entries, one per crossing level
+      // from lowest to highest, holding the index of that level's vertex in its own slab.  The
+      // edge cache holds the position of the first entry.  run_levels holds the run's lowest level
+      // and length alongside each entry (for the seam edges).  A grid point equal to some levels
+      // gets a run of its own for them in the cache's point slot, which the runs of every edge
+      // ending there share, as a single level pass shares the point's vertex.
+      std::vector<size_t> run_vertexes;
+      std::vector<std::pair<uint8_t,uint8_t>> run_levels;
+      std::vector<std::pair<size_t,size_t>> bottom_runs, top_runs;
+
+      EdgeCache edge_cache(size(0), size(1));
+      std::vector<uint8_t> lowest(cube_size(0)), highest(cube_size(0));
+      std::array<uint8_t,8> corner_ranks;
+      std::array<size_t,12> edge_runs;
+      std::array<uint8_t,12> edge_lowest;
+
+      rank_plane(k_begin, ranks[0]);
+      for (size_t k = k_begin; k < k_end; ++k) {
+        rank_plane(k + 1, ranks[1]);
+
+        for (size_t j = 0; j < cube_size(1); ++j) {
+          const uint8_t* r00 = ranks[0].data() + nx*j;
+          const uint8_t* r10 = r00 + nx;
+          const uint8_t* r01 = ranks[1].data() + nx*j;
+          const uint8_t* r11 = r01 + nx;
+
+          // Levels [lowest, highest) cross each cube
+          RowClassifier::rank_range(r00, r10, r01, r11, nx, lowest.data(), highest.data());
+
+          for (size_t i = 0; i < cube_size(0); ++i) {
+            // Skip runs of cubes no level crosses, 8 at a time
+            if (i % 8 == 0 && i + 8 <= cube_size(0)) {
+              uint64_t lo, hi;
+              std::memcpy(&lo, &lowest[i], sizeof(lo));
+              std::memcpy(&hi, &highest[i], sizeof(hi));
+              if (lo == hi) {
+                i += 7;
+                continue;
+              }
+            }
 
-        // No triangles
-        if (cube_type == 0) continue;
+            if (lowest[i] == highest[i]) continue;
+            edge_cache.touch_row(j);
 
-        for (size_t i = 0; i < edge_vertexes.size(); ++i) {
-          if (EDGE_TABLE[cube_type] & (1 << i)) {
-            // Get interpolated vertex position (x0 = 0, x1 = 1)
-            /* offset = (iso_value - v0) * (x1 - x0) / (v1 - v0) + x0; */
-            delta0 = CUBE_INDEX_SHIFTS[EDGE_VERTEXES[i].first];
-            delta1 = CUBE_INDEX_SHIFTS[EDGE_VERTEXES[i].second];
-            v0 = tensor(cube_index + delta0);
-            v1 = tensor(cube_index + delta1);
-            offset = (iso_value - v0) / (v1 - v0);
+            // Corner order follows CUBE_INDEX_SHIFTS
+            corner_ranks = {{r00[i], r00[i+1], r10[i+1], r10[i], r01[i], r01[i+1], r11[i+1], r11[i]}};
+            const size_t base = i + nx*j + plane_size*k;
 
-            edge_vertexes[i] = cube_index + (1-offset)*delta0 + offset*delta1;
+            // Runs are created in edge order, so each level sees its vertexes in the same order
+            // as a single level pass would make them
+            for (size_t e = 0; e < edge_runs.size(); ++e) {
+              const uint8_t ra = corner_ranks[ORDERED_EDGE_VERTEXES[e].first];
+              const uint8_t rb = corner_ranks[ORDERED_EDGE_VERTEXES[e].second];
+              if (ra == rb) continue;
+
+              edge_lowest[e] = std::min(ra, rb);
+              const uint8_t edge_highest = std::max(ra, rb);
+              size_t& run = edge_cache(i, j, e);
+              if (run == EdgeCache::npos) {
+                // Levels [point_lowest, edge_highest) equal the value of the upper end, and land on it
+                const size_t upper = ra < rb ? ORDERED_EDGE_VERTEXES[e].second : ORDERED_EDGE_VERTEXES[e].first;
+                const T upper_value = data[base + (ra < rb ? offsets.edges[e].second : offsets.edges[e].first)];
+                size_t point_lowest = edge_highest;
+                size_t point_run = EdgeCache::npos;
+                if (upper_value == iso_values[edge_highest - 1]) {
+                  point_lowest = std::lower_bound(iso_values.begin(), iso_values.end(), upper_value) - iso_values.begin();
+
+                  const auto& corner = CUBE_INDEX_SHIFTS[upper];
+                  size_t& point = edge_cache.point(i + corner(0), j + corner(1), corner(2));
+                  if (point == EdgeCache::npos) {
+                    point = run_vertexes.size();
+                    for (size_t level = point_lowest; level < edge_highest; ++level) {
+                      auto& level_vertexes = slabs[level][s].vertexes;
+                      run_vertexes.push_back(level_vertexes.size());
+                      run_levels.emplace_back(uint8_t(point_lowest), uint8_t(edge_highest - point_lowest));
+                      level_vertexes.push_back(vertex_type() + (index_type(i, j, k) + corner));
+                    }
+                  }
+                  point_run = point;
+                }
+
+                run = run_vertexes.size();
+                for (size_t level = edge_lowest[e]; level < edge_highest; ++level) {
+                  run_levels.emplace_back(edge_lowest[e], uint8_t(edge_highest - edge_lowest[e]));
+                  if (level >= point_lowest) {
+                    const size_t shared = run_vertexes[point_run + (level - point_lowest)];
+                    run_vertexes.push_back(shared);
+                    continue;
+                  }
+
+                  auto& level_vertexes = slabs[level][s].vertexes;
+                  run_vertexes.push_back(level_vertexes.size());
+                  level_vertexes.push_back(level_edge_vertex(data + base, offsets, i, j, k, e, iso_values[level]));
+                }
+              }
+              edge_runs[e] = run;
+            }
+
+            for (size_t level = lowest[i]; level < highest[i]; ++level) {
+              size_t cube_type = 0;
+              for (size_t c = 0; c < corner_ranks.size(); ++c) {
+                if (corner_ranks[c] <= level) cube_type |= (1 << c);
+              }
+
+              const CubeCase& cube_case = CUBE_CASES[cube_type];
+              const auto vertex = [&](size_t e) { return run_vertexes[edge_runs[e] + (level - edge_lowest[e])]; };
+              for (size_t t = 0; t < 3 * size_t(cube_case.n_triangles); t += 3) {
+                slabs[level][s].faces.emplace_back(
+                  vertex(cube_case.triangles[t + 0]),
+                  vertex(cube_case.triangles[t + 1]),
+                  vertex(cube_case.triangles[t + 2])
+                );
+              }
+            }
           }
         }
 
-        for (size_t i = 0; MarchingCubes::TRIANGLE_TABLE[cube_type][i] != -1; i += 3) {
-          triangles.emplace_back(
-            edge_vertexes[MarchingCubes::TRIANGLE_TABLE[cube_type][i + 0]],
-            edge_vertexes[MarchingCubes::TRIANGLE_TABLE[cube_type][i + 1]],
-            edge_vertexes[MarchingCubes::TRIANGLE_TABLE[cube_type][i + 2]]
-          );
-        }
+        if (k == k_begin) collect_plane_edges(edge_cache, size, 0, bottom_runs);
+        if (k + 1 == k_end) collect_plane_edges(edge_cache, size, 1, top_runs);
+        else edge_cache.advance();
+
+        std::swap(ranks[0], ranks[1]);
       }
 
-      return Mesh(triangles);
+      const auto split_runs = [&](const std::vector<std::pair<size_t,size_t>>& runs, std::vector<std::pair<size_t,size_t>> Slab::* edges) {
+        for (const auto& run : runs) {
+          const auto& levels = run_levels[run.second];
+          for (size_t m = 0; m < levels.second; ++m) {
+            (slabs[levels.first + m][s].*edges).emplace_back(run.first, run_vertexes[run.second + m]);
+          }
+        }
+      };
+      split_runs(bottom_runs, &Slab::bottom_edges);
+      split_runs(top_runs, &Slab::top_edges);
     }
+
+    // Same interpolation as IsosurfaceLayer::edge_vertex.  cube points at the lowest corner of
+    // cube (i,j,k).
+    template <typename T>
+    static vertex_type level_edge_vertex(const T* cube, const CubeOffsets& offsets, size_t i, size_t j, size_t k, size_t edge, const T iso_value) {
+      const auto& delta0 = CUBE_INDEX_SHIFTS[ORDERED_EDGE_VERTEXES[edge].first];
+      const auto& delta1 = CUBE_INDEX_SHIFTS[ORDERED_EDGE_VERTEXES[edge].second];
+
+      const double v0 = cube[offsets.edges[edge].first];
+      const double v1 = cube[offsets.edges[edge].second];
+      const double offset = (iso_value - v0) / (v1 - v0);
+
+      return (index_type(i, j, k) + delta0) + offset*(delta1 - delta0);
+    }
+
+    template <typename MeshType>
+    static MeshType stitch_slabs(std::vector<Slab>& slabs, ThreadPool& pool) {
+      MeshType mesh;
+      stitch_slabs(slabs, pool, mesh);
+      return mesh;
+    }
+
+    // Builds the mesh in the arrays mesh already has, so a mesh reused from call to call stops
+    // allocating once it is large enough.  Instantiated in marching_cubes.cpp for every
+    // BasicMesh and MeshArrays that mesh.cpp has.
+    template <typename MeshType>
+    static void stitch_slabs(std::vector<Slab>& slabs, ThreadPool& pool, MeshType& mesh);
 };
+
+template <typename T> constexpr size_t MarchingCubes::IsosurfaceLayer<T>::RUN_LENGTH;
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "marching_cubes.h"
+
+// Polygonizes volume after volume, keeping everything a call allocates for the next one: the
+// slab buffers and edge caches, the min/max pyramid and inside mask of the volume, and the arrays
+// of the mesh it fills.  Once it has seen a volume and a mesh as large as the current ones, a
+// call allocates nothing, which matters when many small volumes (such as 64^3 patches) go
+// through one after another and the allocator would otherwise dominate.
+//
+// Gives the same meshes as the MarchingCubes functions.  Runs one call at a time, so use one
+// extractor per worker thread, or a MarchingCubesBatch to spread a vector of volumes over a pool.
+template <typename T, typename MeshType = Mesh>
+class MarchingCubesExtractor {
+  public:
+    using Normals = MarchingCubes::Normals;
+
+  private:
+    ThreadPool serial_;
+    ThreadPool& pool_;
+
+    MarchingCubes::Scratch scratch_;
+    MinMaxPyramid<T> pyramid_;
+    InsideMask mask_;
+    NoStats stats_;
+
+  public:
+    // Calls run on pool, or on the calling thread without one
+    explicit MarchingCubesExtractor(ThreadPool* pool = nullptr)
+      : serial_(1), pool_(pool ? *pool : serial_), scratch_(false)
+    {}
+
+    MarchingCubesExtractor(const MarchingCubesExtractor&) = delete;
+    MarchingCubesExtractor& operator=(const MarchingCubesExtractor&) = delete;
+
+    // As MarchingCubes::polygonize_isosurface, but building the mesh in the arrays mesh already
+    // has.  Gradient normals still allocate a few row buffers per layer of cubes.
+    void polygonize_isosurface(const Tensor<T,3>& tensor, const T iso_value, MeshType& mesh, Normals normals = Normals::none) {
+      polygonize_contiguous(tensor, iso_value, mesh, normals);
+    }
+
+    void polygonize_isosurface(const MappedTensor<T,3>& tensor, const T iso_value, MeshType& mesh, Normals normals = Normals::none) {
+      polygonize_contiguous(tensor, iso_value, mesh, normals);
+    }
+
+    MeshType polygonize_isosurface(const Tensor<T,3>& tensor, const T iso_value, Normals normals = Normals::none) {
+      MeshType mesh;
+      polygonize_isosurface(tensor, iso_value, mesh, normals);
+      return mesh;
+    }
+
+    // As MarchingCubes::polygonize_tensor, but building the mesh in the arrays mesh already has
+    template <typename Predicate>
+    void polygonize_tensor(const Tensor<T,3>& tensor, const Predicate& is_inside, MeshType& mesh) {
+      polygonize_inside(tensor, is_inside, mesh);
+    }
+
+    template <typename Predicate>
+    void polygonize_tensor(const MappedTensor<T,3>& tensor, const Predicate& is_inside, MeshType& mesh) {
+      polygonize_inside(tensor, is_inside, mesh);
+    }
+
+    template <typename Predicate>
+    MeshType polygonize_tensor(const Tensor<T,3>& tensor, const Predicate& is_inside) {
+      MeshType mesh;
+      polygonize_tensor(tensor, is_inside, mesh);
+      return mesh;
+    }
+
+    // Bytes held by the slab buffers and edge caches between calls
+    size_t bytes() const { return scratch_.bytes(); }
+
+    // Frees everything kept between calls
+    void release() {
+      scratch_.release();
+      pyramid_ = MinMaxPyramid<T>();
+      mask_ = InsideMask();
+    }
+
+  private:
+    template <typename Volume>
+    void polygonize_contiguous(const Volume& volume, const T iso_value, MeshType& mesh, Normals normals) {
+      // The volume's own cached pyramid would be allocated afresh for every new volume
+      pyramid_.assign(volume.data(), volume.size(), &pool_);
+
+      MarchingCubes::with_contiguous_layers(volume, iso_value, pyramid_, normals, [&](const auto& layer_at) {
+        MarchingCubes::polygonize_slabs(volume.size(), layer_at, pool_, MarchingCubes::index_type(), stats_, scratch_, mesh);
+      });
+    }
+
+    template <typename Volume, typename Predicate>
+    void polygonize_inside(const Volume& volume, const Predicate& is_inside, MeshType& mesh) {
+      const T* data = volume.data();
+      const size_t nx = volume.size()(0);
+      const size_t ny = volume.size()(1);
+
+      mask_.assign(volume.size(), [&](size_t i, size_t j, size_t k) -> bool { return is_inside(data[i + nx*(j + ny*k)]); }, pool_);
+      MarchingCubes::polygonize_slabs(volume.size(), [&](size_t k) { return MarchingCubes::InsideLayer(mask_, k); }, pool_, MarchingCubes::index_type(), stats_, scratch_, mesh);
+    }
+};
+
+// Polygonizes a vector of volumes at a time across a thread pool, each volume whole on one thread
+// with that thread's own MarchingCubesExtractor.  Reusing the batch and the vector of meshes from
+// one call to the next keeps every thread allocation-free once warmed up.
+template <typename T, typename MeshType = Mesh>
+class MarchingCubesBatch {
+  public:
+    using Extractor = MarchingCubesExtractor<T,MeshType>;
+    using Normals = MarchingCubes::Normals;
+
+  private:
+    ThreadPool& pool_;
+    std::vector<std::unique_ptr<Extractor>> extractors_;
+
+  public:
+    explicit MarchingCubesBatch(ThreadPool& pool) : pool_(pool) {
+      for (size_t t = 0; t < pool.size(); ++t) extractors_.emplace_back(new Extractor());
+    }
+
+    // meshes[v] gets the mesh of tensors[v], built in the arrays it already has
+    void polygonize_isosurfaces(const std::vector<Tensor<T,3>>& tensors, const T iso_value, std::vector<MeshType>& meshes, Normals normals = Normals::none) {
+      for_each_volume(tensors.size(), meshes, [&](Extractor& extractor, size_t v) {
+        extractor.polygonize_isosurface(tensors[v], iso_value, meshes[v], normals);
+      });
+    }
+
+    std::vector<MeshType> polygonize_isosurfaces(const std::vector<Tensor<T,3>>& tensors, const T iso_value, Normals normals = Normals::none) {
+      std::vector<MeshType> meshes;
+      polygonize_isosurfaces(tensors, iso_value, meshes, normals);
+      return meshes;
+    }
+
+    template <typename Predicate>
+    void polygonize_tensors(const std::vector<Tensor<T,3>>& tensors, const Predicate& is_inside, std::vector<MeshType>& meshes) {
+      for_each_volume(tensors.size(), meshes, [&](Extractor& extractor, size_t v) {
+        extractor.polygonize_tensor(tensors[v], is_inside, meshes[v]);
+      });
+    }
+
+    template <typename Predicate>
+    std::vector<MeshType> polygonize_tensors(const std::vector<Tensor<T,3>>& tensors, const Predicate& is_inside) {
+      std::vector<MeshType> meshes;
+      polygonize_tensors(tensors, is_inside, meshes);
+      return meshes;
+    }
+
+    size_t bytes() const {
+      size_t total = 0;
+      for (const auto& extractor : extractors_) total += extractor->bytes();
+      return total;
+    }
+
+    void release() {
+      for (auto& extractor : extractors_) extractor->release();
+    }
+
+  private:
+    // One task per extractor, each taking the next volume until none are left, so threads that
+    // get small volumes take more of them
+    template <typename Polygonize>
+    void for_each_volume(size_t n_volumes, std::vector<MeshType>& meshes, const Polygonize& polygonize) {
+      meshes.resize(n_volumes);
+
+      std::atomic<size_t> next(0);
+      pool_.parallel_for(extractors_.size(), [&](size_t t) {
+        for (size_t v = next++; v < n_volumes; v = next++) polygonize(*extractors_[t], v);
+      });
+    }
+};
@@ -1,54 +1,152 @@
 #include "mesh.h"
 
-#include <iostream>
-
-Mesh::Mesh(const std::vector<Mesh::triangle_type>& triangles) {
-  // Get unique vertexes
-  std::set<Mesh::vertex_type> vertex_set;
-  for (const auto& triangle : triangles) {
-    vertex_set.insert(triangle.v0());
-    vertex_set.insert(triangle.v1());
-    vertex_set.insert(triangle.v2());
-  }
+#include <array>
+#include <stdexcept>
 
-  vertexes_.reserve(vertex_set.size());
-  vertexes_.insert(vertexes_.end(), vertex_set.begin(), vertex_set.end());
-  vertex_set.clear();
+#include "mesh_writer.h"
 
-  std::map<Mesh::vertex_type,size_t> vertex_to_index;
-  for (size_t i = 0; i < vertexes_.size(); ++i) {
-    vertex_to_index[vertexes_[i]] = i;
-  }
+namespace {
+  // MeshWriter reads BasicMesh and MeshArrays alike through these
+  template <typename S, typename I>
+  struct FacesAccess {
+    const BasicMesh<S,I>& mesh;
+
+    size_t n_vertexes() const { return mesh.vertexes().size(); }
+    size_t n_faces()    const { return mesh.faces().size(); }
+    bool has_normals()  const { return mesh.has_normals(); }
+    const Point<S,3>& vertex(size_t v) const { return mesh.vertexes()[v]; }
+    const Point<S,3>& normal(size_t v) const { return mesh.normals()[v]; }
+    std::array<I,3> face(size_t f) const {
+      const auto& face = mesh.faces()[f];
+      return {{std::get<0>(face), std::get<1>(face), std::get<2>(face)}};
+    }
+  };
 
-  for (const auto& triangle : triangles) {
-    faces_.emplace_back(
-      vertex_to_index[triangle.v0()],
-      vertex_to_index[triangle.v1()],
-      vertex_to_index[triangle.v2()]
-    );
+  template <typename S, typename I>
+  struct ArraysAccess {
+    const MeshArrays<S,I>& mesh;
+
+    size_t n_vertexes() const { return mesh.n_vertexes(); }
+    size_t n_faces()    const { return mesh.size(); }
+    bool has_normals()  const { return mesh.has_normals(); }
+    Point<S,3> vertex(size_t v) const { return mesh.vertex(v); }
+    Point<S,3> normal(size_t v) const { return mesh.normal(v); }
+    std::array<I,3> face(size_t f) const {
+      const I* face = mesh.indexes().data() + 3*f;
+      return {{face[0], face[1], face[2]}};
+    }
+  };
+}
+
+template <typename S, typename I>
+BasicMesh<S,I>::BasicMesh(const std::vector<VertexWelder::triangle_type>& triangles, const VertexWelder& welder) {
+  std::vector<VertexWelder::vertex_type> vertexes;
+  std::vector<VertexWelder::face_type> faces;
+  welder.weld(triangles, vertexes, faces);
+  *this = BasicMesh<S,I>(Mesh(std::move(vertexes), std::move(faces)));
+}
+
+// The welder's own types need no conversion
+template <>
+BasicMesh<double,size_t>::BasicMesh(const std::vector<VertexWelder::triangle_type>& triangles, const VertexWelder& welder) {
+  welder.weld(triangles, vertexes_, faces_);
+}
+
+template <typename S, typename I>
+BasicMesh<S,I>::BasicMesh(std::vector<vertex_type>&& vertexes, std::vector<face_type>&& faces, std::vector<vertex_type>&& normals)
+  : vertexes_(std::move(vertexes)), faces_(std::move(faces)), normals_(std::move(normals))
+{
+  if (!normals_.empty() && normals_.size() != vertexes_.size()) {
+    throw std::invalid_argument("Mesh must have one normal per vertex, or none");
   }
 }
 
-size_t Mesh::size() const { return faces_.size(); }
+template <typename S, typename I>
+size_t BasicMesh<S,I>::size() const { return faces_.size(); }
 
-Mesh::triangle_type Mesh::triangle(size_t i) const {
-  return Mesh::triangle_type(
+template <typename S, typename I>
+typename BasicMesh<S,I>::triangle_type BasicMesh<S,I>::triangle(size_t i) const {
+  return triangle_type(
     vertexes_[std::get<0>(faces_[i])],
     vertexes_[std::get<1>(faces_[i])],
     vertexes_[std::get<2>(faces_[i])]
   );
 }
 
-std::ostream& Mesh::write_off_file(std::ostream& os) const {
-  os << "OFF " << vertexes_.size() << " " << faces_.size() << " 0" << std::endl;
+template <typename S, typename I>
+MeshDecimator::Report BasicMesh<S,I>::decimate(const MeshDecimator& decimator) {
+  return decimator.decimate(vertexes_, faces_, normals_);
+}
 
-  for (const auto& vertex : vertexes_) {
-    os << vertex.x() << " " << vertex.y() << " " << vertex.z() << std::endl;
-  }
+template <typename S, typename I>
+std::ostream& BasicMesh<S,I>::write_off_file(std::ostream& os, ThreadPool* pool) const {
+  MeshWriter::write_off<S>(FacesAccess<S,I>{*this}, os, pool);
+  return os;
+}
+
+template <typename S, typename I>
+std::ostream& BasicMesh<S,I>::write_ply_file(std::ostream& os) const {
+  MeshWriter::write_ply<S>(FacesAccess<S,I>{*this}, os);
+  return os;
+}
 
-  for (const auto& face : faces_) {
-    os << "3 " << std::get<0>(face) << " " << std::get<1>(face) << " " << std::get<2>(face) << std::endl;
+template <typename S, typename I>
+std::ostream& BasicMesh<S,I>::write_stl_file(std::ostream& os) const {
+  MeshWriter::write_stl<S>(FacesAccess<S,I>{*this}, os);
+  return os;
+}
+
+template <typename S, typename I>
+MeshArrays<S,I>::MeshArrays(
+  std::vector<S>&& x, std::vector<S>&& y, std::vector<S>&& z, std::vector<I>&& indexes,
+  std::vector<S>&& normal_x, std::vector<S>&& normal_y, std::vector<S>&& normal_z
+)
+  : x_(std::move(x)), y_(std::move(y)), z_(std::move(z)), indexes_(std::move(indexes)),
+    normal_x_(std::move(normal_x)), normal_y_(std::move(normal_y)), normal_z_(std::move(normal_z))
+{
+  if (y_.size() != x_.size() || z_.size() != x_.size()) {
+    throw std::invalid_argument("Coordinate arrays must have the same length");
+  }
+  if (normal_y_.size() != normal_x_.size() || normal_z_.size() != normal_x_.size() || (!normal_x_.empty() && normal_x_.size() != x_.size())) {
+    throw std::invalid_argument("Normal arrays must be empty or as long as the coordinate arrays");
+  }
+  if (indexes_.size() % 3 != 0) {
+    throw std::invalid_argument("Index array must hold three indexes per face");
   }
+}
+
+template <typename S, typename I>
+size_t MeshArrays<S,I>::size() const { return indexes_.size() / 3; }
+
+template <typename S, typename I>
+typename MeshArrays<S,I>::triangle_type MeshArrays<S,I>::triangle(size_t i) const {
+  return triangle_type(vertex(indexes_[3*i + 0]), vertex(indexes_[3*i + 1]), vertex(indexes_[3*i + 2]));
+}
 
+template <typename S, typename I>
+std::ostream& MeshArrays<S,I>::write_off_file(std::ostream& os, ThreadPool* pool) const {
+  MeshWriter::write_off<S>(ArraysAccess<S,I>{*this}, os, pool);
   return os;
 }
+
+template <typename S, typename I>
+std::ostream& MeshArrays<S,I>::write_ply_file(std::ostream& os) const {
+  MeshWriter::write_ply<S>(ArraysAccess<S,I>{*this}, os);
+  return os;
+}
+
+template <typename S, typename I>
+std::ostream& MeshArrays<S,I>::write_stl_file(std::ostream& os) const {
+  MeshWriter::write_stl<S>(ArraysAccess<S,I>{*this}, os);
+  return os;
+}
+
+template class BasicMesh<double,size_t>;
+template class BasicMesh<double,uint32_t>;
+template class BasicMesh<float,size_t>;
+template class BasicMesh<float,uint32_t>;
+
+template class MeshArrays<double,size_t>;
+template class MeshArrays<double,uint32_t>;
+template class MeshArrays<float,size_t>;
+template class MeshArrays<float,uint32_t>;
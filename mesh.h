@@ -1,30 +1,212 @@
 #pragma once
 
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
 #include <vector>
-#include <set>
-#include <map>
 
 #include "point.h"
 #include "size.h"
 #include "triangle.h"
+#include "vertex_welder.h"
+#include "mesh_decimator.h"
+#include "thread_pool.h"
 
-class Mesh {
+// Indexed triangle mesh with vertex coordinates of type S and vertex indexes of type I.  Mesh
+// (double, size_t) is what the polygonizers produce by default; CompactMesh (float, uint32_t)
+// takes half the memory.  Member functions are instantiated in mesh.cpp for S in {double, float}
+// and I in {size_t, uint32_t}.
+template <typename S, typename I>
+class BasicMesh {
   public:
-    using triangle_type = Triangle<double,3>;
-    using vertex_type = triangle_type::vertex_type;
-    using size_type = Size<size_t,3>;
-    using index_type = Point<size_t,3>;
+    using scalar_type       = S;
+    using vertex_index_type = I;
+    using triangle_type     = Triangle<S,3>;
+    using vertex_type       = typename triangle_type::vertex_type;
+    using size_type         = Size<size_t,3>;
+    using index_type        = Point<size_t,3>;
+    using face_type         = std::tuple<I,I,I>;
 
   private:
     std::vector<vertex_type> vertexes_;
-    std::vector<std::tuple<size_t,size_t,size_t>> faces_;
+    std::vector<face_type> faces_;
+    // Unit normal per vertex, or empty
+    std::vector<vertex_type> normals_;
 
   public:
-    explicit Mesh(const std::vector<triangle_type>& triangles);
+    BasicMesh() = default;
+    // Welds equal vertexes of the triangles together
+    explicit BasicMesh(const std::vector<VertexWelder::triangle_type>& triangles, const VertexWelder& welder = VertexWelder());
+    // Faces index into vertexes, which must already be unique.  normals is either empty or has
+    // one entry per vertex.
+    explicit BasicMesh(std::vector<vertex_type>&& vertexes, std::vector<face_type>&& faces, std::vector<vertex_type>&& normals = std::vector<vertex_type>());
+
+    // Converts coordinates and indexes.  Throws if I cannot index every vertex.
+    template <typename S2, typename I2>
+    explicit BasicMesh(const BasicMesh<S2,I2>& mesh)
+      : vertexes_(mesh.vertexes().size()), faces_(mesh.faces().size()), normals_(mesh.normals().size())
+    {
+      if (mesh.vertexes().size() > size_t(std::numeric_limits<I>::max())) {
+        throw std::runtime_error("Mesh has too many vertexes for its index type");
+      }
+      for (size_t v = 0; v < vertexes_.size(); ++v) {
+        const auto& vertex = mesh.vertexes()[v];
+        vertexes_[v] = vertex_type(S(vertex.x()), S(vertex.y()), S(vertex.z()));
+      }
+      for (size_t v = 0; v < normals_.size(); ++v) {
+        const auto& normal = mesh.normals()[v];
+        normals_[v] = vertex_type(S(normal.x()), S(normal.y()), S(normal.z()));
+      }
+      for (size_t f = 0; f < faces_.size(); ++f) {
+        const auto& face = mesh.faces()[f];
+        faces_[f] = face_type(I(std::get<0>(face)), I(std::get<1>(face)), I(std::get<2>(face)));
+      }
+    }
+
+    const std::vector<vertex_type>& vertexes() const { return vertexes_; }
+    const std::vector<face_type>&   faces()    const { return faces_; }
+    const std::vector<vertex_type>& normals()  const { return normals_; }
+
+    bool has_normals() const { return !normals_.empty(); }
+
+    // Empties the mesh and moves its arrays out, cleared but keeping their memory, so that a new
+    // mesh can be built in them
+    void release_arrays(std::vector<vertex_type>& vertexes, std::vector<face_type>& faces, std::vector<vertex_type>& normals) {
+      vertexes = std::move(vertexes_);
+      faces = std::move(faces_);
+      normals = std::move(normals_);
+      *this = BasicMesh();
+      vertexes.clear();
+      faces.clear();
+      normals.clear();
+    }
+
+    // Swaps the arrays with the given ones, contents and all, so that a caller can patch a mesh in
+    // place and swap it back.  normals must stay either empty or one per vertex.
+    void swap_arrays(std::vector<vertex_type>& vertexes, std::vector<face_type>& faces, std::vector<vertex_type>& normals) {
+      vertexes_.swap(vertexes);
+      faces_.swap(faces);
+      normals_.swap(normals);
+    }
+
+    size_t size() const;
+    triangle_type triangle(size_t i) const;
+
+    // Reduces the faces in place, and reports how far
+    MeshDecimator::Report decimate(const MeshDecimator& decimator);
+
+    // ASCII OFF, or NOFF with the normal after each vertex when the mesh has normals.  Lines are
+    // formatted into large buffers, in parallel when given a thread pool.
+    std::ostream& write_off_file(std::ostream& os, ThreadPool* pool = nullptr) const;
+
+    // Binary little-endian PLY, with S vertex coordinates (and nx, ny, nz normals when the mesh
+    // has them) and uint32 face indexes
+    std::ostream& write_ply_file(std::ostream& os) const;
+
+    // Binary STL, with float coordinates and per-face normals from the triangle winding (STL has
+    // no vertex normals)
+    std::ostream& write_stl_file(std::ostream& os) const;
+};
+
+template <>
+BasicMesh<double,size_t>::BasicMesh(const std::vector<VertexWelder::triangle_type>& triangles, const VertexWelder& welder);
+
+using Mesh        = BasicMesh<double,size_t>;
+using CompactMesh = BasicMesh<float,uint32_t>;
+
+// Structure-of-arrays form of a mesh: one array per coordinate, and three vertex indexes per
+// face in a single array, ready to be uploaded as-is.  The polygonizers can produce it directly.
+template <typename S, typename I>
+class MeshArrays {
+  public:
+    using scalar_type       = S;
+    using vertex_index_type = I;
+    using triangle_type     = Triangle<S,3>;
+    using vertex_type       = typename triangle_type::vertex_type;
+
+  private:
+    std::vector<S> x_, y_, z_;
+    std::vector<I> indexes_;
+    // Empty, or one normal per vertex
+    std::vector<S> normal_x_, normal_y_, normal_z_;
+
+  public:
+    MeshArrays() = default;
+    // indexes holds three vertex indexes per face.  The normal arrays are either empty or as long
+    // as the coordinate arrays.
+    explicit MeshArrays(
+      std::vector<S>&& x, std::vector<S>&& y, std::vector<S>&& z, std::vector<I>&& indexes,
+      std::vector<S>&& normal_x = std::vector<S>(), std::vector<S>&& normal_y = std::vector<S>(), std::vector<S>&& normal_z = std::vector<S>()
+    );
+
+    // Throws if I cannot index every vertex
+    template <typename S2, typename I2>
+    explicit MeshArrays(const BasicMesh<S2,I2>& mesh)
+      : x_(mesh.vertexes().size()), y_(mesh.vertexes().size()), z_(mesh.vertexes().size()), indexes_(3 * mesh.faces().size()),
+        normal_x_(mesh.normals().size()), normal_y_(mesh.normals().size()), normal_z_(mesh.normals().size())
+    {
+      if (mesh.vertexes().size() > size_t(std::numeric_limits<I>::max())) {
+        throw std::runtime_error("Mesh has too many vertexes for its index type");
+      }
+      for (size_t v = 0; v < x_.size(); ++v) {
+        const auto& vertex = mesh.vertexes()[v];
+        x_[v] = S(vertex.x());
+        y_[v] = S(vertex.y());
+        z_[v] = S(vertex.z());
+      }
+      for (size_t f = 0; f < mesh.faces().size(); ++f) {
+        const auto& face = mesh.faces()[f];
+        indexes_[3*f + 0] = I(std::get<0>(face));
+        indexes_[3*f + 1] = I(std::get<1>(face));
+        indexes_[3*f + 2] = I(std::get<2>(face));
+      }
+      for (size_t v = 0; v < normal_x_.size(); ++v) {
+        const auto& normal = mesh.normals()[v];
+        normal_x_[v] = S(normal.x());
+        normal_y_[v] = S(normal.y());
+        normal_z_[v] = S(normal.z());
+      }
+    }
+
+    const std::vector<S>& x() const { return x_; }
+    const std::vector<S>& y() const { return y_; }
+    const std::vector<S>& z() const { return z_; }
+    const std::vector<I>& indexes() const { return indexes_; }
+
+    const std::vector<S>& normal_x() const { return normal_x_; }
+    const std::vector<S>& normal_y() const { return normal_y_; }
+    const std::vector<S>& normal_z() const { return normal_z_; }
+
+    size_t n_vertexes() const { return x_.size(); }
+    vertex_type vertex(size_t v) const { return vertex_type(x_[v], y_[v], z_[v]); }
+
+    bool has_normals() const { return !normal_x_.empty(); }
+    vertex_type normal(size_t v) const { return vertex_type(normal_x_[v], normal_y_[v], normal_z_[v]); }
+
+    // As BasicMesh::release_arrays
+    void release_arrays(std::vector<S>& x, std::vector<S>& y, std::vector<S>& z, std::vector<I>& indexes, std::vector<S>& normal_x, std::vector<S>& normal_y, std::vector<S>& normal_z) {
+      x = std::move(x_);
+      y = std::move(y_);
+      z = std::move(z_);
+      indexes = std::move(indexes_);
+      normal_x = std::move(normal_x_);
+      normal_y = std::move(normal_y_);
+      normal_z = std::move(normal_z_);
+      *this = MeshArrays();
+      for (auto* array : {&x, &y, &z, &normal_x, &normal_y, &normal_z}) array->clear();
+      indexes.clear();
+    }
 
     size_t size() const;
     triangle_type triangle(size_t i) const;
 
-    std::ostream& write_off_file(std::ostream& os) const;
+    // Same formats as BasicMesh
+    std::ostream& write_off_file(std::ostream& os, ThreadPool* pool = nullptr) const;
+    std::ostream& write_ply_file(std::ostream& os) const;
+    std::ostream& write_stl_file(std::ostream& os) const;
 };
 
+using CompactMeshArrays = MeshArrays<float,uint32_t>;
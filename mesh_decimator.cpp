@@ -0,0 +1,576 @@
+#include "mesh_decimator.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+  using vector_type  = Point<double,3>;
+  using face_indexes = std::array<size_t,3>;
+
+  // Boundaries of n_chunks roughly equal chunks of [0, n)
+  std::vector<size_t> chunk_bounds(size_t n, size_t n_chunks) {
+    std::vector<size_t> bounds(n_chunks + 1);
+    for (size_t i = 0; i <= n_chunks; ++i) bounds[i] = n * i / n_chunks;
+    return bounds;
+  }
+
+  // Sorts each chunk, then merges neighbouring runs pairwise
+  template <typename T>
+  void parallel_sort(std::vector<T>& items, ThreadPool& pool) {
+    const size_t n_chunks = pool.size();
+    const auto bounds = chunk_bounds(items.size(), n_chunks);
+
+    pool.parallel_for(n_chunks, [&](size_t chunk) {
+      std::sort(items.begin() + bounds[chunk], items.begin() + bounds[chunk+1]);
+    });
+    for (size_t width = 1; width < n_chunks; width *= 2) {
+      pool.parallel_for((n_chunks + 2*width - 1) / (2*width), [&](size_t merge) {
+        const size_t first  = bounds[2*width*merge];
+        const size_t middle = bounds[std::min(2*width*merge + width, n_chunks)];
+        const size_t last   = bounds[std::min(2*width*(merge + 1), n_chunks)];
+        std::inplace_merge(items.begin() + first, items.begin() + middle, items.begin() + last);
+      });
+    }
+  }
+
+  double dot(const vector_type& lhs, const vector_type& rhs) {
+    return lhs(0)*rhs(0) + lhs(1)*rhs(1) + lhs(2)*rhs(2);
+  }
+
+  vector_type cross(const vector_type& lhs, const vector_type& rhs) {
+    return vector_type(
+      lhs(1)*rhs(2) - lhs(2)*rhs(1),
+      lhs(2)*rhs(0) - lhs(0)*rhs(2),
+      lhs(0)*rhs(1) - lhs(1)*rhs(0)
+    );
+  }
+
+  // Unit length, or unchanged if zero
+  vector_type normalized(vector_type v) {
+    const double length = std::sqrt(dot(v, v));
+    if (length > 0) v /= length;
+    return v;
+  }
+
+  vector_type face_normal(const vector_type& p0, const vector_type& p1, const vector_type& p2) {
+    return cross(p1 - p0, p2 - p0);
+  }
+
+  // Sum of squared distances to a set of planes, as the symmetric 4x4 matrix of Garland and
+  // Heckbert (upper triangle, by rows)
+  struct Quadric {
+    std::array<double,10> q;
+
+    Quadric() : q{} {}
+
+    // Plane dot(normal, p) + d = 0, with unit normal
+    Quadric(const vector_type& normal, double d, double weight) {
+      const double a = normal(0), b = normal(1), c = normal(2);
+      q = {{a*a, a*b, a*c, a*d, b*b, b*c, b*d, c*c, c*d, d*d}};
+      for (auto& value : q) value *= weight;
+    }
+
+    Quadric& operator+=(const Quadric& rhs) {
+      for (size_t i = 0; i < q.size(); ++i) q[i] += rhs.q[i];
+      return *this;
+    }
+
+    double error(const vector_type& p) const {
+      const double x = p(0), y = p(1), z = p(2);
+      return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+           + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y
+           + q[7]*z*z + 2*q[8]*z
+           + q[9];
+    }
+
+    // Point of least error, or false if there is no unique one (e.g. all planes parallel)
+    bool minimum(vector_type& p) const {
+      const double det =
+          q[0]*(q[4]*q[7] - q[5]*q[5])
+        - q[1]*(q[1]*q[7] - q[5]*q[2])
+        + q[2]*(q[1]*q[5] - q[4]*q[2]);
+      const double trace = q[0] + q[4] + q[7];
+      if (!(std::abs(det) > 1e-10 * trace*trace*trace)) return false;
+
+      const double bx = -q[3], by = -q[6], bz = -q[8];
+      p = vector_type(
+        (bx*(q[4]*q[7] - q[5]*q[5]) - q[1]*(by*q[7] - q[5]*bz) + q[2]*(by*q[5] - q[4]*bz)) / det,
+        (q[0]*(by*q[7] - bz*q[5]) - bx*(q[1]*q[7] - q[5]*q[2]) + q[2]*(q[1]*bz - by*q[2])) / det,
+        (q[0]*(q[4]*bz - q[5]*by) - q[1]*(q[1]*bz - by*q[2]) + bx*(q[1]*q[5] - q[4]*q[2])) / det
+      );
+      return true;
+    }
+  };
+
+  struct Candidate {
+    double cost;
+    size_t u, v;
+    uint32_t version_u, version_v;
+    vector_type position;
+
+    // Cheapest first, ties broken by vertex for a deterministic order
+    bool operator>(const Candidate& rhs) const {
+      return std::tie(cost, u, v) > std::tie(rhs.cost, rhs.u, rhs.v);
+    }
+  };
+
+  // Collapsed position of the edge (u, v) and its error.  A vertex on a boundary keeps its
+  // position, so an edge between two of them cannot be collapsed and costs infinitely much.
+  Candidate candidate_for(size_t u, size_t v, const std::vector<vector_type>& positions, const std::vector<Quadric>& quadrics, const std::vector<uint32_t>& versions, const std::vector<bool>& on_boundary) {
+    Quadric quadric = quadrics[u];
+    quadric += quadrics[v];
+
+    Candidate candidate{0, u, v, versions[u], versions[v], vector_type()};
+    if (on_boundary[u] && on_boundary[v]) {
+      candidate.cost = std::numeric_limits<double>::infinity();
+      return candidate;
+    }
+    if (on_boundary[u] || on_boundary[v]) {
+      candidate.position = positions[on_boundary[u] ? u : v];
+    } else if (!quadric.minimum(candidate.position)) {
+      // Fall back on the best of the two ends and the middle
+      const vector_type middle = (positions[u] + positions[v]) * 0.5;
+      candidate.position = middle;
+      for (const vector_type& p : {positions[u], positions[v]}) {
+        if (quadric.error(p) < quadric.error(candidate.position)) candidate.position = p;
+      }
+    }
+    candidate.cost = std::max(0.0, quadric.error(candidate.position));
+    return candidate;
+  }
+
+  // Writes the given faces back, dropping unused vertexes and keeping vertexes in their order
+  template <typename S, typename I>
+  void compact(
+    const std::vector<vector_type>& positions,
+    const std::vector<vector_type>& working_normals,
+    const std::vector<face_indexes>& working_faces,
+    ThreadPool& pool,
+    std::vector<Point<S,3>>& vertexes,
+    std::vector<std::tuple<I,I,I>>& faces,
+    std::vector<Point<S,3>>& normals
+  ) {
+    std::vector<size_t> new_index(positions.size(), 0);
+    for (const auto& face : working_faces) {
+      for (const size_t v : face) new_index[v] = 1;
+    }
+    size_t n_vertexes = 0;
+    for (auto& index : new_index) {
+      const size_t used = index;
+      index = n_vertexes;
+      n_vertexes += used;
+    }
+
+    vertexes.resize(n_vertexes);
+    normals.resize(working_normals.empty() ? 0 : n_vertexes);
+    const size_t n_chunks = pool.size();
+    const auto vertex_bounds = chunk_bounds(positions.size(), n_chunks);
+    pool.parallel_for(n_chunks, [&](size_t chunk) {
+      for (size_t v = vertex_bounds[chunk]; v < vertex_bounds[chunk+1]; ++v) {
+        const bool used = v + 1 < positions.size() ? new_index[v+1] != new_index[v] : new_index[v] != n_vertexes;
+        if (!used) continue;
+        const auto& p = positions[v];
+        vertexes[new_index[v]] = Point<S,3>(S(p(0)), S(p(1)), S(p(2)));
+        if (!working_normals.empty()) {
+          const auto& normal = working_normals[v];
+          normals[new_index[v]] = Point<S,3>(S(normal(0)), S(normal(1)), S(normal(2)));
+        }
+      }
+    });
+
+    faces.resize(working_faces.size());
+    const auto face_bounds = chunk_bounds(working_faces.size(), n_chunks);
+    pool.parallel_for(n_chunks, [&](size_t chunk) {
+      for (size_t f = face_bounds[chunk]; f < face_bounds[chunk+1]; ++f) {
+        const auto& face = working_faces[f];
+        faces[f] = std::tuple<I,I,I>(I(new_index[face[0]]), I(new_index[face[1]]), I(new_index[face[2]]));
+      }
+    });
+  }
+
+  template <typename S, typename I>
+  void cluster(
+    double cell_size,
+    ThreadPool& pool,
+    std::vector<Point<S,3>>& vertexes,
+    std::vector<std::tuple<I,I,I>>& faces,
+    std::vector<Point<S,3>>& normals
+  ) {
+    const size_t n = vertexes.size();
+    const size_t n_chunks = pool.size();
+    const auto bounds = chunk_bounds(n, n_chunks);
+
+    // Bounding box, per chunk and then overall
+    std::vector<vector_type> chunk_lows(n_chunks, vector_type(HUGE_VAL, HUGE_VAL, HUGE_VAL));
+    std::vector<vector_type> chunk_highs(n_chunks, vector_type(-HUGE_VAL, -HUGE_VAL, -HUGE_VAL));
+    pool.parallel_for(n_chunks, [&](size_t chunk) {
+      for (size_t v = bounds[chunk]; v < bounds[chunk+1]; ++v) {
+        for (size_t d = 0; d < 3; ++d) {
+          chunk_lows[chunk](d)  = std::min(chunk_lows[chunk](d),  double(vertexes[v](d)));
+          chunk_highs[chunk](d) = std::max(chunk_highs[chunk](d), double(vertexes[v](d)));
+        }
+      }
+    });
+    vector_type low = chunk_lows[0], high = chunk_highs[0];
+    for (size_t chunk = 1; chunk < n_chunks; ++chunk) {
+      for (size_t d = 0; d < 3; ++d) {
+        low(d)  = std::min(low(d),  chunk_lows[chunk](d));
+        high(d) = std::max(high(d), chunk_highs[chunk](d));
+      }
+    }
+
+    // Cells are packed 21 bits per axis into one key
+    constexpr uint64_t CELL_BITS = 21;
+    for (size_t d = 0; d < 3; ++d) {
+      if (!((high(d) - low(d)) / cell_size < double(uint64_t(1) << CELL_BITS))) {
+        throw std::invalid_argument("Cell size is too small for the extent of the mesh");
+      }
+    }
+
+    std::vector<std::pair<uint64_t,size_t>> keys(n);
+    pool.parallel_for(n_chunks, [&](size_t chunk) {
+      for (size_t v = bounds[chunk]; v < bounds[chunk+1]; ++v) {
+        uint64_t key = 0;
+        for (size_t d = 0; d < 3; ++d) {
+          key = (key << CELL_BITS) | uint64_t(std::floor((double(vertexes[v](d)) - low(d)) / cell_size));
+        }
+        keys[v] = std::make_pair(key, v);
+      }
+    });
+    parallel_sort(keys, pool);
+
+    // A new cluster starts wherever the key changes.  Count the starts per chunk first so each
+    // chunk knows the index of its first cluster.
+    const auto is_start = [&](size_t c) { return c == 0 || keys[c-1].first != keys[c].first; };
+
+    std::vector<size_t> offsets(n_chunks + 1, 0);
+    pool.parallel_for(n_chunks, [&](size_t chunk) {
+      for (size_t c = bounds[chunk]; c < bounds[chunk+1]; ++c) {
+        if (is_start(c)) ++offsets[chunk+1];
+      }
+    });
+    for (size_t chunk = 0; chunk < n_chunks; ++chunk) offsets[chunk+1] += offsets[chunk];
+    const size_t n_clusters = offsets[n_chunks];
+
+    std::vector<size_t> cluster_of(n);
+    std::vector<size_t> cluster_starts(n_clusters + 1, n);
+    pool.parallel_for(n_chunks, [&](size_t chunk) {
+      size_t next_cluster = offsets[chunk];
+      for (size_t c = bounds[chunk]; c < bounds[chunk+1]; ++c) {
+        if (is_start(c)) {
+          cluster_starts[next_cluster] = c;
+          ++next_cluster;
+        }
+        cluster_of[keys[c].second] = next_cluster - 1;
+      }
+    });
+
+    // Each cluster is replaced by the mean of its vertexes
+    std::vector<vector_type> positions(n_clusters);
+    std::vector<vector_type> cluster_normals(normals.empty() ? 0 : n_clusters);
+    const auto cluster_bounds = chunk_bounds(n_clusters, n_chunks);
+    pool.parallel_for(n_chunks, [&](size_t chunk) {
+      for (size_t cluster = cluster_bounds[chunk]; cluster < cluster_bounds[chunk+1]; ++cluster) {
+        vector_type sum(0.0, 0.0, 0.0), normal_sum(0.0, 0.0, 0.0);
+        for (size_t c = cluster_starts[cluster]; c < cluster_starts[cluster+1]; ++c) {
+          const size_t v = keys[c].second;
+          sum += vertexes[v];
+          if (!normals.empty()) normal_sum += normals[v];
+        }
+        positions[cluster] = sum / double(cluster_starts[cluster+1] - cluster_starts[cluster]);
+        if (!normals.empty()) cluster_normals[cluster] = normalized(normal_sum);
+      }
+    });
+
+    // Remapped faces, rotated to start at their least vertex and kept as (least vertex, lower
+    // other vertex, 2 * higher other vertex + 1 if the winding meets the higher one first), so
+    // that copies of a face sort together however they are wound.  Degenerate faces sort to the
+    // end.
+    const size_t DEGENERATE = size_t(-1);
+    std::vector<face_indexes> working_faces(faces.size());
+    const auto face_bounds = chunk_bounds(faces.size(), n_chunks);
+    pool.parallel_for(n_chunks, [&](size_t chunk) {
+      for (size_t f = face_bounds[chunk]; f < face_bounds[chunk+1]; ++f) {
+        face_indexes face = {{
+          cluster_of[std::get<0>(faces[f])], cluster_of[std::get<1>(faces[f])], cluster_of[std::get<2>(faces[f])]
+        }};
+        if (face[0] == face[1] || face[1] == face[2] || face[2] == face[0]) {
+          face = {{DEGENERATE, DEGENERATE, DEGENERATE}};
+        } else {
+          std::rotate(face.begin(), std::min_element(face.begin(), face.end()), face.end());
+          face = {{face[0], std::min(face[1], face[2]), 2*std::max(face[1], face[2]) + (face[1] > face[2] ? 1 : 0)}};
+        }
+        working_faces[f] = face;
+      }
+    });
+    parallel_sort(working_faces, pool);
+
+    // One face is kept from each run of copies wound the same way.  Copies wound both ways are
+    // two sides of a flattened fold, which encloses nothing, and are all dropped.
+    size_t n_kept = 0;
+    for (size_t f = 0; f < working_faces.size() && working_faces[f][0] != DEGENERATE; ) {
+      const face_indexes first = working_faces[f];
+      size_t end = f + 1;
+      while (end < working_faces.size() && working_faces[end][0] == first[0] && working_faces[end][1] == first[1] && working_faces[end][2] / 2 == first[2] / 2) ++end;
+
+      if (working_faces[end-1][2] == first[2]) {
+        const size_t higher = first[2] / 2;
+        working_faces[n_kept++] = first[2] % 2 == 1 ? face_indexes{{first[0], higher, first[1]}} : face_indexes{{first[0], first[1], higher}};
+      }
+      f = end;
+    }
+    working_faces.resize(n_kept);
+
+    compact(positions, cluster_normals, working_faces, pool, vertexes, faces, normals);
+  }
+
+  template <typename S, typename I>
+  void collapse_edges(
+    size_t target_faces,
+    double max_error,
+    ThreadPool& pool,
+    std::vector<Point<S,3>>& vertexes,
+    std::vector<std::tuple<I,I,I>>& faces,
+    std::vector<Point<S,3>>& normals
+  ) {
+    const size_t n_vertexes = vertexes.size();
+    const size_t n_chunks = pool.size();
+    const auto vertex_bounds = chunk_bounds(n_vertexes, n_chunks);
+    const auto face_bounds = chunk_bounds(faces.size(), n_chunks);
+
+    std::vector<vector_type> positions(n_vertexes);
+    std::vector<vector_type> working_normals(normals.size());
+    pool.parallel_for(n_chunks, [&](size_t chunk) {
+      for (size_t v = vertex_bounds[chunk]; v < vertex_bounds[chunk+1]; ++v) {
+        positions[v] = vector_type(double(vertexes[v](0)), double(vertexes[v](1)), double(vertexes[v](2)));
+        if (!normals.empty()) working_normals[v] = vector_type(double(normals[v](0)), double(normals[v](1)), double(normals[v](2)));
+      }
+    });
+
+    std::vector<face_indexes> working_faces(faces.size());
+    std::vector<Quadric> face_quadrics(faces.size());
+    std::vector<vector_type> unit_normals(faces.size());
+    pool.parallel_for(n_chunks, [&](size_t chunk) {
+      for (size_t f = face_bounds[chunk]; f < face_bounds[chunk+1]; ++f) {
+        const face_indexes face = {{size_t(std::get<0>(faces[f])), size_t(std::get<1>(faces[f])), size_t(std::get<2>(faces[f]))}};
+        working_faces[f] = face;
+        unit_normals[f] = normalized(face_normal(positions[face[0]], positions[face[1]], positions[face[2]]));
+        face_quadrics[f] = Quadric(unit_normals[f], -dot(unit_normals[f], positions[face[0]]), 1);
+      }
+    });
+
+    // Faces around each vertex.  Faces already degenerate take no part.
+    std::vector<bool> face_alive(faces.size());
+    std::vector<std::vector<size_t>> vertex_faces(n_vertexes);
+    size_t n_faces_alive = 0;
+    for (size_t f = 0; f < working_faces.size(); ++f) {
+      const auto& face = working_faces[f];
+      face_alive[f] = face[0] != face[1] && face[1] != face[2] && face[2] != face[0];
+      if (!face_alive[f]) continue;
+      ++n_faces_alive;
+      for (const size_t v : face) vertex_faces[v].push_back(f);
+    }
+
+    std::vector<Quadric> quadrics(n_vertexes);
+    pool.parallel_for(n_chunks, [&](size_t chunk) {
+      for (size_t v = vertex_bounds[chunk]; v < vertex_bounds[chunk+1]; ++v) {
+        for (const size_t f : vertex_faces[v]) quadrics[v] += face_quadrics[f];
+      }
+    });
+
+    // Every edge once, from the sorted (low vertex, high vertex, face) of each face side.  An
+    // edge with a single face is on a boundary, and so are its ends.
+    std::vector<face_indexes> sides;
+    sides.reserve(3 * n_faces_alive);
+    for (size_t f = 0; f < working_faces.size(); ++f) {
+      if (!face_alive[f]) continue;
+      const auto& face = working_faces[f];
+      for (size_t s = 0; s < 3; ++s) {
+        const size_t a = face[s], b = face[(s + 1) % 3];
+        sides.push_back({{std::min(a, b), std::max(a, b), f}});
+      }
+    }
+    parallel_sort(sides, pool);
+
+    std::vector<std::pair<size_t,size_t>> edges;
+    std::vector<bool> on_boundary(n_vertexes, false);
+    for (size_t s = 0; s < sides.size(); ) {
+      size_t end = s + 1;
+      while (end < sides.size() && sides[end][0] == sides[s][0] && sides[end][1] == sides[s][1]) ++end;
+      const size_t a = sides[s][0], b = sides[s][1];
+      edges.emplace_back(a, b);
+      if (end == s + 1) {
+        on_boundary[a] = true;
+        on_boundary[b] = true;
+      }
+      s = end;
+    }
+
+    std::vector<uint32_t> versions(n_vertexes, 0);
+    std::vector<bool> vertex_alive(n_vertexes, true);
+
+    std::vector<Candidate> initial(edges.size());
+    const auto edge_bounds = chunk_bounds(edges.size(), n_chunks);
+    pool.parallel_for(n_chunks, [&](size_t chunk) {
+      for (size_t e = edge_bounds[chunk]; e < edge_bounds[chunk+1]; ++e) {
+        initial[e] = candidate_for(edges[e].first, edges[e].second, positions, quadrics, versions, on_boundary);
+      }
+    });
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue(std::greater<Candidate>(), std::move(initial));
+
+    // Other vertexes of the live faces around v, sorted
+    std::vector<size_t> neighbours_u, neighbours_v, common;
+    const auto gather_neighbours = [&](size_t v, std::vector<size_t>& neighbours) {
+      neighbours.clear();
+      for (const size_t f : vertex_faces[v]) {
+        if (!face_alive[f]) continue;
+        for (const size_t w : working_faces[f]) {
+          if (w != v) neighbours.push_back(w);
+        }
+      }
+      std::sort(neighbours.begin(), neighbours.end());
+      neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    };
+
+    // Collapsing may not turn any face that remains around the edge over
+    const auto flips = [&](size_t moved, size_t other, const vector_type& position) {
+      for (const size_t f : vertex_faces[moved]) {
+        if (!face_alive[f]) continue;
+        const auto& face = working_faces[f];
+        if (face[0] == other || face[1] == other || face[2] == other) continue;
+
+        std::array<vector_type,3> corners = {{positions[face[0]], positions[face[1]], positions[face[2]]}};
+        const vector_type before = face_normal(corners[0], corners[1], corners[2]);
+        for (size_t c = 0; c < 3; ++c) {
+          if (face[c] == moved) corners[c] = position;
+        }
+        if (dot(before, face_normal(corners[0], corners[1], corners[2])) < 0) return true;
+      }
+      return false;
+    };
+
+    while (!queue.empty()) {
+      if (target_faces > 0 && n_faces_alive <= target_faces) break;
+
+      const Candidate candidate = queue.top();
+      queue.pop();
+      // Only edges between boundary vertexes are left once the cost is infinite
+      if (candidate.cost > max_error || std::isinf(candidate.cost)) break;
+
+      const size_t u = candidate.u, v = candidate.v;
+      if (!vertex_alive[u] || !vertex_alive[v] || versions[u] != candidate.version_u || versions[v] != candidate.version_v) continue;
+
+      // Link condition: the two ends may only share the neighbours across the faces on the edge,
+      // or the collapse would pinch the surface
+      gather_neighbours(u, neighbours_u);
+      gather_neighbours(v, neighbours_v);
+      common.clear();
+      std::set_intersection(neighbours_u.begin(), neighbours_u.end(), neighbours_v.begin(), neighbours_v.end(), std::back_inserter(common));
+      size_t n_shared = 0;
+      for (const size_t f : vertex_faces[u]) {
+        if (!face_alive[f]) continue;
+        const auto& face = working_faces[f];
+        if (face[0] == v || face[1] == v || face[2] == v) ++n_shared;
+      }
+      if (n_shared == 0 || common.size() != n_shared) continue;
+      if (flips(u, v, candidate.position) || flips(v, u, candidate.position)) continue;
+
+      // Move u, fold v into it and drop the faces on the edge
+      positions[u] = candidate.position;
+      quadrics[u] += quadrics[v];
+      on_boundary[u] = on_boundary[u] || on_boundary[v];
+      if (!working_normals.empty()) working_normals[u] = normalized(working_normals[u] + working_normals[v]);
+      vertex_alive[v] = false;
+      ++versions[u];
+
+      for (const size_t f : vertex_faces[v]) {
+        if (!face_alive[f]) continue;
+        auto& face = working_faces[f];
+        if (face[0] == u || face[1] == u || face[2] == u) {
+          face_alive[f] = false;
+          --n_faces_alive;
+        } else {
+          for (auto& w : face) {
+            if (w == v) w = u;
+          }
+          vertex_faces[u].push_back(f);
+        }
+      }
+      std::vector<size_t>().swap(vertex_faces[v]);
+      vertex_faces[u].erase(
+        std::remove_if(vertex_faces[u].begin(), vertex_faces[u].end(), [&](size_t f) { return !face_alive[f]; }),
+        vertex_faces[u].end()
+      );
+
+      gather_neighbours(u, neighbours_u);
+      for (const size_t w : neighbours_u) {
+        queue.push(candidate_for(u, w, positions, quadrics, versions, on_boundary));
+      }
+    }
+
+    std::vector<face_indexes> remaining;
+    remaining.reserve(n_faces_alive);
+    for (size_t f = 0; f < working_faces.size(); ++f) {
+      if (face_alive[f]) remaining.push_back(working_faces[f]);
+    }
+    compact(positions, working_normals, remaining, pool, vertexes, faces, normals);
+  }
+}
+
+MeshDecimator::MeshDecimator(Mode mode, double cell_size, size_t target_faces, double max_error, ThreadPool* pool)
+  : mode_(mode), cell_size_(cell_size), target_faces_(target_faces), max_error_(max_error), pool_(pool) {}
+
+MeshDecimator MeshDecimator::clustering(double cell_size, ThreadPool* pool) {
+  if (!(cell_size > 0)) {
+    throw std::invalid_argument("Cell size must be positive");
+  }
+  return MeshDecimator(Mode::clustering, cell_size, 0, 0, pool);
+}
+
+MeshDecimator MeshDecimator::quadric(size_t target_faces, double max_error, ThreadPool* pool) {
+  if (std::isnan(max_error) || max_error < 0) {
+    throw std::invalid_argument("Error bound must be non-negative");
+  }
+  if (target_faces == 0 && std::isinf(max_error)) {
+    throw std::invalid_argument("Quadric decimation needs a target face count or a finite error bound");
+  }
+  return MeshDecimator(Mode::quadric, 0, target_faces, max_error, pool);
+}
+
+template <typename S, typename I>
+MeshDecimator::Report MeshDecimator::decimate(
+  std::vector<Point<S,3>>& vertexes,
+  std::vector<std::tuple<I,I,I>>& faces,
+  std::vector<Point<S,3>>& normals
+) const {
+  if (!normals.empty() && normals.size() != vertexes.size()) {
+    throw std::invalid_argument("Mesh must have one normal per vertex, or none");
+  }
+
+  ThreadPool serial(1);
+  ThreadPool& pool = pool_ ? *pool_ : serial;
+
+  Report report{vertexes.size(), faces.size(), 0, 0};
+  if (!vertexes.empty()) {
+    switch (mode_) {
+      case Mode::clustering: cluster(cell_size_, pool, vertexes, faces, normals);                         break;
+      case Mode::quadric:    collapse_edges(target_faces_, max_error_, pool, vertexes, faces, normals); break;
+    }
+  }
+  report.vertexes_after = vertexes.size();
+  report.faces_after = faces.size();
+  return report;
+}
+
+template MeshDecimator::Report MeshDecimator::decimate(std::vector<Point<double,3>>&, std::vector<std::tuple<size_t,size_t,size_t>>&, std::vector<Point<double,3>>&) const;
+template MeshDecimator::Report MeshDecimator::decimate(std::vector<Point<double,3>>&, std::vector<std::tuple<uint32_t,uint32_t,uint32_t>>&, std::vector<Point<double,3>>&) const;
+template MeshDecimator::Report MeshDecimator::decimate(std::vector<Point<float,3>>&, std::vector<std::tuple<size_t,size_t,size_t>>&, std::vector<Point<float,3>>&) const;
+template MeshDecimator::Report MeshDecimator::decimate(std::vector<Point<float,3>>&, std::vector<std::tuple<uint32_t,uint32_t,uint32_t>>&, std::vector<Point<float,3>>&) const;
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <limits>
+#include <tuple>
+#include <vector>
+
+#include "point.h"
+#include "thread_pool.h"
+
+// Reduces the triangle count of an indexed mesh in place (see BasicMesh::decimate).  Faces that
+// collapse to a line or point are dropped, as are vertexes no face uses any more.  Vertex normals,
+// when present, are averaged over the vertexes that merge.  decimate() is instantiated in
+// mesh_decimator.cpp for the same vertex and index types as BasicMesh.
+class MeshDecimator {
+  public:
+    enum class Mode {
+      // Merges all vertexes within each cell of a grid into their mean, then drops the faces that
+      // became degenerate and all but one of each set of duplicates.  Faces that came to lie on a
+      // copy wound the other way are dropped together with it.  Fast and parallel; detail smaller
+      // than a cell is lost.
+      clustering,
+      // Collapses the edge with the least quadric error (sum of squared distances to the planes of
+      // the original faces around it) until the target face count is reached or the next collapse
+      // would exceed the error bound.  Collapses that would flip a face or make the mesh
+      // non-manifold are skipped.  Vertexes on open boundaries never move, so the boundaries are
+      // kept as they were.
+      quadric
+    };
+
+    struct Report {
+      size_t vertexes_before, faces_before;
+      size_t vertexes_after, faces_after;
+
+      // Faces before per face after, e.g. 10 when a tenth of the faces are left
+      double reduction() const {
+        return faces_after == 0 ? std::numeric_limits<double>::infinity() : double(faces_before) / double(faces_after);
+      }
+    };
+
+  private:
+    Mode mode_;
+    double cell_size_;
+    size_t target_faces_;
+    double max_error_;
+    ThreadPool* pool_;
+
+    MeshDecimator(Mode mode, double cell_size, size_t target_faces, double max_error, ThreadPool* pool);
+
+  public:
+    // Vertex clustering on a grid of cubic cells of the given edge length
+    static MeshDecimator clustering(double cell_size, ThreadPool* pool = nullptr);
+    // Quadric edge collapse down to target_faces faces (0 for no target), stopping early at the
+    // first collapse costing more than max_error
+    static MeshDecimator quadric(size_t target_faces, double max_error = std::numeric_limits<double>::infinity(), ThreadPool* pool = nullptr);
+
+    Mode mode() const { return mode_; }
+
+    // normals is either empty or has one entry per vertex
+    template <typename S, typename I>
+    Report decimate(
+      std::vector<Point<S,3>>& vertexes,
+      std::vector<std::tuple<I,I,I>>& faces,
+      std::vector<Point<S,3>>& normals
+    ) const;
+};
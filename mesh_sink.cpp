@@ -0,0 +1,165 @@
+#include "mesh_sink.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+constexpr size_t MeshFileSink::BUFFER_CAPACITY;
+
+namespace {
+  // Counts are written right-aligned in this many characters, enough for any size_t, so the
+  // header can be patched without moving what follows
+  constexpr size_t COUNT_WIDTH = 20;
+
+  std::string padded_count(size_t count) {
+    std::string digits = std::to_string(count);
+    return std::string(COUNT_WIDTH - digits.size(), ' ') + digits;
+  }
+}
+
+MeshFileSink::MeshFileSink(std::ostream& os, Format format)
+  : os_(os), format_(format),
+    vertex_out_(&os, BUFFER_CAPACITY),
+    // No stream, and never flushed on its own, as spool_faces() empties it first
+    face_out_(nullptr, OutputBuffer::UNBOUNDED),
+    spool_(std::tmpfile(), &std::fclose),
+    normals_(false), n_vertexes_(0), n_faces_(0), spooled_bytes_(0)
+{
+  if (!spool_) {
+    throw std::runtime_error("Could not create a temporary file for mesh faces");
+  }
+}
+
+void MeshFileSink::begin(bool normals) {
+  normals_ = normals;
+  n_vertexes_ = 0;
+  n_faces_ = 0;
+  face_out_.clear();
+  spooled_bytes_ = 0;
+  std::rewind(spool_.get());
+
+  header_ = os_.tellp();
+  if (header_ == std::streampos(-1)) {
+    throw std::runtime_error("Mesh file sink needs a stream that can seek");
+  }
+  write_header();
+}
+
+void MeshFileSink::add_vertexes(const Mesh::vertex_type* vertexes, const Mesh::vertex_type* normals, size_t n) {
+  for (size_t v = 0; v < n; ++v) {
+    if (format_ == Format::off) {
+      vertex_out_.put_general(vertexes[v].x());
+      vertex_out_.put(' ');
+      vertex_out_.put_general(vertexes[v].y());
+      vertex_out_.put(' ');
+      vertex_out_.put_general(vertexes[v].z());
+      if (normals_) {
+        vertex_out_.put(' ');
+        vertex_out_.put_general(normals[v].x());
+        vertex_out_.put(' ');
+        vertex_out_.put_general(normals[v].y());
+        vertex_out_.put(' ');
+        vertex_out_.put_general(normals[v].z());
+      }
+      vertex_out_.put('\n');
+    }
+    else {
+      vertex_out_.put_little_endian(vertexes[v].x());
+      vertex_out_.put_little_endian(vertexes[v].y());
+      vertex_out_.put_little_endian(vertexes[v].z());
+      if (normals_) {
+        vertex_out_.put_little_endian(normals[v].x());
+        vertex_out_.put_little_endian(normals[v].y());
+        vertex_out_.put_little_endian(normals[v].z());
+      }
+    }
+  }
+  n_vertexes_ += n;
+
+  if (format_ == Format::ply && n_vertexes_ > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("Mesh has too many vertexes for uint32 PLY face indexes");
+  }
+}
+
+void MeshFileSink::add_faces(const Mesh::face_type* faces, size_t n) {
+  for (size_t f = 0; f < n; ++f) {
+    if (format_ == Format::off) {
+      face_out_.put("3 ");
+      face_out_.put_uint(std::get<0>(faces[f]));
+      face_out_.put(' ');
+      face_out_.put_uint(std::get<1>(faces[f]));
+      face_out_.put(' ');
+      face_out_.put_uint(std::get<2>(faces[f]));
+      face_out_.put('\n');
+    }
+    else {
+      face_out_.put_little_endian(uint8_t(3));
+      face_out_.put_little_endian(uint32_t(std::get<0>(faces[f])));
+      face_out_.put_little_endian(uint32_t(std::get<1>(faces[f])));
+      face_out_.put_little_endian(uint32_t(std::get<2>(faces[f])));
+    }
+    if (face_out_.str().size() >= BUFFER_CAPACITY) spool_faces();
+  }
+  n_faces_ += n;
+}
+
+void MeshFileSink::end() {
+  spool_faces();
+  vertex_out_.flush();
+
+  // Faces follow the vertexes
+  std::rewind(spool_.get());
+  std::vector<char> block(BUFFER_CAPACITY);
+  for (size_t copied = 0; copied < spooled_bytes_; ) {
+    const size_t n = std::fread(block.data(), 1, std::min(block.size(), spooled_bytes_ - copied), spool_.get());
+    if (n == 0) {
+      throw std::runtime_error("Could not read mesh faces back from a temporary file");
+    }
+    os_.write(block.data(), n);
+    copied += n;
+  }
+
+  const std::streampos end = os_.tellp();
+  if (!os_.seekp(header_)) {
+    throw std::runtime_error("Mesh file sink could not seek back to the header");
+  }
+  write_header();
+  os_.seekp(end);
+}
+
+void MeshFileSink::write_header() {
+  OutputBuffer out(&os_);
+
+  if (format_ == Format::off) {
+    out.put(normals_ ? "NOFF " : "OFF ");
+    out.put(padded_count(n_vertexes_));
+    out.put(' ');
+    out.put(padded_count(n_faces_));
+    out.put(" 0\n");
+    return;
+  }
+
+  out.put("ply\nformat binary_little_endian 1.0\n");
+  out.put("element vertex ");
+  out.put(padded_count(n_vertexes_));
+  for (const char* property : {"x", "y", "z", "nx", "ny", "nz"}) {
+    if (property[0] == 'n' && !normals_) break;
+    out.put("\nproperty double ");
+    out.put(property);
+  }
+  out.put("\nelement face ");
+  out.put(padded_count(n_faces_));
+  out.put("\nproperty list uchar uint vertex_indices\nend_header\n");
+}
+
+void MeshFileSink::spool_faces() {
+  const std::string& formatted = face_out_.str();
+  if (std::fwrite(formatted.data(), 1, formatted.size(), spool_.get()) != formatted.size()) {
+    throw std::runtime_error("Could not write mesh faces to a temporary file");
+  }
+  spooled_bytes_ += formatted.size();
+  face_out_.clear();
+}
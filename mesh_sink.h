@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdio>
+#include <memory>
+#include <ostream>
+
+#include "mesh.h"
+#include "output_buffer.h"
+
+// Writes a mesh to an OFF or binary PLY file as it is handed over in batches by the
+// MarchingCubes::polygonize_isosurface overloads taking a sink.  The vertex and face lines are
+// those of Mesh::write_off_file and Mesh::write_ply_file, but the counts in the header are
+// padded with spaces to 20 characters, so the files are not byte for byte the same.  Readers
+// skip the extra whitespace.
+//
+// Vertexes go straight to the stream.  Both formats want every vertex before the first face, so
+// faces are formatted into a temporary file and copied after the vertexes at the end.  The
+// vertex and face counts are not known until then either, so the header is written with blank
+// space for them and patched in place, which needs a stream that can seek (such as an
+// std::ofstream).  Memory use stays at a few buffers no matter how large the mesh.
+class MeshFileSink {
+  public:
+    enum class Format { off, ply };
+
+    // Blocks of this many bytes are written at a time
+    static constexpr size_t BUFFER_CAPACITY = OutputBuffer::DEFAULT_CAPACITY;
+
+  private:
+    std::ostream& os_;
+    Format format_;
+    OutputBuffer vertex_out_;
+    // Formatted faces collect here and are moved to spool_ when it fills
+    OutputBuffer face_out_;
+    std::unique_ptr<std::FILE, int(*)(std::FILE*)> spool_;
+
+    std::streampos header_;
+    bool normals_;
+    size_t n_vertexes_;
+    size_t n_faces_;
+    size_t spooled_bytes_;
+
+  public:
+    // Throws std::runtime_error if no temporary file can be made
+    MeshFileSink(std::ostream& os, Format format);
+
+    MeshFileSink(const MeshFileSink&) = delete;
+    MeshFileSink& operator=(const MeshFileSink&) = delete;
+
+    size_t n_vertexes() const { return n_vertexes_; }
+    size_t n_faces() const { return n_faces_; }
+
+    // The sink members.  begin throws std::runtime_error if the stream cannot tell its position,
+    // and end if it cannot seek back to the header.
+    void begin(bool normals);
+    void add_vertexes(const Mesh::vertex_type* vertexes, const Mesh::vertex_type* normals, size_t n);
+    void add_faces(const Mesh::face_type* faces, size_t n);
+    void end();
+
+  private:
+    void write_header();
+    void spool_faces();
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#include "point.h"
+#include "output_buffer.h"
+#include "thread_pool.h"
+
+// The OFF, PLY and STL writers behind BasicMesh and MeshArrays (see mesh.h).  They read the mesh
+// through an access object, so that any layout of vertexes and faces can be written:
+//
+//   size_t n_vertexes() const;
+//   size_t n_faces() const;
+//   bool has_normals() const;
+//   Point<S,3> vertex(size_t v) const;
+//   Point<S,3> normal(size_t v) const;
+//   std::array<I,3> face(size_t f) const;
+//
+// for the coordinate type S the writer is called with and any unsigned index type I.
+class MeshWriter {
+  public:
+    // As BasicMesh::write_off_file
+    template <typename S, typename Access>
+    static void write_off(const Access& mesh, std::ostream& os, ThreadPool* pool = nullptr) {
+      {
+        OutputBuffer out(&os);
+        out.put(mesh.has_normals() ? "NOFF " : "OFF ");
+        out.put_uint(mesh.n_vertexes());
+        out.put(' ');
+        out.put_uint(mesh.n_faces());
+        out.put(" 0\n");
+      }
+
+      // Lines are formatted in chunks, each into its own buffer, and written in order
+      constexpr size_t LINES_PER_CHUNK = 1 << 16;
+      const size_t n_lines = mesh.n_vertexes() + mesh.n_faces();
+      const size_t n_chunks = (n_lines + LINES_PER_CHUNK - 1) / LINES_PER_CHUNK;
+
+      const auto format_line = [&mesh](size_t line, OutputBuffer& out) {
+        if (line < mesh.n_vertexes()) {
+          const auto& vertex = mesh.vertex(line);
+          out.put_general(vertex.x());
+          out.put(' ');
+          out.put_general(vertex.y());
+          out.put(' ');
+          out.put_general(vertex.z());
+          if (mesh.has_normals()) {
+            const auto& normal = mesh.normal(line);
+            out.put(' ');
+            out.put_general(normal.x());
+            out.put(' ');
+            out.put_general(normal.y());
+            out.put(' ');
+            out.put_general(normal.z());
+          }
+        }
+        else {
+          const auto face = mesh.face(line - mesh.n_vertexes());
+          out.put("3 ");
+          out.put_uint(face[0]);
+          out.put(' ');
+          out.put_uint(face[1]);
+          out.put(' ');
+          out.put_uint(face[2]);
+        }
+        out.put('\n');
+      };
+
+      ThreadPool serial(1);
+      ThreadPool& threads = pool ? *pool : serial;
+
+      // Format one round of chunks per thread at a time, so memory stays bounded
+      for (size_t first_chunk = 0; first_chunk < n_chunks; first_chunk += threads.size()) {
+        const size_t n_round = std::min(threads.size(), n_chunks - first_chunk);
+        std::vector<std::unique_ptr<OutputBuffer>> buffers(n_round);
+
+        threads.parallel_for(n_round, [&](size_t c) {
+          // No stream and unbounded capacity, so the buffer only collects
+          buffers[c].reset(new OutputBuffer(nullptr, OutputBuffer::UNBOUNDED));
+          const size_t begin = (first_chunk + c) * LINES_PER_CHUNK;
+          const size_t end = std::min(begin + LINES_PER_CHUNK, n_lines);
+          for (size_t line = begin; line < end; ++line) format_line(line, *buffers[c]);
+        });
+
+        for (const auto& buffer : buffers) {
+          os.write(buffer->str().data(), buffer->str().size());
+        }
+      }
+    }
+
+    // As BasicMesh::write_ply_file.  Throws std::runtime_error, before writing anything, if there
+    // are more vertexes than uint32 face indexes can reach.
+    template <typename S, typename Access>
+    static void write_ply(const Access& mesh, std::ostream& os) {
+      if (mesh.n_vertexes() > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("Mesh has too many vertexes for uint32 PLY face indexes");
+      }
+
+      OutputBuffer out(&os);
+
+      out.put("ply\nformat binary_little_endian 1.0\n");
+      out.put("element vertex ");
+      out.put_uint(mesh.n_vertexes());
+      for (const char* property : {"x", "y", "z", "nx", "ny", "nz"}) {
+        if (property[0] == 'n' && !mesh.has_normals()) break;
+        out.put("\nproperty ");
+        out.put(ply_scalar_name(S()));
+        out.put(' ');
+        out.put(property);
+      }
+      out.put("\nelement face ");
+      out.put_uint(mesh.n_faces());
+      out.put("\nproperty list uchar uint vertex_indices\nend_header\n");
+
+      for (size_t v = 0; v < mesh.n_vertexes(); ++v) {
+        const auto& vertex = mesh.vertex(v);
+        out.put_little_endian(vertex.x());
+        out.put_little_endian(vertex.y());
+        out.put_little_endian(vertex.z());
+        if (mesh.has_normals()) {
+          const auto& normal = mesh.normal(v);
+          out.put_little_endian(normal.x());
+          out.put_little_endian(normal.y());
+          out.put_little_endian(normal.z());
+        }
+      }
+
+      for (size_t f = 0; f < mesh.n_faces(); ++f) {
+        const auto face = mesh.face(f);
+        out.put_little_endian(uint8_t(3));
+        out.put_little_endian(uint32_t(face[0]));
+        out.put_little_endian(uint32_t(face[1]));
+        out.put_little_endian(uint32_t(face[2]));
+      }
+    }
+
+    // As BasicMesh::write_stl_file.  Throws std::runtime_error, before writing anything, if there
+    // are more faces than the uint32 count of the header can hold.
+    template <typename S, typename Access>
+    static void write_stl(const Access& mesh, std::ostream& os) {
+      if (mesh.n_faces() > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("Mesh has too many faces for an STL file");
+      }
+
+      OutputBuffer out(&os);
+
+      out.put(std::string(80, ' '));
+      out.put_little_endian(uint32_t(mesh.n_faces()));
+
+      for (size_t f = 0; f < mesh.n_faces(); ++f) {
+        const auto face = mesh.face(f);
+        const Point<double,3> v0(double(mesh.vertex(face[0]).x()), double(mesh.vertex(face[0]).y()), double(mesh.vertex(face[0]).z()));
+        const Point<double,3> v1(double(mesh.vertex(face[1]).x()), double(mesh.vertex(face[1]).y()), double(mesh.vertex(face[1]).z()));
+        const Point<double,3> v2(double(mesh.vertex(face[2]).x()), double(mesh.vertex(face[2]).y()), double(mesh.vertex(face[2]).z()));
+
+        const auto a = v1 - v0;
+        const auto b = v2 - v0;
+        Point<double,3> normal(a.y()*b.z() - a.z()*b.y(), a.z()*b.x() - a.x()*b.z(), a.x()*b.y() - a.y()*b.x());
+        const double length = std::sqrt(normal.x()*normal.x() + normal.y()*normal.y() + normal.z()*normal.z());
+        if (length > 0) normal /= length;
+
+        for (const auto& vertex : {normal, v0, v1, v2}) {
+          out.put_little_endian(float(vertex.x()));
+          out.put_little_endian(float(vertex.y()));
+          out.put_little_endian(float(vertex.z()));
+        }
+        out.put_little_endian(uint16_t(0));
+      }
+    }
+
+  private:
+    static const char* ply_scalar_name(double) { return "double"; }
+    static const char* ply_scalar_name(float)  { return "float"; }
+};
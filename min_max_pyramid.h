@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "size.h"
+#include "thread_pool.h"
+
+// Per-brick minimum and maximum of a 3D grid of values, for skipping regions an iso surface
+// cannot pass through.  Brick (bx,by,bz) holds the BRICK_SIZE^3 cubes whose lowest corner lies in
+// [BRICK_SIZE*bx, BRICK_SIZE*(bx+1)) and so on, so its range covers the vertexes up to and
+// including BRICK_SIZE*(bx+1).  A coarser level summarizes COARSE_SIZE^3 bricks at a time.
+//
+// NaN values are kept in the maximum, since a NaN corner counts as not below the iso value.
+// The minimum is NaN only if every value in the brick is.
+template <typename T>
+class MinMaxPyramid {
+  public:
+    static constexpr size_t BRICK_SIZE = 8;
+    static constexpr size_t COARSE_SIZE = 4;
+
+    using size_type = Size<size_t,3>;
+
+  private:
+    size_type bricks_;
+    size_type coarse_bricks_;
+
+    std::vector<T> min_, max_;
+    std::vector<T> coarse_min_, coarse_max_;
+
+    // Column minimums and maximums of each plane of bricks, kept so that reassigning a grid of
+    // the same size allocates nothing
+    std::vector<T> columns_;
+
+  public:
+    // No bricks, until assigned
+    MinMaxPyramid() = default;
+
+    // data holds size.prod() values in x-fastest order
+    explicit MinMaxPyramid(const T* data, const size_type& size, ThreadPool* pool = nullptr) {
+      assign(data, size, pool);
+    }
+
+    // Summarizes another grid, reusing the memory of the last one
+    void assign(const T* data, const size_type& size, ThreadPool* pool = nullptr) {
+      assign_rows([data, &size](size_t y, size_t z) { return data + size(0)*(y + size(1)*z); }, size, pool);
+    }
+
+    // As assign, for a grid stored in any order: rows(y, z) gives row (y, z), indexable by x
+    template <typename Rows>
+    void assign_rows(const Rows& rows, const size_type& size, ThreadPool* pool = nullptr) {
+      bricks_ = size_type(bricks_for(size(0)), bricks_for(size(1)), bricks_for(size(2)));
+      coarse_bricks_ = size_type(
+        (bricks_(0) + COARSE_SIZE - 1) / COARSE_SIZE,
+        (bricks_(1) + COARSE_SIZE - 1) / COARSE_SIZE,
+        (bricks_(2) + COARSE_SIZE - 1) / COARSE_SIZE
+      );
+      min_.resize(bricks_.prod());
+      max_.resize(bricks_.prod());
+      coarse_min_.resize(coarse_bricks_.prod());
+      coarse_max_.resize(coarse_bricks_.prod());
+      columns_.resize(2 * size(0) * bricks_(2));
+
+      ThreadPool serial(1);
+      ThreadPool& threads = pool ? *pool : serial;
+
+      // For each row of bricks, first reduce all its vertex rows elementwise (which vectorizes),
+      // then reduce the short x-ranges of each brick
+      threads.parallel_for(bricks_(2), [&](size_t bz) {
+        T* column_min = columns_.data() + 2*size(0)*bz;
+        T* column_max = column_min + size(0);
+
+        for (size_t by = 0; by < bricks_(1); ++by) {
+          const size_t y_end = std::min(BRICK_SIZE*(by+1) + 1, size(1));
+          const size_t z_end = std::min(BRICK_SIZE*(bz+1) + 1, size(2));
+
+          const auto first_row = rows(BRICK_SIZE*by, BRICK_SIZE*bz);
+          for (size_t x = 0; x < size(0); ++x) {
+            column_min[x] = first_row[x];
+            column_max[x] = first_row[x];
+          }
+
+          for (size_t z = BRICK_SIZE*bz; z < z_end; ++z) {
+            for (size_t y = BRICK_SIZE*by; y < y_end; ++y) {
+              const auto row = rows(y, z);
+              for (size_t x = 0; x < size(0); ++x) {
+                lower(row[x], column_min[x]);
+                raise(row[x], column_max[x]);
+              }
+            }
+          }
+
+          for (size_t bx = 0; bx < bricks_(0); ++bx) {
+            const size_t b = bricks_.absolute_index_for({bx, by, bz});
+            const size_t x_end = std::min(BRICK_SIZE*(bx+1) + 1, size(0));
+
+            min_[b] = column_min[BRICK_SIZE*bx];
+            max_[b] = column_max[BRICK_SIZE*bx];
+            for (size_t x = BRICK_SIZE*bx + 1; x < x_end; ++x) {
+              lower(column_min[x], min_[b]);
+              raise(column_max[x], max_[b]);
+            }
+          }
+        }
+      });
+
+      for (size_t cz = 0; cz < coarse_bricks_(2); ++cz) {
+        for (size_t cy = 0; cy < coarse_bricks_(1); ++cy) {
+          for (size_t cx = 0; cx < coarse_bricks_(0); ++cx) {
+            const size_t c = coarse_bricks_.absolute_index_for({cx, cy, cz});
+            bool first = true;
+
+            for (size_t bz = COARSE_SIZE*cz; bz < std::min(COARSE_SIZE*(cz+1), bricks_(2)); ++bz) {
+              for (size_t by = COARSE_SIZE*cy; by < std::min(COARSE_SIZE*(cy+1), bricks_(1)); ++by) {
+                for (size_t bx = COARSE_SIZE*cx; bx < std::min(COARSE_SIZE*(cx+1), bricks_(0)); ++bx) {
+                  const size_t b = bricks_.absolute_index_for({bx, by, bz});
+                  if (first) {
+                    coarse_min_[c] = min_[b];
+                    coarse_max_[c] = max_[b];
+                    first = false;
+                  }
+                  else {
+                    lower(min_[b], coarse_min_[c]);
+                    raise(max_[b], coarse_max_[c]);
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+
+    const size_type& bricks() const { return bricks_; }
+    const size_type& coarse_bricks() const { return coarse_bricks_; }
+
+    T min(size_t bx, size_t by, size_t bz) const { return min_[bricks_.absolute_index_for({bx, by, bz})]; }
+    T max(size_t bx, size_t by, size_t bz) const { return max_[bricks_.absolute_index_for({bx, by, bz})]; }
+
+    // Whether some cube in the brick may have corners on both sides of the iso value, i.e. some
+    // corner below it and some corner not below it
+    bool brick_crosses(size_t bx, size_t by, size_t bz, const T& iso_value) const {
+      const size_t b = bricks_.absolute_index_for({bx, by, bz});
+      return min_[b] < iso_value && !(max_[b] < iso_value);
+    }
+
+    bool coarse_brick_crosses(size_t cx, size_t cy, size_t cz, const T& iso_value) const {
+      const size_t c = coarse_bricks_.absolute_index_for({cx, cy, cz});
+      return coarse_min_[c] < iso_value && !(coarse_max_[c] < iso_value);
+    }
+
+    // Fills crosses[bx] for every brick along the row of bricks (by,bz)
+    void row_crosses(size_t by, size_t bz, const T& iso_value, std::vector<bool>& crosses) const {
+      crosses.assign(bricks_(0), false);
+
+      for (size_t cx = 0; cx < coarse_bricks_(0); ++cx) {
+        if (!coarse_brick_crosses(cx, by / COARSE_SIZE, bz / COARSE_SIZE, iso_value)) continue;
+
+        for (size_t bx = COARSE_SIZE*cx; bx < std::min(COARSE_SIZE*(cx+1), bricks_(0)); ++bx) {
+          crosses[bx] = brick_crosses(bx, by, bz, iso_value);
+        }
+      }
+    }
+
+    // Folds a value into a running minimum or maximum.  The minimum skips NaN values (a NaN is
+    // never below the iso value), while once the maximum is NaN it stays NaN.  The tensors' min()
+    // and max() fold their values the same way.
+    static void lower(const T& value, T& lo) {
+      lo = (value < lo || lo != lo) ? value : lo;
+    }
+
+    static void raise(const T& value, T& hi) {
+      hi = (hi == hi && !(value <= hi)) ? value : hi;
+    }
+
+  private:
+    static size_t bricks_for(size_t n_vertexes) {
+      return n_vertexes < 2 ? 0 : (n_vertexes - 1 + BRICK_SIZE - 1) / BRICK_SIZE;
+    }
+};
+
+template <typename T> constexpr size_t MinMaxPyramid<T>::BRICK_SIZE;
+template <typename T> constexpr size_t MinMaxPyramid<T>::COARSE_SIZE;
@@ -0,0 +1,127 @@
+#include "npy_file.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  // Text following "'key':" in the header dictionary
+  const char* find_value(const std::string& dict, const std::string& key) {
+    const size_t at = dict.find("'" + key + "'");
+    if (at == std::string::npos) throw std::runtime_error("npy header has no '" + key + "'");
+
+    const size_t colon = dict.find(':', at);
+    if (colon == std::string::npos) throw std::runtime_error("npy header has no value for '" + key + "'");
+
+    const char* value = dict.c_str() + colon + 1;
+    while (*value == ' ') ++value;
+    return value;
+  }
+
+  bool host_is_little_endian() {
+    const uint16_t one = 1;
+    uint8_t first;
+    std::memcpy(&first, &one, 1);
+    return first == 1;
+  }
+}
+
+NpyHeader NpyHeader::parse(const char* bytes, size_t n_bytes) {
+  static const char MAGIC[] = "\x93NUMPY";
+
+  if (n_bytes < 10 || std::memcmp(bytes, MAGIC, 6) != 0) throw std::runtime_error("not an npy file");
+
+  const uint8_t major_version = bytes[6];
+  size_t header_length, header_start;
+
+  if (major_version == 1) {
+    header_length = uint8_t(bytes[8]) | (size_t(uint8_t(bytes[9])) << 8);
+    header_start = 10;
+  }
+  else if (major_version == 2 || major_version == 3) {
+    if (n_bytes < 12) throw std::runtime_error("truncated npy header");
+    header_length = 0;
+    for (size_t i = 0; i < 4; ++i) header_length |= size_t(uint8_t(bytes[8 + i])) << (8*i);
+    header_start = 12;
+  }
+  else {
+    throw std::runtime_error("unsupported npy version " + std::to_string(major_version));
+  }
+
+  if (header_start + header_length > n_bytes) throw std::runtime_error("truncated npy header");
+
+  const std::string dict(bytes + header_start, header_length);
+  NpyHeader header;
+  header.data_offset = header_start + header_length;
+
+  const char* descr = find_value(dict, "descr");
+  if (*descr != '\'') throw std::runtime_error("npy descr is not a simple dtype");
+  const char* descr_end = std::strchr(descr + 1, '\'');
+  if (!descr_end) throw std::runtime_error("npy descr is not terminated");
+  header.descr.assign(descr + 1, descr_end);
+
+  const char* fortran_order = find_value(dict, "fortran_order");
+  if (std::strncmp(fortran_order, "True", 4) == 0) header.fortran_order = true;
+  else if (std::strncmp(fortran_order, "False", 5) == 0) header.fortran_order = false;
+  else throw std::runtime_error("npy fortran_order is neither True nor False");
+
+  const char* shape = find_value(dict, "shape");
+  if (*shape != '(') throw std::runtime_error("npy shape is not a tuple");
+  for (const char* c = shape + 1; *c != ')'; ) {
+    if (*c == '\0') throw std::runtime_error("npy shape is not terminated");
+    if (*c >= '0' && *c <= '9') {
+      char* end;
+      header.shape.push_back(std::strtoull(c, &end, 10));
+      c = end;
+    }
+    else {
+      ++c;
+    }
+  }
+
+  return header;
+}
+
+bool NpyHeader::has_type(const std::string& type_code) const {
+  if (descr.size() != type_code.size() + 1 || descr.compare(1, std::string::npos, type_code) != 0) return false;
+
+  switch (descr[0]) {
+    case '|': return type_code.back() == '1';
+    case '=': return true;
+    case '<': return host_is_little_endian() || type_code.back() == '1';
+    case '>': return !host_is_little_endian() || type_code.back() == '1';
+    default:  return false;
+  }
+}
+
+MappedFile::MappedFile(const std::string& path) : data_(nullptr), size_(0) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("cannot open " + path);
+
+  struct stat status;
+  if (::fstat(fd, &status) != 0) {
+    ::close(fd);
+    throw std::runtime_error("cannot stat " + path);
+  }
+  size_ = status.st_size;
+
+  if (size_ > 0) {
+    void* mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      ::close(fd);
+      throw std::runtime_error("cannot map " + path);
+    }
+    data_ = static_cast<const char*>(mapped);
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) ::munmap(const_cast<char*>(data_), size_);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Header of a .npy file (https://numpy.org/doc/stable/reference/generated/numpy.lib.format.html)
+struct NpyHeader {
+  std::string descr;          // dtype, e.g. "<f4" or "|u1"
+  bool fortran_order;
+  std::vector<size_t> shape;
+  size_t data_offset;         // bytes from the start of the file to the array data
+
+  // Throws std::runtime_error if the bytes do not start with a valid .npy header
+  static NpyHeader parse(const char* bytes, size_t n_bytes);
+
+  // Whether descr is the given type code (e.g. "f4") stored in host byte order
+  bool has_type(const std::string& type_code) const;
+};
+
+// .npy type code of each element type
+template <typename T> struct NpyType;
+template <> struct NpyType<bool>     { static const char* code() { return "b1"; } };
+template <> struct NpyType<int8_t>   { static const char* code() { return "i1"; } };
+template <> struct NpyType<uint8_t>  { static const char* code() { return "u1"; } };
+template <> struct NpyType<int16_t>  { static const char* code() { return "i2"; } };
+template <> struct NpyType<uint16_t> { static const char* code() { return "u2"; } };
+template <> struct NpyType<int32_t>  { static const char* code() { return "i4"; } };
+template <> struct NpyType<uint32_t> { static const char* code() { return "u4"; } };
+template <> struct NpyType<int64_t>  { static const char* code() { return "i8"; } };
+template <> struct NpyType<uint64_t> { static const char* code() { return "u8"; } };
+template <> struct NpyType<float>    { static const char* code() { return "f4"; } };
+template <> struct NpyType<double>   { static const char* code() { return "f8"; } };
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+  private:
+    const char* data_;
+    size_t size_;
+
+  public:
+    // Throws std::runtime_error if the file cannot be opened or mapped
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+};
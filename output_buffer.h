@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <ostream>
+#include <string>
+
+// Collects formatted text and little-endian binary values in memory and hands them to the
+// stream in large blocks, instead of one small write (or flush) per value.
+class OutputBuffer {
+  public:
+    static constexpr size_t DEFAULT_CAPACITY = size_t(1) << 20;
+    // Capacity of a buffer that never flushes on its own
+    static constexpr size_t UNBOUNDED = std::numeric_limits<size_t>::max();
+
+  private:
+    std::ostream* os_;
+    std::string buffer_;
+    size_t capacity_;
+
+  public:
+    // Without a stream, the buffer only collects (see str()).  Reserves at most
+    // DEFAULT_CAPACITY up front, so larger and UNBOUNDED buffers grow as they fill.
+    explicit OutputBuffer(std::ostream* os = nullptr, size_t capacity = DEFAULT_CAPACITY) : os_(os), capacity_(capacity) {
+      buffer_.reserve((capacity < DEFAULT_CAPACITY ? capacity : DEFAULT_CAPACITY) + 64);
+    }
+
+    ~OutputBuffer() { flush(); }
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void flush() {
+      if (os_ && !buffer_.empty()) {
+        os_->write(buffer_.data(), buffer_.size());
+        buffer_.clear();
+      }
+    }
+
+    const std::string& str() const { return buffer_; }
+
+    // Drops what has been collected, for a buffer without a stream that is emptied by hand
+    void clear() { buffer_.clear(); }
+
+    void put(char c) {
+      buffer_.push_back(c);
+      maybe_flush();
+    }
+
+    void put(const char* text) {
+      buffer_.append(text);
+      maybe_flush();
+    }
+
+    void put(const std::string& text) {
+      buffer_.append(text);
+      maybe_flush();
+    }
+
+    void put_uint(uint64_t value) {
+      char digits[20];
+      size_t n = 0;
+      do {
+        digits[n++] = char('0' + value % 10);
+        value /= 10;
+      } while (value != 0);
+      while (n > 0) buffer_.push_back(digits[--n]);
+      maybe_flush();
+    }
+
+    // Same text as the default std::ostream formatting of a double (%g, 6 significant digits)
+    void put_general(double value) {
+      char text[32];
+      const int n = std::snprintf(text, sizeof(text), "%g", value);
+      buffer_.append(text, n);
+      maybe_flush();
+    }
+
+    template <typename T>
+    void put_little_endian(const T& value) {
+      char bytes[sizeof(T)];
+      std::memcpy(bytes, &value, sizeof(T));
+      if (!host_is_little_endian()) {
+        for (size_t i = 0; i < sizeof(T) / 2; ++i) std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+      }
+      buffer_.append(bytes, sizeof(T));
+      maybe_flush();
+    }
+
+  private:
+    void maybe_flush() {
+      if (buffer_.size() >= capacity_) flush();
+    }
+
+    static bool host_is_little_endian() {
+      const uint16_t one = 1;
+      uint8_t first;
+      std::memcpy(&first, &one, 1);
+      return first == 1;
+    }
+};
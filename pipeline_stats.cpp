@@ -0,0 +1,66 @@
+#include "pipeline_stats.h"
+
+#include <algorithm>
+
+constexpr bool PipelineStats::enabled;
+constexpr size_t PipelineStats::N_PHASES;
+constexpr bool NoStats::enabled;
+
+PipelineStats::PipelineStats() {
+  reset();
+}
+
+void PipelineStats::count_welding(size_t vertexes_before, size_t vertexes_after, size_t faces) {
+  vertexes_before_welding_ += vertexes_before;
+  vertexes_after_welding_ += vertexes_after;
+  faces_ += faces;
+}
+
+void PipelineStats::merge(const PipelineStats& other) {
+  for (size_t p = 0; p < N_PHASES; ++p) times_[p] += other.times_[p];
+  cubes_visited_ += other.cubes_visited_;
+  cubes_skipped_ += other.cubes_skipped_;
+  for (size_t c = 0; c < case_counts_.size(); ++c) case_counts_[c] += other.case_counts_[c];
+  count_welding(other.vertexes_before_welding_, other.vertexes_after_welding_, other.faces_);
+  note_bytes(other.peak_bytes_);
+}
+
+void PipelineStats::reset() {
+  times_.fill(clock_type::duration::zero());
+  cubes_visited_ = 0;
+  cubes_skipped_ = 0;
+  case_counts_.fill(0);
+  vertexes_before_welding_ = 0;
+  vertexes_after_welding_ = 0;
+  faces_ = 0;
+  peak_bytes_ = 0;
+}
+
+const char* PipelineStats::phase_name(Phase phase) {
+  switch (phase) {
+    case Phase::total:          return "total";
+    case Phase::pyramid:        return "pyramid";
+    case Phase::classification: return "classification";
+    case Phase::interpolation:  return "interpolation";
+    case Phase::emission:       return "emission";
+    case Phase::welding:        return "welding";
+    case Phase::output:         return "output";
+  }
+  return "";
+}
+
+std::ostream& PipelineStats::write_json(std::ostream& os) const {
+  os << "{\"seconds\": {";
+  for (size_t p = 0; p < N_PHASES; ++p) {
+    os << (p ? ", " : "") << "\"" << phase_name(Phase(p)) << "\": " << seconds(Phase(p));
+  }
+  os << "}, \"cubes_visited\": " << cubes_visited_ << ", \"cubes_skipped\": " << cubes_skipped_
+     << ", \"vertexes_before_welding\": " << vertexes_before_welding_
+     << ", \"vertexes_after_welding\": " << vertexes_after_welding_
+     << ", \"faces\": " << faces_ << ", \"peak_bytes\": " << peak_bytes_ << ", \"cases\": [";
+  for (size_t c = 0; c < case_counts_.size(); ++c) {
+    os << (c ? ", " : "") << case_counts_[c];
+  }
+  os << "]}";
+  return os;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Timings and counters for one or more polygonize_isosurface calls (see the overloads taking a
+// PipelineStats in marching_cubes.h).  The polygonizers are templated on the stats policy, and
+// the overloads without one use NoStats, whose members are empty and compile away.
+//
+// Phases inside the slab tasks (classification, interpolation, emission) are summed over the
+// threads that ran them, so with several threads they can add up to more than the wall time.
+// The others are wall time.  Output is not timed by the polygonizers; wrap the writer in a Timer
+// to record it.
+class PipelineStats {
+  public:
+    static constexpr bool enabled = true;
+
+    using clock_type = std::chrono::steady_clock;
+
+    enum class Phase {
+      // Whole polygonize call
+      total,
+      // Building the min/max pyramid used to skip bricks
+      pyramid,
+      // Finding the case of each cube
+      classification,
+      // Placing the vertexes on crossed edges (and their normals)
+      interpolation,
+      // Writing the faces of each cube
+      emission,
+      // Merging the slabs' shared vertexes into the final mesh
+      welding,
+      // Writing the mesh out, when timed by the caller
+      output
+    };
+    static constexpr size_t N_PHASES = 7;
+
+    // Adds the time between its construction and destruction to a phase
+    class Timer {
+      private:
+        PipelineStats& stats_;
+        Phase phase_;
+        clock_type::time_point start_;
+
+      public:
+        Timer(PipelineStats& stats, Phase phase) : stats_(stats), phase_(phase), start_(clock_type::now()) {}
+        ~Timer() { stats_.add_time(phase_, clock_type::now() - start_); }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+    };
+
+  private:
+    std::array<clock_type::duration, N_PHASES> times_;
+    size_t cubes_visited_;
+    size_t cubes_skipped_;
+    std::array<size_t,256> case_counts_;
+    size_t vertexes_before_welding_;
+    size_t vertexes_after_welding_;
+    size_t faces_;
+    size_t peak_bytes_;
+
+  public:
+    PipelineStats();
+
+    void add_time(Phase phase, clock_type::duration time) { times_[size_t(phase)] += time; }
+    // Cubes whose case was looked up one by one, and cubes passed over in rows with no crossing
+    // (often ruled out by the pyramid) or in runs of eight all inside or all outside
+    void count_cubes(size_t visited, size_t skipped) { cubes_visited_ += visited; cubes_skipped_ += skipped; }
+    void count_case(uint8_t cube_type, size_t n = 1) { case_counts_[cube_type] += n; }
+    void count_welding(size_t vertexes_before, size_t vertexes_after, size_t faces);
+    // Bytes held at once by the pipeline's own buffers (slab buffers and the output mesh, not the
+    // volume or its pyramid).  Only the largest value is kept.
+    void note_bytes(size_t bytes) { if (bytes > peak_bytes_) peak_bytes_ = bytes; }
+    // Adds the counters and times of other, keeping the larger peak
+    void merge(const PipelineStats& other);
+    void reset();
+
+    double seconds(Phase phase) const { return std::chrono::duration<double>(times_[size_t(phase)]).count(); }
+    size_t cubes_visited() const { return cubes_visited_; }
+    size_t cubes_skipped() const { return cubes_skipped_; }
+    const std::array<size_t,256>& case_counts() const { return case_counts_; }
+    size_t vertexes_before_welding() const { return vertexes_before_welding_; }
+    size_t vertexes_after_welding() const { return vertexes_after_welding_; }
+    size_t faces() const { return faces_; }
+    size_t peak_bytes() const { return peak_bytes_; }
+
+    // One JSON object, with seconds per phase and the case histogram as an array of 256 counts.
+    // The histogram covers every cube of the rows that were classified.
+    std::ostream& write_json(std::ostream& os) const;
+
+    static const char* phase_name(Phase phase);
+};
+
+// Stats policy that records nothing
+struct NoStats {
+  static constexpr bool enabled = false;
+
+  struct Timer {
+    Timer(NoStats&, PipelineStats::Phase) {}
+  };
+
+  void add_time(PipelineStats::Phase, PipelineStats::clock_type::duration) {}
+  void count_cubes(size_t, size_t) {}
+  void count_case(uint8_t, size_t = 1) {}
+  void count_welding(size_t, size_t, size_t) {}
+  void note_bytes(size_t) {}
+  void merge(const NoStats&) {}
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "size.h"
+#include "min_max_pyramid.h"
+#include "thread_pool.h"
+
+// How each point of a coarser level is reduced from the 3x3x3 points around it in the level
+// below
+enum class Downsampling {
+  // Weights 1, 2, 1 along each axis.  Smooth, so the coarse surface stays close to the fine one.
+  average,
+  // Keeps thin features below the iso value (the inside) from vanishing
+  minimum,
+  // Keeps thin features at or above the iso value (the outside) from vanishing
+  maximum
+};
+
+// Downsampled copies of a 3D grid of values, each level with half the points of the one below
+// along every axis, for quick previews of an iso surface.  Point (i,j,k) of level l stands for
+// point (2^l i, 2^l j, 2^l k) of the full grid, so coarse vertexes scale back to full resolution
+// coordinates by 2^l.  Each level has its own min/max pyramid for skipping bricks.
+template <typename T>
+class ResolutionPyramid {
+  public:
+    // Levels 1 to N_LEVELS are 2x, 4x and 8x coarser than the full grid (level 0)
+    static constexpr size_t N_LEVELS = 3;
+
+    using size_type = Size<size_t,3>;
+
+  private:
+    struct Level {
+      size_type size;
+      std::vector<T> values;
+      std::unique_ptr<const MinMaxPyramid<T>> min_max;
+    };
+
+    Downsampling downsampling_;
+    std::array<Level,N_LEVELS> levels_;
+
+  public:
+    // data holds size.prod() values in x-fastest order.  Each level is reduced from the one
+    // below, with the planes of a level in parallel on the pool.
+    explicit ResolutionPyramid(const T* data, const size_type& size, Downsampling downsampling, ThreadPool* pool = nullptr)
+      : downsampling_(downsampling)
+    {
+      ThreadPool serial(1);
+      ThreadPool& threads = pool ? *pool : serial;
+
+      const T* fine = data;
+      size_type fine_size = size;
+      for (auto& level : levels_) {
+        level.size = size_type(half(fine_size(0)), half(fine_size(1)), half(fine_size(2)));
+        level.values.resize(level.size.prod());
+        threads.parallel_for(level.size(2), [&](size_t k) {
+          reduce_plane(fine, fine_size, k, level);
+        });
+        level.min_max.reset(new MinMaxPyramid<T>(level.values.data(), level.size, &threads));
+
+        fine = level.values.data();
+        fine_size = level.size;
+      }
+    }
+
+    Downsampling downsampling() const { return downsampling_; }
+
+    // level is from 1 to N_LEVELS
+    const size_type& size(size_t level) const { return at(level).size; }
+    const T* data(size_t level) const { return at(level).values.data(); }
+    const MinMaxPyramid<T>& min_max_pyramid(size_t level) const { return *at(level).min_max; }
+
+  private:
+    static size_t half(size_t n) { return n == 0 ? 0 : (n - 1) / 2 + 1; }
+
+    const Level& at(size_t level) const {
+      if (level < 1 || level > N_LEVELS) {
+        throw std::out_of_range("Resolution pyramid levels run from 1 to 3");
+      }
+      return levels_[level - 1];
+    }
+
+    // Plane k of level from the values of the level below.  Neighbours past the edge of the grid
+    // are clamped to it.
+    void reduce_plane(const T* fine, const size_type& fine_size, size_t k, Level& level) const {
+      const auto clamped = [](size_t center, int offset, size_t n) {
+        const ptrdiff_t index = ptrdiff_t(2*center) + offset;
+        return size_t(std::min(std::max(index, ptrdiff_t(0)), ptrdiff_t(n) - 1));
+      };
+
+      for (size_t j = 0; j < level.size(1); ++j) {
+        for (size_t i = 0; i < level.size(0); ++i) {
+          double sum = 0;
+          T extreme = fine[2*i + fine_size(0)*(2*j + fine_size(1)*2*k)];
+
+          for (int dz = -1; dz <= 1; ++dz) {
+            const size_t z = clamped(k, dz, fine_size(2));
+            for (int dy = -1; dy <= 1; ++dy) {
+              const size_t y = clamped(j, dy, fine_size(1));
+              const T* row = fine + fine_size(0)*(y + fine_size(1)*z);
+              const double weight_yz = (2 - std::abs(dy)) * (2 - std::abs(dz));
+              for (int dx = -1; dx <= 1; ++dx) {
+                const T& value = row[clamped(i, dx, fine_size(0))];
+                switch (downsampling_) {
+                  case Downsampling::average: sum += weight_yz * (2 - std::abs(dx)) * double(value); break;
+                  case Downsampling::minimum: if (value < extreme) extreme = value;                  break;
+                  case Downsampling::maximum: if (extreme < value) extreme = value;                  break;
+                }
+              }
+            }
+          }
+
+          level.values[i + level.size(0)*(j + level.size(1)*k)] = downsampling_ == Downsampling::average ? from_average(sum / 64) : extreme;
+        }
+      }
+    }
+
+    static T from_average(double value) {
+      return std::is_integral<T>::value ? T(std::round(value)) : T(value);
+    }
+};
+
+template <typename T> constexpr size_t ResolutionPyramid<T>::N_LEVELS;
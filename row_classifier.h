@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Computes the marching cubes case (the cube_type bitmask of corners below the iso value) for a
+// whole row of cubes at once.  A row of cubes spans two adjacent x-rows of vertexes in each of
+// two adjacent z-planes:
+//
+//   row00 = (y=j,   z=k)    row10 = (y=j+1, z=k)
+//   row01 = (y=j,   z=k+1)  row11 = (y=j+1, z=k+1)
+//
+// Comparisons are vectorized with AVX2 or SSE2 when the compiler targets them (uint8_t, uint16_t
+// and float rows), with a scalar fallback for the tail and for every other element type.
+class RowClassifier {
+  public:
+    // Writes n-1 cube types for rows of n vertexes.  flags must have room for 4*n bytes.
+    template <typename T>
+    static void classify(const T* row00, const T* row10, const T* row01, const T* row11, size_t n, T iso_value, uint8_t* cube_types, uint8_t* flags) {
+      below(row00, n, iso_value, flags);
+      below(row10, n, iso_value, flags + n);
+      below(row01, n, iso_value, flags + 2*n);
+      below(row11, n, iso_value, flags + 3*n);
+      combine(flags, flags + n, flags + 2*n, flags + 3*n, n, cube_types);
+    }
+
+    // flags[i] = 0xff if row[i] < iso_value, otherwise 0
+    template <typename T>
+    static void below(const T* row, size_t n, T iso_value, uint8_t* flags) {
+      for (size_t i = 0; i < n; ++i) flags[i] = row[i] < iso_value ? 0xff : 0;
+    }
+
+    static void below(const uint8_t* row, size_t n, uint8_t iso_value, uint8_t* flags) {
+      size_t i = 0;
+#if defined(__AVX2__)
+      // No unsigned compare, so shift both sides into signed range
+      const __m256i bias = _mm256_set1_epi8(char(0x80));
+      const __m256i iso = _mm256_xor_si256(_mm256_set1_epi8(char(iso_value)), bias);
+      for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i)), bias);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(flags + i), _mm256_cmpgt_epi8(iso, v));
+      }
+#endif
+#if defined(__SSE2__)
+      {
+        const __m128i bias = _mm_set1_epi8(char(0x80));
+        const __m128i iso = _mm_xor_si128(_mm_set1_epi8(char(iso_value)), bias);
+        for (; i + 16 <= n; i += 16) {
+          const __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)), bias);
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(flags + i), _mm_cmplt_epi8(v, iso));
+        }
+      }
+#endif
+      for (; i < n; ++i) flags[i] = row[i] < iso_value ? 0xff : 0;
+    }
+
+    static void below(const uint16_t* row, size_t n, uint16_t iso_value, uint8_t* flags) {
+      size_t i = 0;
+#if defined(__AVX2__)
+      {
+        const __m256i bias = _mm256_set1_epi16(short(0x8000));
+        const __m256i iso = _mm256_xor_si256(_mm256_set1_epi16(short(iso_value)), bias);
+        for (; i + 32 <= n; i += 32) {
+          const __m256i v0 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i)), bias);
+          const __m256i v1 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i + 16)), bias);
+          // Packing works per 128-bit lane, so put the 64-bit quarters back in order afterwards
+          const __m256i packed = _mm256_packs_epi16(_mm256_cmpgt_epi16(iso, v0), _mm256_cmpgt_epi16(iso, v1));
+          _mm256_storeu_si256(reinterpret_cast<__m256i*>(flags + i), _mm256_permute4x64_epi64(packed, 0xd8));
+        }
+      }
+#endif
+#if defined(__SSE2__)
+      {
+        const __m128i bias = _mm_set1_epi16(short(0x8000));
+        const __m128i iso = _mm_xor_si128(_mm_set1_epi16(short(iso_value)), bias);
+        for (; i + 16 <= n; i += 16) {
+          const __m128i v0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)), bias);
+          const __m128i v1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i + 8)), bias);
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(flags + i), _mm_packs_epi16(_mm_cmplt_epi16(v0, iso), _mm_cmplt_epi16(v1, iso)));
+        }
+      }
+#endif
+      for (; i < n; ++i) flags[i] = row[i] < iso_value ? 0xff : 0;
+    }
+
+    static void below(const float* row, size_t n, float iso_value, uint8_t* flags) {
+      size_t i = 0;
+#if defined(__AVX2__)
+      {
+        const __m256 iso = _mm256_set1_ps(iso_value);
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        for (; i + 32 <= n; i += 32) {
+          const __m256i m0 = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(row + i),      iso, _CMP_LT_OQ));
+          const __m256i m1 = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(row + i + 8),  iso, _CMP_LT_OQ));
+          const __m256i m2 = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(row + i + 16), iso, _CMP_LT_OQ));
+          const __m256i m3 = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(row + i + 24), iso, _CMP_LT_OQ));
+          const __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(m0, m1), _mm256_packs_epi32(m2, m3));
+          _mm256_storeu_si256(reinterpret_cast<__m256i*>(flags + i), _mm256_permutevar8x32_epi32(packed, order));
+        }
+      }
+#endif
+#if defined(__SSE2__)
+      {
+        const __m128 iso = _mm_set1_ps(iso_value);
+        for (; i + 16 <= n; i += 16) {
+          const __m128i m0 = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(row + i),      iso));
+          const __m128i m1 = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(row + i + 4),  iso));
+          const __m128i m2 = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(row + i + 8),  iso));
+          const __m128i m3 = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(row + i + 12), iso));
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(flags + i), _mm_packs_epi16(_mm_packs_epi32(m0, m1), _mm_packs_epi32(m2, m3)));
+        }
+      }
+#endif
+      for (; i < n; ++i) flags[i] = row[i] < iso_value ? 0xff : 0;
+    }
+
+    // Builds the cube types of a row from the below flags of its four vertex rows.  Bit numbers
+    // follow the corner numbering of MarchingCubes::CUBE_INDEX_SHIFTS.
+    static void combine(const uint8_t* flags00, const uint8_t* flags10, const uint8_t* flags01, const uint8_t* flags11, size_t n, uint8_t* cube_types) {
+      size_t i = 0;
+#if defined(__SSE2__)
+      {
+        const auto bit = [](int b) { return _mm_set1_epi8(char(1 << b)); };
+        const auto load = [](const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); };
+
+        // Each step reads flags at i+1 .. i+16, which must be inside the row
+        for (; i + 16 < n; i += 16) {
+          __m128i types = _mm_and_si128(load(flags00 + i), bit(0));
+          types = _mm_or_si128(types, _mm_and_si128(load(flags00 + i + 1), bit(1)));
+          types = _mm_or_si128(types, _mm_and_si128(load(flags10 + i + 1), bit(2)));
+          types = _mm_or_si128(types, _mm_and_si128(load(flags10 + i),     bit(3)));
+          types = _mm_or_si128(types, _mm_and_si128(load(flags01 + i),     bit(4)));
+          types = _mm_or_si128(types, _mm_and_si128(load(flags01 + i + 1), bit(5)));
+          types = _mm_or_si128(types, _mm_and_si128(load(flags11 + i + 1), bit(6)));
+          types = _mm_or_si128(types, _mm_and_si128(load(flags11 + i),     bit(7)));
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(cube_types + i), types);
+        }
+      }
+#endif
+      for (; i + 1 < n; ++i) {
+        cube_types[i] =
+          (flags00[i]   & 0x01) | (flags00[i+1] & 0x02) | (flags10[i+1] & 0x04) | (flags10[i]   & 0x08) |
+          (flags01[i]   & 0x10) | (flags01[i+1] & 0x20) | (flags11[i+1] & 0x40) | (flags11[i]   & 0x80);
+      }
+    }
+
+    // ranks[i] = how many of the ascending iso values row[i] is at or above, for at most 255
+    // levels.  flags must have room for n bytes.
+    template <typename T>
+    static void rank(const T* row, size_t n, const T* iso_values, size_t n_levels, uint8_t* ranks, uint8_t* flags) {
+      std::memset(ranks, int(n_levels), n);
+      for (size_t level = 0; level < n_levels; ++level) {
+        below(row, n, iso_values[level], flags);
+
+        // Below flags are 0xff, so adding them takes one off
+        size_t i = 0;
+#if defined(__SSE2__)
+        for (; i + 16 <= n; i += 16) {
+          const __m128i sum = _mm_add_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ranks + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(flags + i)));
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(ranks + i), sum);
+        }
+#endif
+        for (; i < n; ++i) ranks[i] += flags[i];
+      }
+    }
+
+    // Lowest and highest of the 8 corner ranks of each of the n-1 cubes of a row, with the rank
+    // rows laid out as the rows passed to classify()
+    static void rank_range(const uint8_t* ranks00, const uint8_t* ranks10, const uint8_t* ranks01, const uint8_t* ranks11, size_t n, uint8_t* lowest, uint8_t* highest) {
+      size_t i = 0;
+#if defined(__SSE2__)
+      {
+        const auto load = [](const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); };
+
+        // Each step reads ranks at i+1 .. i+16, which must be inside the row
+        for (; i + 16 < n; i += 16) {
+          const __m128i c0 = load(ranks00 + i), c1 = load(ranks00 + i + 1), c2 = load(ranks10 + i + 1), c3 = load(ranks10 + i);
+          const __m128i c4 = load(ranks01 + i), c5 = load(ranks01 + i + 1), c6 = load(ranks11 + i + 1), c7 = load(ranks11 + i);
+          const __m128i lo = _mm_min_epu8(_mm_min_epu8(_mm_min_epu8(c0, c1), _mm_min_epu8(c2, c3)), _mm_min_epu8(_mm_min_epu8(c4, c5), _mm_min_epu8(c6, c7)));
+          const __m128i hi = _mm_max_epu8(_mm_max_epu8(_mm_max_epu8(c0, c1), _mm_max_epu8(c2, c3)), _mm_max_epu8(_mm_max_epu8(c4, c5), _mm_max_epu8(c6, c7)));
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(lowest + i), lo);
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(highest + i), hi);
+        }
+      }
+#endif
+      for (; i + 1 < n; ++i) {
+        const std::array<uint8_t,8> corners = {{ranks00[i], ranks00[i+1], ranks10[i+1], ranks10[i], ranks01[i], ranks01[i+1], ranks11[i+1], ranks11[i]}};
+        lowest[i] = *std::min_element(corners.begin(), corners.end());
+        highest[i] = *std::max_element(corners.begin(), corners.end());
+      }
+    }
+};
@@ -30,13 +30,13 @@ class Size {
       public:
         static const_iterator begin(const Size& size) {
           index_type index;
-          for (size_t i = 0; i < N; ++i) index(0) = 0;
+          for (size_t i = 0; i < N; ++i) index(i) = 0;
           return const_iterator(size, index);
         }
 
         static const_iterator end(const Size& size) {
           index_type index;
-          for (size_t i = 0; i < N-1; ++i) index(0) = 0;
+          for (size_t i = 0; i < N-1; ++i) index(i) = 0;
           index(N-1) = size(N-1);
           return const_iterator(size, index);
         }
@@ -87,13 +87,13 @@ class Size {
       public:
         static iterator begin(const Size& size) {
           index_type index;
-          for (size_t i = 0; i < N; ++i) index(0) = 0;
+          for (size_t i = 0; i < N; ++i) index(i) = 0;
           return iterator(size, index);
         }
 
         static iterator end(const Size& size) {
           index_type index;
-          for (size_t i = 0; i < N-1; ++i) index(0) = 0;
+          for (size_t i = 0; i < N-1; ++i) index(i) = 0;
           index(N-1) = size(N-1);
           return iterator(size, index);
         }
@@ -155,23 +155,32 @@ class Size {
       return sizes_.prod();
     }
 
+    // Horner's rule, from the slowest index down
     T absolute_index_for(const index_type& index) const {
-      T i = index(0);
-
-      for (T j = 1; j < N; ++j) {
-        T factor = 1;
-        for (T k = 0; k < j; ++k) {
-          factor *= sizes_(k);
-        }
-        i += factor * index(j);
+      T i = index(N-1);
+      for (size_t d = N-1; d-- > 0;) {
+        i = i * sizes_(d) + index(d);
       }
-
       return i;
     }
+
+    // Distance in absolute index between neighbours along each dimension (x-fastest order)
+    index_type strides() const {
+      index_type strides;
+      T stride = 1;
+      for (size_t d = 0; d < N; ++d) {
+        strides(d) = stride;
+        stride *= sizes_(d);
+      }
+      return strides;
+    }
 };
 
 template <typename T, size_t N>
 std::ostream& operator<<(std::ostream& os, const Size<T,N>& s) {
-  os << s.size_;
+  for (size_t i = 0; i < N; ++i) {
+    os << s(i);
+    if (i < N-1) os << ",";
+  }
   return os;
 }
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "size.h"
+#include "point.h"
+#include "tensor.h"
+#include "thread_pool.h"
+
+// 3D grid of values stored as dense bricks of BRICK_SIZE^3 points, kept in a hash map by brick
+// and allocated only where some point differs from the background value.  Points in missing
+// bricks read as the background, so a volume that is mostly background (such as a segmentation)
+// takes a fraction of the memory of a Tensor.  Brick (bx,by,bz) holds the points in
+// [BRICK_SIZE*bx, BRICK_SIZE*(bx+1)) and so on, x fastest.
+//
+// See the MarchingCubes overloads taking a SparseVolume, which only classify cubes next to
+// allocated bricks.
+template <typename T>
+class SparseVolume {
+  public:
+    static constexpr size_t BRICK_SIZE = 8;
+    static constexpr size_t BRICK_VOLUME = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+    using value_type = T;
+    using size_type  = Size<size_t,3>;
+    using index_type = Point<size_t,3>;
+
+  private:
+    size_type size_;
+    size_type bricks_;
+    T background_;
+
+    // Brick number (bx + bricks(0)*(by + bricks(1)*bz)) to its offset in values_
+    std::unordered_map<size_t,size_t> offsets_;
+    std::vector<T> values_;
+    // Whether each row of bricks (by, bz) has any brick allocated
+    std::vector<bool> rows_allocated_;
+
+  public:
+    // Every point starts as background
+    SparseVolume(const size_type& size, const T& background)
+      : size_(size), bricks_(bricks_for(size(0)), bricks_for(size(1)), bricks_for(size(2))), background_(background),
+        rows_allocated_(bricks_(1) * bricks_(2), false)
+    {}
+
+    // Allocates the bricks of tensor with any value other than background.  Planes of bricks are
+    // scanned in parallel on the pool.
+    SparseVolume(const Tensor<T,3>& tensor, const T& background, ThreadPool* pool = nullptr)
+      : SparseVolume(tensor.size(), background)
+    {
+      ThreadPool serial(1);
+      ThreadPool& threads = pool ? *pool : serial;
+
+      // Brick numbers and values of each plane of bricks, in order
+      std::vector<std::pair<std::vector<size_t>,std::vector<T>>> planes(bricks_(2));
+      threads.parallel_for(bricks_(2), [&](size_t bz) {
+        std::vector<T> brick(BRICK_VOLUME);
+        for (size_t by = 0; by < bricks_(1); ++by) {
+          for (size_t bx = 0; bx < bricks_(0); ++bx) {
+            if (!gather_brick(tensor, bx, by, bz, brick)) continue;
+            planes[bz].first.push_back(brick_number(bx, by, bz));
+            planes[bz].second.insert(planes[bz].second.end(), brick.begin(), brick.end());
+          }
+        }
+      });
+
+      size_t n_bricks = 0;
+      for (const auto& plane : planes) n_bricks += plane.first.size();
+      offsets_.reserve(n_bricks);
+      values_.reserve(n_bricks * BRICK_VOLUME);
+
+      for (auto& plane : planes) {
+        for (size_t b = 0; b < plane.first.size(); ++b) {
+          offsets_.emplace(plane.first[b], values_.size());
+          rows_allocated_[plane.first[b] / bricks_(0)] = true;
+          values_.insert(values_.end(), plane.second.begin() + b*BRICK_VOLUME, plane.second.begin() + (b+1)*BRICK_VOLUME);
+        }
+        std::vector<size_t>().swap(plane.first);
+        std::vector<T>().swap(plane.second);
+      }
+    }
+
+    const size_type& size() const { return size_; }
+    const size_type& bricks() const { return bricks_; }
+    const T& background() const { return background_; }
+
+    size_t n_bricks() const { return offsets_.size(); }
+
+    // Bytes held by the bricks and the map
+    size_t bytes() const {
+      return sizeof(T) * values_.capacity() + rows_allocated_.capacity() / 8
+           + (sizeof(std::pair<const size_t,size_t>) + 2*sizeof(void*)) * offsets_.size() + sizeof(void*) * offsets_.bucket_count();
+    }
+
+    const T& operator()(size_t i, size_t j, size_t k) const {
+      const T* values = brick(i / BRICK_SIZE, j / BRICK_SIZE, k / BRICK_SIZE);
+      return values ? values[offset_in_brick(i, j, k)] : background_;
+    }
+
+    const T& operator()(const index_type& index) const { return (*this)(index(0), index(1), index(2)); }
+
+    // Values of a brick, or null if it is not allocated
+    const T* brick(size_t bx, size_t by, size_t bz) const {
+      if (!rows_allocated_[by + bricks_(1)*bz]) return nullptr;
+      const auto found = offsets_.find(brick_number(bx, by, bz));
+      return found == offsets_.end() ? nullptr : values_.data() + found->second;
+    }
+
+    bool row_allocated(size_t by, size_t bz) const { return rows_allocated_[by + bricks_(1)*bz]; }
+
+    // Allocates the brick of the point, filled with background, if it is missing.  Throws
+    // std::out_of_range if the point is outside the volume.
+    void set(const index_type& index, const T& value) {
+      if (index(0) >= size_(0) || index(1) >= size_(1) || index(2) >= size_(2)) {
+        throw std::out_of_range("Point is outside the sparse volume");
+      }
+      allocate(index(0) / BRICK_SIZE, index(1) / BRICK_SIZE, index(2) / BRICK_SIZE)[offset_in_brick(index(0), index(1), index(2))] = value;
+    }
+
+    // Sets every point of a voxel list to value, such as the voxels of one label
+    void set(const std::vector<index_type>& indexes, const T& value) {
+      for (const auto& index : indexes) set(index, value);
+    }
+
+    // Sets each point of a voxel list to its own value.  Throws std::invalid_argument if the
+    // lists differ in length.
+    void set(const std::vector<index_type>& indexes, const std::vector<T>& values) {
+      if (indexes.size() != values.size()) {
+        throw std::invalid_argument("Voxel list needs one value per point");
+      }
+      for (size_t v = 0; v < indexes.size(); ++v) set(indexes[v], values[v]);
+    }
+
+    // Dense copy, with background in the missing bricks
+    Tensor<T,3> to_tensor() const {
+      Tensor<T,3> tensor(size_, background_);
+      T* data = tensor.data();
+      for (const auto& entry : offsets_) {
+        const size_t bx = entry.first % bricks_(0);
+        const size_t by = (entry.first / bricks_(0)) % bricks_(1);
+        const size_t bz = entry.first / (bricks_(0) * bricks_(1));
+        for (size_t k = BRICK_SIZE*bz; k < std::min(BRICK_SIZE*(bz+1), size_(2)); ++k) {
+          for (size_t j = BRICK_SIZE*by; j < std::min(BRICK_SIZE*(by+1), size_(1)); ++j) {
+            for (size_t i = BRICK_SIZE*bx; i < std::min(BRICK_SIZE*(bx+1), size_(0)); ++i) {
+              data[i + size_(0)*(j + size_(1)*k)] = values_[entry.second + offset_in_brick(i, j, k)];
+            }
+          }
+        }
+      }
+      return tensor;
+    }
+
+  private:
+    static size_t bricks_for(size_t n) { return (n + BRICK_SIZE - 1) / BRICK_SIZE; }
+
+    static size_t offset_in_brick(size_t i, size_t j, size_t k) {
+      return i % BRICK_SIZE + BRICK_SIZE*(j % BRICK_SIZE + BRICK_SIZE*(k % BRICK_SIZE));
+    }
+
+    size_t brick_number(size_t bx, size_t by, size_t bz) const { return bx + bricks_(0)*(by + bricks_(1)*bz); }
+
+    T* allocate(size_t bx, size_t by, size_t bz) {
+      const auto inserted = offsets_.emplace(brick_number(bx, by, bz), values_.size());
+      if (inserted.second) {
+        values_.resize(values_.size() + BRICK_VOLUME, background_);
+        rows_allocated_[by + bricks_(1)*bz] = true;
+      }
+      return values_.data() + inserted.first->second;
+    }
+
+    // Copies a brick of the tensor into brick, with background past the edges, and returns
+    // whether any value differs from the background
+    bool gather_brick(const Tensor<T,3>& tensor, size_t bx, size_t by, size_t bz, std::vector<T>& brick) const {
+      const T* data = tensor.data();
+      std::fill(brick.begin(), brick.end(), background_);
+
+      bool any = false;
+      for (size_t k = BRICK_SIZE*bz; k < std::min(BRICK_SIZE*(bz+1), size_(2)); ++k) {
+        for (size_t j = BRICK_SIZE*by; j < std::min(BRICK_SIZE*(by+1), size_(1)); ++j) {
+          const T* row = data + size_(0)*(j + size_(1)*k);
+          for (size_t i = BRICK_SIZE*bx; i < std::min(BRICK_SIZE*(bx+1), size_(0)); ++i) {
+            if (row[i] != background_) any = true;
+            brick[offset_in_brick(i, j, k)] = row[i];
+          }
+        }
+      }
+      return any;
+    }
+};
+
+template <typename T> constexpr size_t SparseVolume<T>::BRICK_SIZE;
+template <typename T> constexpr size_t SparseVolume<T>::BRICK_VOLUME;
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <istream>
+#include <vector>
+
+#include "marching_cubes.h"
+
+// Polygonizes an iso surface from z-slices pushed in one at a time, for volumes too large to hold
+// in memory.  Only the last two slices and the edge cache of one layer of cubes are kept, so
+// memory scales with the slice area plus the size of the output mesh.
+//
+// Vertexes are in first-use order over the whole volume, so their order can differ from
+// MarchingCubes::polygonize_isosurface on the same data, but the surface is the same.
+template <typename T>
+class StreamingMarchingCubes {
+  public:
+    using vertex_type = MarchingCubes::vertex_type;
+    using size_type   = MarchingCubes::size_type;
+
+  private:
+    const size_t nx_, ny_;
+    const T iso_value_;
+
+    std::vector<T> lower_slice_, upper_slice_;
+    size_t n_slices_;
+
+    EdgeCache edge_cache_;
+    std::vector<uint8_t> cube_types_;
+    MarchingCubes::Slab output_;
+
+  public:
+    StreamingMarchingCubes(size_t nx, size_t ny, const T iso_value)
+      : nx_(nx), ny_(ny), iso_value_(iso_value),
+        lower_slice_(nx*ny), upper_slice_(nx*ny), n_slices_(0),
+        edge_cache_(nx, ny),
+        cube_types_(nx > 0 ? nx - 1 : 0)
+    {}
+
+    // Adds the next z-slice of nx*ny values (x fastest), polygonizing the layer of cubes between
+    // it and the previous slice
+    void push_slice(const T* slice) {
+      std::copy(slice, slice + nx_*ny_, upper_slice_.begin());
+      polygonize_upper_slice();
+    }
+
+    // Reads the next slice of raw values from the stream.  Returns false, and adds nothing, if
+    // the stream runs out before a whole slice is read.
+    bool read_slice(std::istream& is) {
+      is.read(reinterpret_cast<char*>(upper_slice_.data()), sizeof(T) * nx_*ny_);
+      if (!is) return false;
+      polygonize_upper_slice();
+      return true;
+    }
+
+    size_t slices() const { return n_slices_; }
+
+    // Mesh so far, growing as slices are pushed
+    const std::vector<vertex_type>& vertexes() const { return output_.vertexes; }
+    const std::vector<Mesh::face_type>& faces() const { return output_.faces; }
+
+    // Hands over the mesh so far and starts again with no slices
+    Mesh take_mesh() {
+      Mesh mesh(std::move(output_.vertexes), std::move(output_.faces));
+      output_ = MarchingCubes::Slab();
+      edge_cache_.clear();
+      n_slices_ = 0;
+      return mesh;
+    }
+
+    // Polygonizes raw slices read from the stream until it runs out
+    static Mesh polygonize(std::istream& is, size_t nx, size_t ny, const T iso_value) {
+      StreamingMarchingCubes<T> streaming(nx, ny, iso_value);
+      while (streaming.read_slice(is)) {}
+      return streaming.take_mesh();
+    }
+
+    // Polygonizes slices from next_slice, which fills its nx*ny buffer and returns true, or
+    // returns false when there are no more slices
+    static Mesh polygonize(size_t nx, size_t ny, const T iso_value, const std::function<bool(T*)>& next_slice) {
+      StreamingMarchingCubes<T> streaming(nx, ny, iso_value);
+      std::vector<T> slice(nx*ny);
+      while (next_slice(slice.data())) streaming.push_slice(slice.data());
+      return streaming.take_mesh();
+    }
+
+  private:
+    void polygonize_upper_slice() {
+      if (n_slices_ > 0 && nx_ > 1 && ny_ > 1) {
+        const size_t k = n_slices_ - 1;
+        const MarchingCubes::IsosurfaceLayer<T> layer(lower_slice_.data(), upper_slice_.data(), nx_, nx_, iso_value_, k);
+
+        NoStats stats;
+        if (k > 0) edge_cache_.advance();
+        MarchingCubes::polygonize_layer(layer, k, size_type(nx_ - 1, ny_ - 1, 1u), edge_cache_, cube_types_, output_, stats);
+      }
+
+      std::swap(lower_slice_, upper_slice_);
+      ++n_slices_;
+    }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+
+// A summary of some data (its min and max, a min/max pyramid, ...) built on first use by const
+// calls, which may come from several threads at once.  Threads that find it missing at the same
+// time each build one, and all of them get the one stored first.  reset() is for writers of the
+// data, and like them must not race with other calls.
+template <typename Summary>
+class SummaryCache {
+  private:
+    mutable std::shared_ptr<const Summary> summary_;
+
+  public:
+    SummaryCache() = default;
+
+    SummaryCache(const SummaryCache& other) : summary_(std::atomic_load(&other.summary_)) {}
+
+    SummaryCache& operator=(const SummaryCache& other) {
+      summary_ = std::atomic_load(&other.summary_);
+      return *this;
+    }
+
+    // build() returns a std::shared_ptr<const Summary>.  The summary stays valid until reset().
+    template <typename Build>
+    const Summary& get(const Build& build) const {
+      std::shared_ptr<const Summary> summary = std::atomic_load(&summary_);
+      if (!summary) {
+        std::shared_ptr<const Summary> built = build();
+        // On failure summary is set to the one another thread stored
+        if (std::atomic_compare_exchange_strong(&summary_, &summary, built)) summary = built;
+      }
+      return *summary;
+    }
+
+    void reset() { summary_.reset(); }
+};
@@ -1,16 +1,28 @@
 #pragma once
 
+#include <algorithm>
 #include <limits>
+#include <memory>
+#include <utility>
 #include <vector>
 #include <iostream>
 #include <functional>
+#include <type_traits>
 
 #include "size.h"
 #include "point.h"
-
-template <typename T, size_t N>
+#include "layout.h"
+#include "min_max_pyramid.h"
+#include "resolution_pyramid.h"
+#include "dirty_bricks.h"
+#include "summary_cache.h"
+
+// Values in x-fastest order.  Other storage orders for N == 3 (see layout.h) are given by the
+// Layout parameter, and implemented in layout_tensor.h.
+template <typename T, size_t N, typename Layout = LinearLayout>
 class Tensor {
   static_assert(N >= 1, "N must be at least 1 for Tensor");
+  static_assert(std::is_same<Layout, LinearLayout>::value, "Include layout_tensor.h for Tensor layouts other than LinearLayout");
 
   public:
     using size_type            = Size<size_t,N>;
@@ -20,18 +32,28 @@ class Tensor {
 
   private:
     const size_type size_;
+    // size_.strides(), kept so indexing is a dot product
+    const index_type strides_;
     std::vector<T> data_;
 
-    mutable bool min_max_calculated_;
-    mutable T min_, max_;
+    // Cached summaries of the data, dropped on any mutable access (a non-const operator(),
+    // data(), begin() or end()), even one that only reads
+    SummaryCache<std::pair<T,T>> min_max_;
+    SummaryCache<MinMaxPyramid<T>> min_max_pyramid_;
+    // One per Downsampling
+    std::array<SummaryCache<ResolutionPyramid<T>>,3> resolution_pyramids_;
+
+    // Disabled unless track_dirty_bricks() is called
+    DirtyBricks dirty_bricks_;
 
   public:
-    explicit Tensor(size_type size)                : size_(size), data_(size.prod()),       min_max_calculated_(false) {}
-    explicit Tensor(size_type size, const T& fill) : size_(size), data_(size.prod(), fill), min_max_calculated_(false) {}
+    explicit Tensor(size_type size)                : size_(size), strides_(size.strides()), data_(size.prod())       {}
+    explicit Tensor(size_type size, const T& fill) : size_(size), strides_(size.strides()), data_(size.prod(), fill) {}
 
     Tensor<T,N>& transform(const std::function<T(T)> f) {
-      for (const auto& index : size_) {
-        transformed(index) = f((*this)(index));
+      invalidate_caches();
+      for (auto& value : data_) {
+        value = f(value);
       }
       return *this;
     }
@@ -39,11 +61,8 @@ class Tensor {
     template <typename U>
     Tensor<U,N> transformed(const std::function<U(T)> f) const {
       Tensor<U,N> transformed(size_);
-
-      for (const auto& index : size_) {
-        transformed(index) = f((*this)(index));
-      }
-
+      // Through iterators, as std::vector<bool> has no data()
+      std::transform(data_.begin(), data_.end(), transformed.begin(), f);
       return transformed;
     }
 
@@ -52,99 +71,161 @@ class Tensor {
       return data_[i];
     }
     reference_type operator()(size_t i) {
+      invalidate_caches(i);
       return data_[i];
     }
 
     const_reference_type operator()(size_t i, size_t j) const {
       static_assert(N == 2, "Cannot call operator() with 2 argument unless N == 2");
-      return data_[i + size_(0)*j];
+      return data_[i + strides_(1)*j];
     }
     reference_type operator()(size_t i, size_t j) {
       static_assert(N == 2, "Cannot call operator() with 2 argument unless N == 2");
-      return data_[i + size_(0)*j];
+      const size_t index = i + strides_(1)*j;
+      invalidate_caches(index);
+      return data_[index];
     }
 
     const_reference_type operator()(size_t i, size_t j, size_t k) const {
       static_assert(N == 3, "Cannot call operator() with 3 argument unless N == 3");
-      return data_[i + size_(0)*j];
+      return data_[i + strides_(1)*j + strides_(2)*k];
     }
     reference_type operator()(size_t i, size_t j, size_t k) {
       static_assert(N == 3, "Cannot call operator() with 3 argument unless N == 3");
-      return data_[i + size_(0)*j + size_(0)*size_(1)*k];
+      const size_t index = i + strides_(1)*j + strides_(2)*k;
+      invalidate_caches(index);
+      return data_[index];
     }
 
     const_reference_type operator()(size_t i, size_t j, size_t k, size_t l) const {
       static_assert(N == 4, "Cannot call operator() with 4 argument unless N == 4");
-      return data_[i + size_(0)*j + size_(0)*size_(1)*k + size_(0)*size_(1)*size_(2)*l];
+      return data_[i + strides_(1)*j + strides_(2)*k + strides_(3)*l];
     }
     reference_type operator()(size_t i, size_t j, size_t k, size_t l) {
       static_assert(N == 4, "Cannot call operator() with 4 argument unless N == 4");
-      return data_[i + size_(0)*j + size_(0)*size_(1)*k + size_(0)*size_(1)*size_(2)*l];
+      const size_t index = i + strides_(1)*j + strides_(2)*k + strides_(3)*l;
+      invalidate_caches(index);
+      return data_[index];
     }
 
     const_reference_type operator()(const index_type& index) const {
-      return data_[size_.absolute_index_for(index)];
+      return data_[absolute_index_for(index)];
     }
 
     reference_type operator()(const index_type& index) {
-      return data_[size_.absolute_index_for(index)];
+      const size_t absolute_index = absolute_index_for(index);
+      invalidate_caches(absolute_index);
+      return data_[absolute_index];
     }
 
     template <typename ... Args>
     const_reference_type operator()(const Args& ... args) const {
       static_assert(sizeof...(args) == N, "Variable argument pack size in operator() must match N");
-      return data_[size_.absolute_index_for(index_type(args...))];
+      return data_[absolute_index_for(index_type(args...))];
     }
 
     template <typename ... Args>
     reference_type operator()(const Args& ... args) {
       static_assert(sizeof...(args) == N, "Variable argument pack size in operator() must match N");
-      return data_[size_.absolute_index_for(index_type(args...))];
+      const size_t absolute_index = absolute_index_for(index_type(args...));
+      invalidate_caches(absolute_index);
+      return data_[absolute_index];
     }
 
+    // Raw element data, without a .npy header (see MappedTensor for reading .npy files)
     std::ostream& write_to_numpy(std::ostream& os) const {
-      for (const auto& val : *this) {
-        os.write(reinterpret_cast<const char*>(&val), sizeof(val));
-      }
+      os.write(reinterpret_cast<const char*>(data_.data()), sizeof(T) * data_.size());
       return os;
     }
 
     std::istream& read_from_numpy(std::istream& is) {
-      for (auto& val : *this) {
-        is.read(reinterpret_cast<char*>(&val), sizeof(val));
-      }
+      invalidate_caches();
+      is.read(reinterpret_cast<char*>(data_.data()), sizeof(T) * data_.size());
       return is;
     }
 
-    T min() const {
-      calculate_min_max();
-      return min_;
+    // min(), max() and the pyramids are built on first use and kept until the next mutable
+    // access.  Const calls may come from several threads at once.
+    T min() const { return min_max().first; }
+    T max() const { return min_max().second; }
+
+    // Per-brick min/max summary
+    const MinMaxPyramid<T>& min_max_pyramid(ThreadPool* pool = nullptr) const {
+      static_assert(N == 3, "min_max_pyramid() is only available when N == 3");
+      return min_max_pyramid_.get([&]() { return std::make_shared<const MinMaxPyramid<T>>(data(), size_, pool); });
+    }
+
+    // Downsampled levels for coarse previews (see resolution_pyramid.h), one for each kind of
+    // downsampling
+    const ResolutionPyramid<T>& resolution_pyramid(Downsampling downsampling = Downsampling::average, ThreadPool* pool = nullptr) const {
+      static_assert(N == 3, "resolution_pyramid() is only available when N == 3");
+      return resolution_pyramids_[size_t(downsampling)].get([&]() {
+        return std::make_shared<const ResolutionPyramid<T>>(data(), size_, downsampling, pool);
+      });
     }
 
-    T max() const {
-      calculate_min_max();
-      return min_;
+    // Starts recording which bricks of cubes (see DirtyBricks) are written through mutable
+    // access, with every brick dirty to begin with.  Writes through data(), begin(), end() and
+    // read_from_numpy() mark every brick.
+    void track_dirty_bricks() {
+      static_assert(N == 3, "track_dirty_bricks() is only available when N == 3");
+      dirty_bricks_ = DirtyBricks(size_);
+    }
+
+    const DirtyBricks& dirty_bricks() const { return dirty_bricks_; }
+
+    // Absolute indexes of the bricks written since the last call, in ascending order
+    std::vector<size_t> take_dirty_bricks() {
+      return dirty_bricks_.take();
     }
 
     const size_type& size() const { return size_; }
+    const index_type& strides() const { return strides_; }
+
+    size_t absolute_index_for(const index_type& index) const {
+      size_t absolute_index = index(0);
+      for (size_t d = 1; d < N; ++d) absolute_index += strides_(d) * index(d);
+      return absolute_index;
+    }
 
-    auto begin()       { return data_.begin(); }
+    // Elements in x-fastest order
+    const T* data() const { return data_.data(); }
+    T*       data()       { invalidate_caches(); return data_.data(); }
+
+    auto begin()       { invalidate_caches(); return data_.begin(); }
     auto begin() const { return data_.begin(); }
-    auto end()         { return data_.end();   }
+    auto end()         { invalidate_caches(); return data_.end();   }
     auto end()   const { return data_.end();   }
 
   private:
-    void calculate_min_max() const {
-      if (min_max_calculated_) return;
-
-      min_ = std::numeric_limits<T>::max();
-      max_ = std::numeric_limits<T>::min();
-
-      for (const auto& val : *this) {
-        if (val < min_) min_ = val;
-        if (val > max_) max_ = val;
-      }
-
-      min_max_calculated_ = true;
+    void invalidate_caches() {
+      min_max_.reset();
+      min_max_pyramid_.reset();
+      for (auto& pyramid : resolution_pyramids_) pyramid.reset();
+      dirty_bricks_.mark_all();
+    }
+
+    // Only the value at the given absolute index changes
+    void invalidate_caches(size_t absolute_index) {
+      min_max_.reset();
+      min_max_pyramid_.reset();
+      for (auto& pyramid : resolution_pyramids_) pyramid.reset();
+      dirty_bricks_.mark(absolute_index);
+    }
+
+    // NaN values are folded in as MinMaxPyramid does: the maximum is NaN if any value is
+    const std::pair<T,T>& min_max() const {
+      return min_max_.get([&]() {
+        T min = std::numeric_limits<T>::max();
+        T max = std::numeric_limits<T>::lowest();
+
+        if (!data_.empty()) min = max = data_[0];
+        for (const auto& val : *this) {
+          MinMaxPyramid<T>::lower(val, min);
+          MinMaxPyramid<T>::raise(val, max);
+        }
+
+        return std::make_shared<const std::pair<T,T>>(min, max);
+      });
     }
 };
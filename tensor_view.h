@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+
+#include "size.h"
+#include "point.h"
+#include "tensor.h"
+#include "mapped_tensor.h"
+
+// Read-only, non-owning view of an N dimensional grid of values anywhere in memory, given the
+// address of its first element, its extents and the distance in elements between neighbours along
+// each axis.  Views can wrap external buffers in any memory order (including padded rows), or a
+// region of a Tensor, MappedTensor or another view, without copying.
+//
+// The origin is the position of the first element in the coordinates of the volume the view was
+// taken from, so meshes of a region line up with meshes of the whole volume.
+template <typename T, size_t N>
+class TensorView {
+  static_assert(N >= 1, "N must be at least 1 for TensorView");
+
+  public:
+    using size_type            = Size<size_t,N>;
+    using index_type           = Point<size_t,N>;
+    using stride_type          = std::array<ptrdiff_t,N>;
+    using const_reference_type = const T&;
+
+  private:
+    const T* data_;
+    size_type size_;
+    stride_type strides_;
+    index_type origin_;
+
+  public:
+    // Contiguous values, x fastest (the layout of Tensor)
+    TensorView(const T* data, const size_type& size)
+      : data_(data), size_(size), strides_(x_fastest_strides(size)), origin_()
+    {}
+
+    TensorView(const T* data, const size_type& size, const stride_type& strides, const index_type& origin = index_type())
+      : data_(data), size_(size), strides_(strides), origin_(origin)
+    {}
+
+    explicit TensorView(const Tensor<T,N>& tensor)       : TensorView(tensor.data(), tensor.size()) {}
+    explicit TensorView(const MappedTensor<T,N>& tensor) : TensorView(tensor.data(), tensor.size()) {}
+
+    // Contiguous values indexed (i, j, k, ...) with the last index fastest, i.e. a C ordered
+    // array of shape (size(0), size(1), ...)
+    static TensorView c_order(const T* data, const size_type& size) {
+      stride_type strides;
+      ptrdiff_t stride = 1;
+      for (size_t d = N; d-- > 0; ) {
+        strides[d] = stride;
+        stride *= ptrdiff_t(size(d));
+      }
+      return TensorView(data, size, strides);
+    }
+
+    // Contiguous values indexed (i, j, k, ...) with the first index fastest
+    static TensorView fortran_order(const T* data, const size_type& size) {
+      return TensorView(data, size);
+    }
+
+    // The box of the given size starting at offset within this view.  Throws std::out_of_range
+    // if it does not fit.
+    TensorView region(const index_type& offset, const size_type& size) const {
+      const T* data = data_;
+      for (size_t d = 0; d < N; ++d) {
+        if (offset(d) + size(d) > size_(d)) {
+          throw std::out_of_range("TensorView region does not fit in the view");
+        }
+        data += ptrdiff_t(offset(d)) * strides_[d];
+      }
+      return TensorView(data, size, strides_, origin_ + offset);
+    }
+
+    const_reference_type operator()(const index_type& index) const {
+      return data_[offset_of(index)];
+    }
+
+    template <typename ... Args>
+    const_reference_type operator()(const Args& ... args) const {
+      static_assert(sizeof...(args) == N, "Variable argument pack size in operator() must match N");
+      return data_[offset_of(index_type(args...))];
+    }
+
+    const size_type& size() const { return size_; }
+    const stride_type& strides() const { return strides_; }
+    const index_type& origin() const { return origin_; }
+
+    // Address of the element at index 0
+    const T* data() const { return data_; }
+
+  private:
+    static stride_type x_fastest_strides(const size_type& size) {
+      stride_type strides;
+      ptrdiff_t stride = 1;
+      for (size_t d = 0; d < N; ++d) {
+        strides[d] = stride;
+        stride *= ptrdiff_t(size(d));
+      }
+      return strides;
+    }
+
+    ptrdiff_t offset_of(const index_type& index) const {
+      ptrdiff_t offset = 0;
+      for (size_t d = 0; d < N; ++d) offset += ptrdiff_t(index(d)) * strides_[d];
+      return offset;
+    }
+};
@@ -0,0 +1,975 @@
+#include "../tensor.h"
+#include "../tensor_view.h"
+#include "../layout_tensor.h"
+#include "../mapped_tensor.h"
+#include "../sparse_volume.h"
+#include "../mesh.h"
+#include "../mesh_writer.h"
+#include "../mesh_sink.h"
+#include "../marching_cubes.h"
+#include "../marching_cubes_extractor.h"
+#include "../streaming_marching_cubes.h"
+#include "../incremental_marching_cubes.h"
+#include "../thread_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Checks that every polygonizer gives the surface of the plain per-cube algorithm the library
+// started from, and that the parallel ones give identical meshes for any number of threads.
+// Prints the failed checks and exits with 1 if there are any.
+//
+// cd tests && g++ -Wall -O2 --std=c++14 -pthread tests.cpp $(ls ../*.cpp | grep -v /main.cpp) -o tests && ./tests
+
+namespace {
+  using vertex_type = MarchingCubes::vertex_type;
+  using index_type  = MarchingCubes::index_type;
+  using size_type   = MarchingCubes::size_type;
+
+  using Triangle = std::array<vertex_type,3>;
+
+  size_t n_checks = 0;
+  size_t n_failures = 0;
+
+  void check(bool ok, const std::string& what) {
+    ++n_checks;
+    if (!ok) {
+      ++n_failures;
+      std::cout << "FAILED " << what << std::endl;
+    }
+  }
+
+  // Triangle soup of the original polygonize_isosurface, one cube at a time
+  template <typename T>
+  std::vector<Triangle> reference_isosurface(const Tensor<T,3>& tensor, const T iso_value) {
+    std::vector<Triangle> triangles;
+    if (tensor.size()(0) < 2 || tensor.size()(1) < 2 || tensor.size()(2) < 2) return triangles;
+
+    const auto cube_size = size_type(tensor.size()) - size_type(1u, 1u, 1u);
+    std::array<vertex_type,12> edge_vertexes;
+
+    for (const auto& cube_index : cube_size) {
+      size_t cube_type = 0;
+      for (size_t c = 0; c < MarchingCubes::CUBE_INDEX_SHIFTS.size(); ++c) {
+        if (tensor(cube_index + MarchingCubes::CUBE_INDEX_SHIFTS[c]) < iso_value) cube_type |= (1 << c);
+      }
+
+      for (size_t e = 0; e < edge_vertexes.size(); ++e) {
+        if (MarchingCubes::EDGE_TABLE[cube_type] & (1 << e)) {
+          const auto delta0 = MarchingCubes::CUBE_INDEX_SHIFTS[MarchingCubes::EDGE_VERTEXES[e].first];
+          const auto delta1 = MarchingCubes::CUBE_INDEX_SHIFTS[MarchingCubes::EDGE_VERTEXES[e].second];
+          const double v0 = tensor(cube_index + delta0);
+          const double v1 = tensor(cube_index + delta1);
+          const double offset = (iso_value - v0) / (v1 - v0);
+          edge_vertexes[e] = cube_index + (1-offset)*delta0 + offset*delta1;
+        }
+      }
+
+      for (size_t t = 0; MarchingCubes::TRIANGLE_TABLE[cube_type][t] != -1; t += 3) {
+        triangles.push_back({{
+          edge_vertexes[MarchingCubes::TRIANGLE_TABLE[cube_type][t + 0]],
+          edge_vertexes[MarchingCubes::TRIANGLE_TABLE[cube_type][t + 1]],
+          edge_vertexes[MarchingCubes::TRIANGLE_TABLE[cube_type][t + 2]]
+        }});
+      }
+    }
+    return triangles;
+  }
+
+  // Triangle soup of the original polygonize_tensor, with vertexes at the edge midpoints
+  template <typename T, typename Predicate>
+  std::vector<Triangle> reference_tensor(const Tensor<T,3>& tensor, const Predicate& is_inside) {
+    std::vector<Triangle> triangles;
+    if (tensor.size()(0) < 2 || tensor.size()(1) < 2 || tensor.size()(2) < 2) return triangles;
+
+    const auto cube_size = size_type(tensor.size()) - size_type(1u, 1u, 1u);
+    for (const auto& cube_index : cube_size) {
+      size_t cube_type = 0;
+      for (size_t c = 0; c < MarchingCubes::CUBE_INDEX_SHIFTS.size(); ++c) {
+        if (!is_inside(tensor(cube_index + MarchingCubes::CUBE_INDEX_SHIFTS[c]))) cube_type |= (1 << c);
+      }
+
+      for (size_t t = 0; MarchingCubes::TRIANGLE_TABLE[cube_type][t] != -1; t += 3) {
+        triangles.push_back({{
+          cube_index + MarchingCubes::CUBE_EDGE_SHIFTS[MarchingCubes::TRIANGLE_TABLE[cube_type][t + 0]],
+          cube_index + MarchingCubes::CUBE_EDGE_SHIFTS[MarchingCubes::TRIANGLE_TABLE[cube_type][t + 1]],
+          cube_index + MarchingCubes::CUBE_EDGE_SHIFTS[MarchingCubes::TRIANGLE_TABLE[cube_type][t + 2]]
+        }});
+      }
+    }
+    return triangles;
+  }
+
+  template <typename MeshType>
+  std::vector<Triangle> soup_of(const MeshType& mesh) {
+    const auto to_vertex = [&](size_t v) {
+      const auto& vertex = mesh.vertexes()[v];
+      return vertex_type(double(vertex(0)), double(vertex(1)), double(vertex(2)));
+    };
+
+    std::vector<Triangle> triangles;
+    for (const auto& face : mesh.faces()) {
+      triangles.push_back({{to_vertex(std::get<0>(face)), to_vertex(std::get<1>(face)), to_vertex(std::get<2>(face))}});
+    }
+    return triangles;
+  }
+
+  bool close(const vertex_type& a, const vertex_type& b) {
+    // Float meshes keep about 7 digits of coordinates up to a few hundred
+    for (size_t d = 0; d < 3; ++d) {
+      if (std::fabs(a(d) - b(d)) > 1e-4) return false;
+    }
+    return true;
+  }
+
+  // Same triangles up to order, each with the same winding up to rotation
+  bool same_soup(std::vector<Triangle> a, std::vector<Triangle> b) {
+    if (a.size() != b.size()) return false;
+
+    const auto key = [](const Triangle& t) { return t[0](0) + t[1](0) + t[2](0) + 0.37*(t[0](1) + t[1](1) + t[2](1)) + 0.11*(t[0](2) + t[1](2) + t[2](2)); };
+    const auto by_key = [&](const Triangle& l, const Triangle& r) { return key(l) < key(r); };
+    std::sort(a.begin(), a.end(), by_key);
+    std::sort(b.begin(), b.end(), by_key);
+
+    std::vector<bool> used(b.size(), false);
+    size_t first = 0;
+    for (const auto& t : a) {
+      const double k = key(t);
+      while (first < b.size() && key(b[first]) < k - 1e-3) ++first;
+
+      bool found = false;
+      for (size_t n = first; n < b.size() && key(b[n]) <= k + 1e-3 && !found; ++n) {
+        if (used[n]) continue;
+        for (size_t r = 0; r < 3 && !found; ++r) {
+          found = close(t[0], b[n][r]) && close(t[1], b[n][(r+1) % 3]) && close(t[2], b[n][(r+2) % 3]);
+        }
+        if (found) used[n] = true;
+      }
+      if (!found) return false;
+    }
+    return true;
+  }
+
+  // Every face index points at a vertex, and every vertex is used
+  template <typename MeshType>
+  bool well_formed(const MeshType& mesh) {
+    std::vector<bool> used(mesh.vertexes().size(), false);
+    for (const auto& face : mesh.faces()) {
+      for (size_t v : {size_t(std::get<0>(face)), size_t(std::get<1>(face)), size_t(std::get<2>(face))}) {
+        if (v >= used.size()) return false;
+        used[v] = true;
+      }
+    }
+    return std::find(used.begin(), used.end(), false) == used.end();
+  }
+
+  // No two vertexes at the same position
+  template <typename MeshType>
+  bool unique_vertexes(const MeshType& mesh) {
+    auto vertexes = mesh.vertexes();
+    std::sort(vertexes.begin(), vertexes.end());
+    return std::adjacent_find(vertexes.begin(), vertexes.end()) == vertexes.end();
+  }
+
+  template <typename MeshType>
+  bool identical(const MeshType& a, const MeshType& b) {
+    return a.vertexes() == b.vertexes() && a.faces() == b.faces();
+  }
+
+  // The counters add up to the mesh and to the cubes of the tensor, every cube the surface crosses
+  // is in the histogram under its own case, and the JSON holds the same numbers
+  template <typename T>
+  bool stats_agree(const PipelineStats& stats, const Tensor<T,3>& tensor, const T iso_value, const Mesh& mesh) {
+    std::array<size_t,256> cases{};
+    size_t n_cubes = 0;
+    if (tensor.size()(0) > 1 && tensor.size()(1) > 1 && tensor.size()(2) > 1) {
+      const auto cube_size = size_type(tensor.size()) - size_type(1u, 1u, 1u);
+      n_cubes = cube_size.prod();
+      for (const auto& cube_index : cube_size) {
+        size_t cube_type = 0;
+        for (size_t c = 0; c < MarchingCubes::CUBE_INDEX_SHIFTS.size(); ++c) {
+          if (tensor(cube_index + MarchingCubes::CUBE_INDEX_SHIFTS[c]) < iso_value) cube_type |= (1 << c);
+        }
+        ++cases[cube_type];
+      }
+    }
+
+    if (stats.faces() != mesh.faces().size() || stats.vertexes_after_welding() != mesh.vertexes().size() ||
+        stats.vertexes_before_welding() < stats.vertexes_after_welding() || stats.cubes_visited() + stats.cubes_skipped() != n_cubes) {
+      return false;
+    }
+
+    // Cubes all inside or all outside may be in rows passed over without classifying
+    size_t n_classified = 0;
+    for (size_t c = 0; c < cases.size(); ++c) {
+      n_classified += stats.case_counts()[c];
+      const bool crossed = c != 0 && c != 255;
+      if (crossed ? stats.case_counts()[c] != cases[c] : stats.case_counts()[c] > cases[c]) return false;
+    }
+    if (n_classified < stats.cubes_visited() || n_classified > n_cubes) return false;
+
+    std::stringstream expected;
+    expected << "\"cubes_visited\": " << stats.cubes_visited() << ", \"cubes_skipped\": " << stats.cubes_skipped()
+             << ", \"vertexes_before_welding\": " << stats.vertexes_before_welding()
+             << ", \"vertexes_after_welding\": " << mesh.vertexes().size()
+             << ", \"faces\": " << mesh.faces().size() << ", \"peak_bytes\": " << stats.peak_bytes() << ", \"cases\": [";
+    for (size_t c = 0; c < cases.size(); ++c) expected << (c ? ", " : "") << stats.case_counts()[c];
+    expected << "]}";
+
+    std::stringstream json;
+    stats.write_json(json);
+    const std::string text = json.str(), tail = expected.str();
+    return text.compare(0, 22, "{\"seconds\": {\"total\": ") == 0 && text.size() > tail.size() &&
+           text.compare(text.size() - tail.size(), tail.size(), tail) == 0;
+  }
+
+  struct CollectingSink {
+    std::vector<vertex_type> vertexes;
+    std::vector<Mesh::face_type> faces;
+    std::vector<vertex_type> normals;
+
+    void begin(bool) {}
+    void add_vertexes(const vertex_type* added, const vertex_type* added_normals, size_t n) {
+      vertexes.insert(vertexes.end(), added, added + n);
+      if (added_normals) normals.insert(normals.end(), added_normals, added_normals + n);
+    }
+    void add_faces(const Mesh::face_type* added, size_t n) { faces.insert(faces.end(), added, added + n); }
+    void end() {}
+  };
+
+  // C ordered .npy of shape (nz, ny, nx), which maps onto the tensor's own layout
+  template <typename T>
+  void write_npy(const Tensor<T,3>& tensor, const std::string& path) {
+    const auto& size = tensor.size();
+    std::string header = "{'descr': '=" + std::string(NpyType<T>::code()) + "', 'fortran_order': False, 'shape': (" +
+      std::to_string(size(2)) + ", " + std::to_string(size(1)) + ", " + std::to_string(size(0)) + "), }";
+    while ((10 + header.size() + 1) % 64 != 0) header += ' ';
+    header += '\n';
+
+    std::ofstream file(path, std::ios::binary);
+    file.write("\x93NUMPY\x01\x00", 8);
+    const uint16_t header_size = uint16_t(header.size());
+    file.put(char(header_size & 0xff));
+    file.put(char(header_size >> 8));
+    file << header;
+    file.write(reinterpret_cast<const char*>(tensor.data()), sizeof(T) * size.prod());
+  }
+
+  template <typename T>
+  std::string describe(const char* what, const Tensor<T,3>& tensor, double iso_value) {
+    std::stringstream ss;
+    ss << what << " " << tensor.size()(0) << "x" << tensor.size()(1) << "x" << tensor.size()(2) << " iso " << iso_value;
+    return ss.str();
+  }
+
+  template <typename T>
+  void check_isosurface(const Tensor<T,3>& tensor, const T iso_value, const std::vector<ThreadPool*>& pools) {
+    const auto name = [&](const char* what) { return describe(what, tensor, iso_value); };
+    const auto reference = reference_isosurface(tensor, iso_value);
+
+    const Mesh mesh = MarchingCubes::polygonize_isosurface(tensor, iso_value);
+    check(same_soup(soup_of(mesh), reference), name("polygonize_isosurface"));
+    check(well_formed(mesh), name("polygonize_isosurface well formed"));
+    check(unique_vertexes(mesh), name("polygonize_isosurface unique vertexes"));
+
+    for (ThreadPool* pool : pools) {
+      const std::string threads = " threads " + std::to_string(pool->size());
+      check(identical(MarchingCubes::polygonize_isosurface(tensor, iso_value, *pool), mesh), name("pool") + threads);
+      check(identical(MarchingCubes::polygonize_isosurface(tensor, iso_value, *pool, MarchingCubes::Normals::gradient), mesh), name("normals") + threads);
+
+      PipelineStats stats;
+      check(identical(MarchingCubes::polygonize_isosurface(tensor, iso_value, *pool, stats), mesh), name("stats") + threads);
+      check(stats_agree(stats, tensor, iso_value, mesh), name("stats counters") + threads);
+
+      MarchingCubes::Scratch scratch;
+      check(identical(MarchingCubes::polygonize_isosurface(tensor, iso_value, *pool, scratch), mesh), name("scratch") + threads);
+      check(identical(MarchingCubes::polygonize_isosurface(tensor, iso_value, *pool, scratch), mesh), name("scratch reused") + threads);
+
+      CompactMesh compact;
+      MarchingCubes::polygonize_isosurface(tensor, iso_value, *pool, compact);
+      check(same_soup(soup_of(compact), reference) && well_formed(compact), name("compact mesh") + threads);
+
+      CollectingSink sink;
+      MarchingCubes::polygonize_isosurface(tensor, iso_value, *pool, sink);
+      // Slabs reach the sink as they finish, so its vertexes come in another order
+      const Mesh sunk(std::move(sink.vertexes), std::move(sink.faces));
+      check(same_soup(soup_of(sunk), reference) && well_formed(sunk) && sunk.vertexes().size() == mesh.vertexes().size(), name("sink") + threads);
+
+      check(identical(MarchingCubes::polygonize_isosurface(TensorView<T,3>(tensor), iso_value, *pool), mesh), name("view") + threads);
+      check(identical(MarchingCubes::polygonize_isosurface(LayoutTensor<T,BrickedLayout<8>>(tensor), iso_value, *pool), mesh), name("bricked") + threads);
+      check(identical(MarchingCubes::polygonize_isosurface(LayoutTensor<T,MortonLayout>(tensor), iso_value, *pool), mesh), name("morton") + threads);
+
+      // A layout tensor's pyramid summarizes the same bricks as the linear one
+      const LayoutTensor<T,BrickedLayout<16>> bricked(tensor);
+      const MinMaxPyramid<T>& pyramid = bricked.min_max_pyramid(pool);
+      const auto& bricks = tensor.min_max_pyramid().bricks();
+      bool same_pyramid = pyramid.bricks().prod() == bricks.prod() && pyramid.bricks()(0) == bricks(0) && pyramid.bricks()(1) == bricks(1) &&
+                          bricked.min() == tensor.min() && bricked.max() == tensor.max();
+      for (size_t bz = 0; same_pyramid && bz < pyramid.bricks()(2); ++bz) {
+        for (size_t by = 0; by < pyramid.bricks()(1); ++by) {
+          for (size_t bx = 0; bx < pyramid.bricks()(0); ++bx) {
+            if (!(pyramid.min(bx, by, bz) == tensor.min_max_pyramid().min(bx, by, bz) && pyramid.max(bx, by, bz) == tensor.min_max_pyramid().max(bx, by, bz))) same_pyramid = false;
+          }
+        }
+      }
+      check(same_pyramid && identical(MarchingCubes::polygonize_isosurface(bricked, iso_value, *pool), mesh), name("bricked pyramid") + threads);
+      check(identical(MarchingCubes::polygonize_isosurface(SparseVolume<T>(tensor, T(0), pool), iso_value, *pool), mesh), name("sparse") + threads);
+      check(identical(MarchingCubes::polygonize_isosurface(tensor, iso_value, *pool, size_t(0)), mesh), name("level 0") + threads);
+      check(identical(MarchingCubes::polygonize_isosurfaces(tensor, std::vector<T>{iso_value, iso_value}, *pool)[1], mesh), name("levels") + threads);
+
+      MarchingCubesExtractor<T> extractor(pool);
+      Mesh extracted;
+      extractor.polygonize_isosurface(tensor, iso_value, extracted);
+      extractor.polygonize_isosurface(tensor, iso_value, extracted);
+      check(identical(extracted, mesh), name("extractor") + threads);
+
+      MarchingCubesBatch<T> batch(*pool);
+      const auto batched = batch.polygonize_isosurfaces(std::vector<Tensor<T,3>>(3, tensor), iso_value);
+      check(batched.size() == 3 && identical(batched[2], mesh), name("batch") + threads);
+    }
+
+    const std::string path = "tests_volume.npy";
+    write_npy(tensor, path);
+    {
+      ThreadPool serial(1);
+      const MappedTensor<T,3> mapped(path);
+      check(identical(MarchingCubes::polygonize_isosurface(mapped, iso_value, serial), mesh), name("mapped"));
+    }
+    std::remove(path.c_str());
+
+    if (tensor.size()(0) > 0 && tensor.size()(1) > 0) {
+      std::stringstream slices;
+      slices.write(reinterpret_cast<const char*>(tensor.data()), sizeof(T) * tensor.size().prod());
+      const Mesh streamed = StreamingMarchingCubes<T>::polygonize(slices, tensor.size()(0), tensor.size()(1), iso_value);
+      check(same_soup(soup_of(streamed), reference) && well_formed(streamed), name("streaming"));
+    }
+
+    if (tensor.size()(0) > 1 && tensor.size()(1) > 1 && tensor.size()(2) > 1) {
+      Tensor<T,3> edited = tensor;
+      IncrementalMarchingCubes<T> incremental(edited, iso_value, pools.back());
+      check(same_soup(soup_of(incremental.mesh()), reference) && well_formed(incremental.mesh()), name("incremental"));
+
+      std::mt19937 generator(7);
+      for (size_t n = 0; n < 20; ++n) {
+        const size_t i = generator() % tensor.size()(0), j = generator() % tensor.size()(1), k = generator() % tensor.size()(2);
+        edited(i, j, k) = edited(generator() % tensor.size()(0), j, k);
+      }
+      incremental.update();
+      check(same_soup(soup_of(incremental.mesh()), reference_isosurface(static_cast<const Tensor<T,3>&>(edited), iso_value)) && well_formed(incremental.mesh()), name("incremental edit"));
+
+      // Erasing a box of surface frees mesh slots, and restoring it takes them back
+      const auto for_each_in_box = [&](const auto& f) {
+        for (size_t k = tensor.size()(2) / 3; k < std::min(tensor.size()(2), tensor.size()(2) / 3 + 10); ++k) {
+          for (size_t j = tensor.size()(1) / 3; j < std::min(tensor.size()(1), tensor.size()(1) / 3 + 10); ++j) {
+            for (size_t i = tensor.size()(0) / 3; i < std::min(tensor.size()(0), tensor.size()(0) / 3 + 10); ++i) f(i, j, k);
+          }
+        }
+      };
+      for_each_in_box([&](size_t i, size_t j, size_t k) { edited(i, j, k) = tensor.min(); });
+      incremental.update();
+      check(same_soup(soup_of(incremental.mesh()), reference_isosurface(static_cast<const Tensor<T,3>&>(edited), iso_value)) && well_formed(incremental.mesh()), name("incremental erase"));
+
+      for_each_in_box([&](size_t i, size_t j, size_t k) { edited(i, j, k) = tensor(i, j, k); });
+      incremental.update();
+      check(same_soup(soup_of(incremental.mesh()), reference_isosurface(static_cast<const Tensor<T,3>&>(edited), iso_value)) && well_formed(incremental.mesh()), name("incremental restore"));
+    }
+  }
+
+  template <typename T, typename Predicate>
+  void check_tensor(const Tensor<T,3>& tensor, const Predicate& is_inside, const std::vector<ThreadPool*>& pools) {
+    const auto name = [&](const char* what) { return describe(what, tensor, 0.0); };
+    const auto reference = reference_tensor(tensor, is_inside);
+
+    const Mesh mesh = MarchingCubes::polygonize_tensor(tensor, is_inside);
+    check(same_soup(soup_of(mesh), reference), name("polygonize_tensor"));
+    check(well_formed(mesh) && unique_vertexes(mesh), name("polygonize_tensor well formed"));
+
+    // std::vector<bool> has no data(), so this writes through its iterators
+    const Tensor<bool,3> inside = tensor.template transformed<bool>(is_inside);
+    bool same_inside = true;
+    for (const auto& index : tensor.size()) same_inside = same_inside && inside(index) == bool(is_inside(tensor(index)));
+    check(same_inside, name("transformed to bool"));
+
+    for (ThreadPool* pool : pools) {
+      const std::string threads = " threads " + std::to_string(pool->size());
+      check(identical(MarchingCubes::polygonize_tensor(tensor, is_inside, *pool), mesh), name("tensor pool") + threads);
+      check(identical(MarchingCubes::polygonize_tensor(tensor, std::function<bool(T)>(is_inside), *pool), mesh), name("tensor std::function") + threads);
+      check(identical(MarchingCubes::polygonize_tensor(TensorView<T,3>(tensor), is_inside, *pool), mesh), name("tensor view") + threads);
+      check(identical(MarchingCubes::polygonize_tensor(LayoutTensor<T,BrickedLayout<8>>(tensor), is_inside, *pool), mesh), name("tensor bricked") + threads);
+      check(identical(MarchingCubes::polygonize_tensor(SparseVolume<T>(tensor, T(0), pool), is_inside, *pool), mesh), name("tensor sparse") + threads);
+
+      MarchingCubesExtractor<T> extractor(pool);
+      check(identical(extractor.polygonize_tensor(tensor, is_inside), mesh), name("tensor extractor") + threads);
+    }
+  }
+
+  // Smooth blob with ripples, scaled to [0, scale].  Integer fields hold even values only, so odd
+  // iso values never land exactly on a grid point.
+  template <typename T>
+  Tensor<T,3> make_field(const size_type& size, double scale, unsigned seed) {
+    Tensor<T,3> tensor(size);
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> jitter(0.0, 0.05);
+
+    for (const auto& index : size) {
+      const double x = (index(0) + 0.5) / size(0) - 0.5, y = (index(1) + 0.5) / size(1) - 0.45, z = (index(2) + 0.5) / size(2) - 0.55;
+      const double r = std::sqrt(x*x + y*y + z*z);
+      const double v = 0.5 + 0.3*std::cos(9.0*r) + 0.1*std::sin(11.0*x)*std::sin(7.0*y + 3.0*z) + jitter(generator);
+      const double value = std::min(1.0, std::max(0.0, v)) * scale;
+      tensor(index) = T(std::is_integral<T>::value ? 2 * std::floor(value / 2) : value);
+    }
+    return tensor;
+  }
+
+  double dot(const vertex_type& a, const vertex_type& b) {
+    return a(0)*b(0) + a(1)*b(1) + a(2)*b(2);
+  }
+
+  vertex_type cross(const vertex_type& a, const vertex_type& b) {
+    return vertex_type(a(1)*b(2) - a(2)*b(1), a(2)*b(0) - a(0)*b(2), a(0)*b(1) - a(1)*b(0));
+  }
+
+  // Value of type T stored little-endian at offset, whatever the byte order of the machine
+  template <typename T>
+  T read_little_endian(const std::string& bytes, size_t offset) {
+    uint64_t bits = 0;
+    for (size_t b = sizeof(T); b-- > 0; ) bits = (bits << 8) | uint8_t(bytes[offset + b]);
+
+    T value;
+    if (sizeof(T) == 8) {
+      std::memcpy(&value, &bits, sizeof(T));
+    } else if (sizeof(T) == 4) {
+      const uint32_t bits32 = uint32_t(bits);
+      std::memcpy(&value, &bits32, sizeof(T));
+    } else if (sizeof(T) == 2) {
+      const uint16_t bits16 = uint16_t(bits);
+      std::memcpy(&value, &bits16, sizeof(T));
+    } else {
+      const uint8_t bits8 = uint8_t(bits);
+      std::memcpy(&value, &bits8, sizeof(T));
+    }
+    return value;
+  }
+
+  // The PLY header Mesh::write_ply_file gives a mesh of coordinate type S
+  template <typename S>
+  std::string ply_header(const char* scalar_name, const BasicMesh<S,uint32_t>& mesh) {
+    std::string header = "ply\nformat binary_little_endian 1.0\nelement vertex " + std::to_string(mesh.vertexes().size()) + "\n";
+    for (const char* property : {"x", "y", "z", "nx", "ny", "nz"}) {
+      if (property[0] == 'n' && !mesh.has_normals()) break;
+      header += "property " + std::string(scalar_name) + " " + property + "\n";
+    }
+    return header + "element face " + std::to_string(mesh.faces().size()) + "\nproperty list uchar uint vertex_indices\nend_header\n";
+  }
+
+  // The body of a PLY file written by Mesh::write_ply_file holds exactly the mesh's vertexes,
+  // normals and faces
+  template <typename S>
+  bool ply_body_matches(const std::string& file, size_t offset, const BasicMesh<S,uint32_t>& mesh) {
+    const size_t n_columns = mesh.has_normals() ? 6 : 3;
+    if (file.size() != offset + mesh.vertexes().size() * n_columns * sizeof(S) + mesh.faces().size() * 13) return false;
+
+    for (size_t v = 0; v < mesh.vertexes().size(); ++v) {
+      for (size_t c = 0; c < n_columns; ++c) {
+        const S expected = c < 3 ? mesh.vertexes()[v](c) : mesh.normals()[v](c - 3);
+        if (read_little_endian<S>(file, offset) != expected) return false;
+        offset += sizeof(S);
+      }
+    }
+    for (const auto& face : mesh.faces()) {
+      if (uint8_t(file[offset]) != 3 ||
+          read_little_endian<uint32_t>(file, offset + 1) != std::get<0>(face) ||
+          read_little_endian<uint32_t>(file, offset + 5) != std::get<1>(face) ||
+          read_little_endian<uint32_t>(file, offset + 9) != std::get<2>(face)) {
+        return false;
+      }
+      offset += 13;
+    }
+    return true;
+  }
+
+  // Ball whose values are the distance inside its surface, so the iso surface at 0 is a sphere
+  // and the values fall outward along the radius
+  struct Sphere {
+    vertex_type centre;
+    double radius;
+
+    double distance(const vertex_type& p) const {
+      const auto d = p - centre;
+      return std::sqrt(d(0)*d(0) + d(1)*d(1) + d(2)*d(2));
+    }
+
+    Tensor<float,3> tensor(const size_type& size) const {
+      Tensor<float,3> tensor(size);
+      for (const auto& index : size) tensor(index) = float(radius - distance(vertex_type() + index));
+      return tensor;
+    }
+  };
+
+  // Grid points exactly at the iso value: every edge crossing at such a point must share its
+  // vertex, as the weld of the original Mesh made them
+  void check_exact_hits(const std::vector<ThreadPool*>& pools) {
+    Tensor<uint8_t,3> sphere(size_type(40u, 40u, 40u));
+    for (const auto& index : sphere.size()) {
+      const double x = index(0) - 20.0, y = index(1) - 20.0, z = index(2) - 20.0;
+      sphere(index) = uint8_t(std::max(0.0, 255.0 - 8.0*std::sqrt(x*x + y*y + z*z)));
+    }
+    check_isosurface(sphere, uint8_t(128), pools);
+
+    Tensor<uint8_t,3> steps(size_type(23u, 19u, 37u));
+    std::mt19937 generator(3);
+    for (const auto& index : steps.size()) steps(index) = uint8_t(64 * (generator() % 4));
+    check_isosurface(steps, uint8_t(128), pools);
+    check_isosurface(steps, uint8_t(64), pools);
+  }
+
+  // Const calls from several threads at once on one tensor, which build its cached summaries
+  // concurrently.  Build with -fsanitize=thread to have races reported.
+  void check_concurrent_calls() {
+    const auto tensor = make_field<float>(size_type(40u, 37u, 45u), 1.0, 11);
+    const Mesh mesh = MarchingCubes::polygonize_isosurface(Tensor<float,3>(tensor), 0.55f);
+
+    std::vector<Mesh> meshes(4, mesh);
+    std::vector<Mesh> previews(meshes.size(), mesh);
+    std::vector<float> ranges(meshes.size());
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < meshes.size(); ++t) {
+      threads.emplace_back([&, t]() {
+        ThreadPool serial(1);
+        meshes[t] = MarchingCubes::polygonize_isosurface(tensor, 0.55f, serial);
+        ranges[t] = tensor.max() - tensor.min();
+        previews[t] = MarchingCubes::polygonize_isosurface(tensor, 0.55f, serial, 1);
+      });
+    }
+    for (auto& thread : threads) thread.join();
+
+    for (size_t t = 0; t < meshes.size(); ++t) {
+      check(identical(meshes[t], mesh) && ranges[t] == tensor.max() - tensor.min(), "concurrent calls");
+      check(identical(previews[t], previews[0]) && !previews[t].faces().empty(), "concurrent previews");
+    }
+  }
+
+  // Reports more vertexes and faces than uint32 can count, without holding any, for the writers'
+  // size checks (which come before anything is read)
+  struct OversizedMesh {
+    size_t n_vertexes() const { return size_t(std::numeric_limits<uint32_t>::max()) + 1; }
+    size_t n_faces()    const { return size_t(std::numeric_limits<uint32_t>::max()) + 1; }
+    bool has_normals()  const { return false; }
+    Point<double,3> vertex(size_t) const { return Point<double,3>(); }
+    Point<double,3> normal(size_t) const { return Point<double,3>(); }
+    std::array<size_t,3> face(size_t) const { return {{0, 0, 0}}; }
+  };
+
+  // The OFF, PLY and STL writers on a mesh large enough for the OFF writer to format it in
+  // several chunks
+  void check_writers(const std::vector<ThreadPool*>& pools) {
+    const Mesh mesh = MarchingCubes::polygonize_isosurface(make_field<float>(size_type(90u, 85u, 95u), 1.0, 5), 0.55f);
+    const CompactMesh compact(mesh);
+    check(mesh.vertexes().size() + mesh.faces().size() > (size_t(1) << 16), "writers mesh takes several OFF chunks");
+
+    std::stringstream serial;
+    mesh.write_off_file(serial);
+    std::stringstream header(serial.str().substr(0, serial.str().find('\n')));
+    std::string magic;
+    size_t n_vertexes = 0, n_faces = 0, n_edges = 1;
+    header >> magic >> n_vertexes >> n_faces >> n_edges;
+    check(magic == "OFF" && n_vertexes == mesh.vertexes().size() && n_faces == mesh.faces().size() && n_edges == 0, "OFF header");
+
+    for (ThreadPool* pool : pools) {
+      const std::string threads = " threads " + std::to_string(pool->size());
+      std::stringstream parallel, arrays;
+      mesh.write_off_file(parallel, pool);
+      MeshArrays<double,size_t>(mesh).write_off_file(arrays, pool);
+      check(parallel.str() == serial.str() && arrays.str() == serial.str(), "OFF with a pool" + threads);
+    }
+
+    std::stringstream ply;
+    compact.write_ply_file(ply);
+    const std::string header_text = ply_header("float", compact);
+    check(ply.str().compare(0, header_text.size(), header_text) == 0 && ply_body_matches(ply.str(), header_text.size(), compact), "PLY");
+
+    std::stringstream double_ply;
+    mesh.write_ply_file(double_ply);
+    const BasicMesh<double,uint32_t> double_mesh(mesh);
+    const std::string double_header = ply_header("double", double_mesh);
+    check(double_ply.str().compare(0, double_header.size(), double_header) == 0 && ply_body_matches(double_ply.str(), double_header.size(), double_mesh), "PLY of doubles");
+
+    std::stringstream stl;
+    compact.write_stl_file(stl);
+    const std::string file = stl.str();
+    bool stl_ok = file.size() == 84 + 50 * compact.faces().size() && file.compare(0, 80, std::string(80, ' ')) == 0 &&
+                  read_little_endian<uint32_t>(file, 80) == compact.faces().size();
+    for (size_t f = 0; stl_ok && f < compact.faces().size(); ++f) {
+      const size_t offset = 84 + 50*f;
+      const auto& face = compact.faces()[f];
+      std::array<vertex_type,4> read;
+      for (size_t p = 0; p < 4; ++p) {
+        for (size_t d = 0; d < 3; ++d) read[p](d) = read_little_endian<float>(file, offset + 12*p + 4*d);
+      }
+      const vertex_type corners[3] = {
+        vertex_type() + compact.vertexes()[std::get<0>(face)], vertex_type() + compact.vertexes()[std::get<1>(face)], vertex_type() + compact.vertexes()[std::get<2>(face)]
+      };
+      // The normal is the unit normal of the winding, rounded to float
+      const auto winding = cross(corners[1] - corners[0], corners[2] - corners[0]);
+      const double length = std::sqrt(dot(winding, winding));
+      stl_ok = read[1] == corners[0] && read[2] == corners[1] && read[3] == corners[2] && read_little_endian<uint16_t>(file, offset + 48) == 0 &&
+               (length == 0 || close(read[0], winding / length));
+    }
+    check(stl_ok, "STL");
+
+    // Nothing is written when the counts do not fit
+    for (const char* format : {"PLY", "STL"}) {
+      std::stringstream out;
+      bool threw = false;
+      try {
+        if (format[0] == 'P') {
+          MeshWriter::write_ply<double>(OversizedMesh(), out);
+        } else {
+          MeshWriter::write_stl<double>(OversizedMesh(), out);
+        }
+      } catch (const std::runtime_error&) {
+        threw = true;
+      }
+      check(threw && out.str().empty(), std::string(format) + " with more than uint32 can count");
+    }
+  }
+
+  // NaN values count toward the maximum, and the minimum is NaN only if every value is, in every
+  // layout and in the min/max pyramid alike
+  void check_nan_min_max() {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    Tensor<float,3> tensor(size_type(19u, 18u, 17u), 2.0f);
+    tensor(3u, 4u, 5u) = -1.0f;
+    tensor(11u, 12u, 13u) = nan;
+    tensor(18u, 17u, 16u) = 5.0f;
+    const Tensor<float,3> all_nan(size_type(9u, 9u, 9u), nan);
+
+    const auto min_max_agree = [](const auto& t, const MinMaxPyramid<float>& pyramid) {
+      return std::isnan(t.max()) && t.min() == -1.0f && std::isnan(pyramid.max(1, 1, 1)) && pyramid.min(1, 1, 1) == 2.0f &&
+             pyramid.max(0, 0, 0) == 2.0f && pyramid.min(0, 0, 0) == -1.0f;
+    };
+    const auto all_nan_agree = [](const auto& t) { return std::isnan(t.min()) && std::isnan(t.max()); };
+
+    const LayoutTensor<float,BrickedLayout<8>> bricked(tensor);
+    const LayoutTensor<float,MortonLayout> morton(tensor);
+    check(min_max_agree(tensor, tensor.min_max_pyramid()), "NaN min/max");
+    check(min_max_agree(bricked, bricked.min_max_pyramid()), "NaN min/max bricked");
+    check(min_max_agree(morton, morton.min_max_pyramid()), "NaN min/max morton");
+    check(all_nan_agree(all_nan) && all_nan_agree(LayoutTensor<float,BrickedLayout<8>>(all_nan)) && all_nan_agree(LayoutTensor<float,MortonLayout>(all_nan)), "all NaN min/max");
+  }
+
+  // Normals of a sphere are unit length and point out along the radius, down the values, to the
+  // side the faces are wound towards.  The OFF and PLY writers carry them in their own columns.
+  void check_normals(const std::vector<ThreadPool*>& pools) {
+    const Sphere sphere{vertex_type(19.7, 19.4, 20.3), 14.2};
+    const auto tensor = sphere.tensor(size_type(40u, 41u, 42u));
+
+    for (ThreadPool* pool : pools) {
+      const std::string threads = " threads " + std::to_string(pool->size());
+      const Mesh mesh = MarchingCubes::polygonize_isosurface(tensor, 0.0f, *pool, MarchingCubes::Normals::gradient);
+      check(!mesh.faces().empty() && mesh.normals().size() == mesh.vertexes().size(), "sphere normals per vertex" + threads);
+
+      bool unit = true, radial = true;
+      for (size_t v = 0; v < mesh.normals().size(); ++v) {
+        const auto& normal = mesh.normals()[v];
+        const auto outward = (mesh.vertexes()[v] - sphere.centre) / sphere.distance(mesh.vertexes()[v]);
+        unit = unit && std::fabs(dot(normal, normal) - 1) < 1e-9;
+        radial = radial && dot(normal, outward) > 0.99;
+      }
+      check(unit, "sphere normals unit length" + threads);
+      check(radial, "sphere normals outward" + threads);
+
+      bool wound_outward = true;
+      for (const auto& face : mesh.faces()) {
+        const auto& a = mesh.vertexes()[std::get<0>(face)];
+        const auto& b = mesh.vertexes()[std::get<1>(face)];
+        const auto& c = mesh.vertexes()[std::get<2>(face)];
+        wound_outward = wound_outward && dot(cross(b - a, c - a), (a + b + c) / 3.0 - sphere.centre) > 0;
+      }
+      check(wound_outward, "sphere faces wound outward" + threads);
+    }
+
+    const Mesh mesh = MarchingCubes::polygonize_isosurface(tensor, 0.0f, *pools[0], MarchingCubes::Normals::gradient);
+
+    // OFF keeps 6 significant digits
+    std::stringstream off;
+    mesh.write_off_file(off);
+    std::string magic;
+    size_t n_vertexes = 0, n_faces = 0, n_edges = 0;
+    off >> magic >> n_vertexes >> n_faces >> n_edges;
+    bool off_ok = magic == "NOFF" && n_vertexes == mesh.vertexes().size() && n_faces == mesh.faces().size();
+    for (size_t v = 0; off_ok && v < n_vertexes; ++v) {
+      for (size_t c = 0; c < 6; ++c) {
+        double value = 0;
+        off >> value;
+        const double expected = c < 3 ? mesh.vertexes()[v](c) : mesh.normals()[v](c - 3);
+        off_ok = off_ok && std::fabs(value - expected) <= 1e-5 * std::max(1.0, std::fabs(expected));
+      }
+    }
+    check(off_ok, "NOFF normals");
+
+    // PLY keeps every bit
+    std::stringstream ply;
+    mesh.write_ply_file(ply);
+    const std::string file = ply.str();
+    const size_t body = file.find("end_header\n") + 11;
+    const size_t normal_columns = file.find("property double nx\nproperty double ny\nproperty double nz\nelement face");
+    bool ply_ok = normal_columns != std::string::npos && normal_columns < body && file.size() >= body + 48 * mesh.vertexes().size();
+    for (size_t v = 0; ply_ok && v < mesh.vertexes().size(); ++v) {
+      for (size_t c = 0; c < 6; ++c) {
+        const double expected = c < 3 ? mesh.vertexes()[v](c) : mesh.normals()[v](c - 3);
+        ply_ok = ply_ok && read_little_endian<double>(file, body + 48*v + 8*c) == expected;
+      }
+    }
+    check(ply_ok, "PLY normals");
+  }
+
+  // Each directed edge of a face is met by the reverse edge of exactly one other face: the surface
+  // is closed, manifold along its edges and consistently wound
+  bool closed_manifold(const Mesh& mesh) {
+    std::vector<std::pair<size_t,size_t>> edges;
+    for (const auto& face : mesh.faces()) {
+      const size_t a = std::get<0>(face), b = std::get<1>(face), c = std::get<2>(face);
+      edges.insert(edges.end(), {{a, b}, {b, c}, {c, a}});
+    }
+    std::sort(edges.begin(), edges.end());
+    if (std::adjacent_find(edges.begin(), edges.end()) != edges.end()) return false;
+    for (const auto& edge : edges) {
+      if (!std::binary_search(edges.begin(), edges.end(), std::make_pair(edge.second, edge.first))) return false;
+    }
+    return true;
+  }
+
+  bool no_degenerate_faces(const Mesh& mesh) {
+    for (const auto& face : mesh.faces()) {
+      if (std::get<0>(face) == std::get<1>(face) || std::get<1>(face) == std::get<2>(face) || std::get<2>(face) == std::get<0>(face)) return false;
+    }
+    return true;
+  }
+
+  // Sorted positions of the vertexes on edges that only one face has
+  std::vector<vertex_type> boundary_vertexes(const Mesh& mesh) {
+    std::vector<std::pair<size_t,size_t>> edges;
+    for (const auto& face : mesh.faces()) {
+      const size_t a = std::get<0>(face), b = std::get<1>(face), c = std::get<2>(face);
+      for (const auto& edge : {std::make_pair(a, b), std::make_pair(b, c), std::make_pair(c, a)}) {
+        edges.emplace_back(std::min(edge.first, edge.second), std::max(edge.first, edge.second));
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    std::vector<vertex_type> boundary;
+    for (size_t e = 0; e < edges.size(); ++e) {
+      const bool shared = (e > 0 && edges[e-1] == edges[e]) || (e + 1 < edges.size() && edges[e+1] == edges[e]);
+      if (shared) continue;
+      boundary.push_back(mesh.vertexes()[edges[e].first]);
+      boundary.push_back(mesh.vertexes()[edges[e].second]);
+    }
+    std::sort(boundary.begin(), boundary.end());
+    boundary.erase(std::unique(boundary.begin(), boundary.end()), boundary.end());
+    return boundary;
+  }
+
+  // Both decimation modes on a sphere keep it closed and on its surface, and quadric collapse
+  // leaves the boundary of an open surface alone
+  void check_decimation(const std::vector<ThreadPool*>& pools) {
+    const Sphere sphere{vertex_type(19.7, 19.4, 19.9), 14.2};
+    const auto tensor = sphere.tensor(size_type(40u, 40u, 40u));
+
+    for (ThreadPool* pool : pools) {
+      const std::string threads = " threads " + std::to_string(pool->size());
+      const Mesh original = MarchingCubes::polygonize_isosurface(tensor, 0.0f, *pool, MarchingCubes::Normals::gradient);
+
+      const std::pair<const char*, MeshDecimator> decimators[] = {
+        {"clustering", MeshDecimator::clustering(2.0, pool)},
+        {"quadric", MeshDecimator::quadric(original.faces().size() / 4, std::numeric_limits<double>::infinity(), pool)}
+      };
+      for (const auto& decimator : decimators) {
+        const std::string name = std::string(decimator.first) + threads;
+        Mesh mesh = original;
+        const auto report = mesh.decimate(decimator.second);
+
+        check(report.vertexes_before == original.vertexes().size() && report.faces_before == original.faces().size() &&
+              report.vertexes_after == mesh.vertexes().size() && report.faces_after == mesh.faces().size() &&
+              report.reduction() == double(original.faces().size()) / double(mesh.faces().size()) && report.reduction() > 3, name + " report");
+        check(well_formed(mesh) && no_degenerate_faces(mesh), name + " faces");
+        check(closed_manifold(mesh), name + " closed manifold");
+        check(mesh.normals().size() == mesh.vertexes().size(), name + " normals");
+
+        bool on_surface = true;
+        for (const auto& vertex : mesh.vertexes()) on_surface = on_surface && std::fabs(sphere.distance(vertex) - sphere.radius) < 0.25;
+        check(on_surface, name + " on the sphere");
+      }
+    }
+
+    // Oppositely wound copies of a face enclose nothing and go together; copies wound the same
+    // way leave one face
+    Mesh pair(
+      {vertex_type(0.0, 0.0, 0.0), vertex_type(1.0, 0.0, 0.0), vertex_type(0.0, 1.0, 0.0), vertex_type(0.0, 0.0, 1.0)},
+      {Mesh::face_type(0, 1, 2), Mesh::face_type(0, 3, 1), Mesh::face_type(2, 1, 0), Mesh::face_type(3, 1, 0), Mesh::face_type(1, 0, 3)}
+    );
+    pair.decimate(MeshDecimator::clustering(0.1));
+    check(pair.faces().size() == 1 && pair.vertexes().size() == 3 &&
+          soup_of(pair)[0][0] == vertex_type(0.0, 0.0, 0.0) && soup_of(pair)[0][1] == vertex_type(0.0, 0.0, 1.0) && soup_of(pair)[0][2] == vertex_type(1.0, 0.0, 0.0), "clustering drops opposite faces");
+
+    // A sphere cut open by the face x = 0 of the volume
+    const auto cut = Sphere{vertex_type(3.4, 15.3, 14.6), 11.7}.tensor(size_type(30u, 30u, 30u));
+    Mesh open = MarchingCubes::polygonize_isosurface(cut, 0.0f);
+    const auto boundary = boundary_vertexes(open);
+    const auto report = open.decimate(MeshDecimator::quadric(open.faces().size() / 8));
+    check(!boundary.empty() && report.reduction() > 4 && boundary_vertexes(open) == boundary && no_degenerate_faces(open), "quadric keeps the boundary");
+  }
+
+  // Coarse previews of a sphere have their vertexes in the coordinates of the full grid, inside
+  // it, and within a coarse cell of the surface the full grid gives
+  void check_previews(const std::vector<ThreadPool*>& pools) {
+    const Sphere sphere{vertex_type(30.3, 28.6, 33.1), 21.7};
+    const auto tensor = sphere.tensor(size_type(61u, 58u, 67u));
+    const Mesh full = MarchingCubes::polygonize_isosurface(tensor, 0.0f);
+
+    double full_error = 0;
+    for (const auto& vertex : full.vertexes()) full_error = std::max(full_error, std::fabs(sphere.distance(vertex) - sphere.radius));
+    check(full_error < 0.05, "level 0 on the sphere");
+
+    for (ThreadPool* pool : pools) {
+      for (size_t level = 1; level <= ResolutionPyramid<float>::N_LEVELS; ++level) {
+        const Mesh preview = MarchingCubes::polygonize_isosurface(tensor, 0.0f, *pool, level);
+        const double cell = double(size_t(1) << level);
+
+        bool inside = true, near = true;
+        vertex_type low(1e9, 1e9, 1e9), high(-1e9, -1e9, -1e9);
+        for (const auto& vertex : preview.vertexes()) {
+          for (size_t d = 0; d < 3; ++d) {
+            inside = inside && vertex(d) >= 0 && vertex(d) <= tensor.size()(d) - 1;
+            low(d) = std::min(low(d), vertex(d));
+            high(d) = std::max(high(d), vertex(d));
+          }
+          near = near && std::fabs(sphere.distance(vertex) - sphere.radius) < cell / 2;
+        }
+        // Reaching out to the sphere's extent means the vertexes were scaled up from the level
+        bool spans = true;
+        for (size_t d = 0; d < 3; ++d) {
+          spans = spans && std::fabs(low(d) - (sphere.centre(d) - sphere.radius)) < cell && std::fabs(high(d) - (sphere.centre(d) + sphere.radius)) < cell;
+        }
+
+        const std::string name = "preview level " + std::to_string(level) + " threads " + std::to_string(pool->size());
+        check(!preview.faces().empty() && well_formed(preview), name);
+        check(inside && spans, name + " in full coordinates");
+        check(near, name + " near the surface");
+      }
+    }
+  }
+
+  // Forwards every batch to two sinks
+  template <typename First, typename Second>
+  struct TeeSink {
+    First& first;
+    Second& second;
+
+    void begin(bool normals) { first.begin(normals); second.begin(normals); }
+    void add_vertexes(const vertex_type* vertexes, const vertex_type* normals, size_t n) { first.add_vertexes(vertexes, normals, n); second.add_vertexes(vertexes, normals, n); }
+    void add_faces(const Mesh::face_type* faces, size_t n) { first.add_faces(faces, n); second.add_faces(faces, n); }
+    void end() { first.end(); second.end(); }
+  };
+
+  // Same file apart from the spaces padding the counts of the header, which is the first line of
+  // an OFF file and runs to end_header in a PLY file
+  bool same_apart_from_padding(const std::string& padded, const std::string& plain) {
+    const auto header_end = [](const std::string& file) {
+      return file.compare(0, 4, "ply\n") == 0 ? file.find("end_header\n") + 11 : file.find('\n') + 1;
+    };
+    const auto words = [](const std::string& text) {
+      std::stringstream ss(text);
+      std::vector<std::string> words;
+      for (std::string word; ss >> word; ) words.push_back(word);
+      return words;
+    };
+
+    const size_t padded_end = header_end(padded), plain_end = header_end(plain);
+    return words(padded.substr(0, padded_end)) == words(plain.substr(0, plain_end)) &&
+           padded.compare(padded_end, std::string::npos, plain, plain_end, std::string::npos) == 0;
+  }
+
+  // MeshFileSink writes what the Mesh writers write for the mesh it was handed, on a mesh whose
+  // faces take several buffers and so go through the temporary file
+  void check_file_sink(const std::vector<ThreadPool*>& pools) {
+    const auto tensor = make_field<float>(size_type(90u, 85u, 95u), 1.0, 5);
+
+    for (ThreadPool* pool : pools) {
+      for (const auto normals : {MarchingCubes::Normals::none, MarchingCubes::Normals::gradient}) {
+        for (const auto format : {MeshFileSink::Format::off, MeshFileSink::Format::ply}) {
+          std::stringstream file;
+          MeshFileSink file_sink(file, format);
+          CollectingSink collected;
+          TeeSink<CollectingSink,MeshFileSink> tee{collected, file_sink};
+          MarchingCubes::polygonize_isosurface(tensor, 0.55f, *pool, tee, normals);
+
+          const Mesh mesh(std::move(collected.vertexes), std::move(collected.faces), std::move(collected.normals));
+          std::stringstream written;
+          if (format == MeshFileSink::Format::off) {
+            mesh.write_off_file(written);
+          } else {
+            mesh.write_ply_file(written);
+          }
+
+          const std::string name = std::string("file sink ") + (format == MeshFileSink::Format::off ? "OFF" : "PLY") +
+                                   (normals == MarchingCubes::Normals::gradient ? " normals" : "") + " threads " + std::to_string(pool->size());
+          check(mesh.faces().size() * 13 > MeshFileSink::BUFFER_CAPACITY && file_sink.n_faces() == mesh.faces().size() &&
+                file_sink.n_vertexes() == mesh.vertexes().size() && mesh.has_normals() == (normals == MarchingCubes::Normals::gradient), name + " counts");
+          check(same_apart_from_padding(file.str(), written.str()), name);
+        }
+      }
+    }
+  }
+
+  template <typename T>
+  void check_sizes(double scale, T iso_value, const std::vector<ThreadPool*>& pools) {
+    const size_t D = MarchingCubes::SLAB_DEPTH;
+    const std::vector<size_type> sizes = {
+      size_type(2u, 2u, 2u), size_type(1u, 9u, 9u), size_type(9u, 1u, 9u), size_type(9u, 9u, 1u), size_type(3u, 2u, 5u),
+      size_type(17u, 13u, D), size_type(17u, 13u, D + 1), size_type(11u, 10u, 2*D + 1), size_type(12u, 9u, 3*D + 2),
+      size_type(33u, 31u, 45u)
+    };
+
+    unsigned seed = 1;
+    for (const auto& size : sizes) {
+      const auto tensor = make_field<T>(size, scale, seed++);
+      check_isosurface(tensor, iso_value, pools);
+      check_tensor(tensor, [iso_value](T v) { return v > iso_value; }, pools);
+    }
+  }
+}
+
+int main() {
+  ThreadPool one(1), two(2), three(3), eight(8);
+  const std::vector<ThreadPool*> pools = {&one, &two, &three, &eight};
+
+  check_sizes<float>(1.0, 0.55f, pools);
+  check_sizes<uint8_t>(254.0, uint8_t(127), pools);
+  check_exact_hits(pools);
+  check_concurrent_calls();
+  check_writers(pools);
+  check_nan_min_max();
+  check_normals(pools);
+  check_decimation(pools);
+  check_previews(pools);
+  check_file_sink(pools);
+
+  std::cout << n_checks - n_failures << " of " << n_checks << " checks passed" << std::endl;
+  return n_failures == 0 ? 0 : 1;
+}
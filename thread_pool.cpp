@@ -0,0 +1,87 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t size)
+  : task_(nullptr), n_tasks_(0), next_task_(0), n_done_(0), generation_(0), stopping_(false)
+{
+  if (size == 0) size = std::max(1u, std::thread::hardware_concurrency());
+
+  workers_.reserve(size - 1);
+  for (size_t i = 1; i < size; ++i) {
+    workers_.emplace_back([this]() { work(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_cv_.notify_all();
+
+  for (auto& worker : workers_) worker.join();
+}
+
+void ThreadPool::run_parallel(size_t n_tasks, const std::function<void(size_t)>& task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    n_tasks_ = n_tasks;
+    next_task_ = 0;
+    n_done_ = 0;
+    error_ = nullptr;
+    ++generation_;
+  }
+  work_cv_.notify_all();
+
+  run_tasks();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this]() { return n_done_ == n_tasks_; });
+  task_ = nullptr;
+
+  if (error_) std::rethrow_exception(error_);
+}
+
+void ThreadPool::run_tasks() {
+  for (;;) {
+    const std::function<void(size_t)>* task;
+    size_t i;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (task_ == nullptr || next_task_ >= n_tasks_) return;
+      task = task_;
+      i = next_task_++;
+    }
+
+    try {
+      (*task)(i);
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) error_ = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (++n_done_ == n_tasks_) done_cv_.notify_all();
+    }
+  }
+}
+
+void ThreadPool::work() {
+  size_t seen_generation = 0;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_cv_.wait(lock, [&]() { return stopping_ || generation_ != seen_generation; });
+      if (stopping_) return;
+      seen_generation = generation_;
+    }
+
+    run_tasks();
+  }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run the tasks of one parallel_for at a time.  The calling
+// thread takes part in the work, so a pool of size 1 has no workers and runs everything inline.
+class ThreadPool {
+  private:
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+
+    const std::function<void(size_t)>* task_;
+    size_t n_tasks_;
+    size_t next_task_;
+    size_t n_done_;
+    size_t generation_;
+    bool stopping_;
+    std::exception_ptr error_;
+
+  public:
+    // A size of 0 uses one thread per hardware core
+    explicit ThreadPool(size_t size = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads working on a parallel_for, including the caller
+    size_t size() const { return workers_.size() + 1; }
+
+    // Calls task(i) for every i in [0, n_tasks) and returns once all have finished.  The first
+    // exception thrown by a task is rethrown here.  Must not be called from inside a task.
+    //
+    // Work that does not need the workers is run inline, without wrapping task in a
+    // std::function, so a pool of size 1 never allocates.
+    template <typename Task>
+    void parallel_for(size_t n_tasks, const Task& task) {
+      if (workers_.empty() || n_tasks <= 1) {
+        for (size_t i = 0; i < n_tasks; ++i) task(i);
+        return;
+      }
+      run_parallel(n_tasks, task);
+    }
+
+  private:
+    void run_parallel(size_t n_tasks, const std::function<void(size_t)>& task);
+    void run_tasks();
+    void work();
+};
@@ -0,0 +1,241 @@
+#include "vertex_welder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+  const VertexWelder::vertex_type& corner(const std::vector<VertexWelder::triangle_type>& triangles, size_t c) {
+    const auto& triangle = triangles[c / 3];
+    switch (c % 3) {
+      case 0:  return triangle.v0();
+      case 1:  return triangle.v1();
+      default: return triangle.v2();
+    }
+  }
+
+  // Equal vertexes must hash equally, so -0.0 is folded onto 0.0 first
+  uint64_t hash_vertex(const VertexWelder::vertex_type& vertex) {
+    uint64_t hash = 0x9e3779b97f4a7c15ull;
+    for (const double& coordinate : vertex) {
+      const double normalized = coordinate + 0.0;
+      uint64_t bits;
+      std::memcpy(&bits, &normalized, sizeof(bits));
+      hash = (hash ^ bits) * 0xff51afd7ed558ccdull;
+      hash ^= hash >> 32;
+    }
+    return hash;
+  }
+
+  // Boundaries of n_chunks roughly equal chunks of [0, n)
+  std::vector<size_t> chunk_bounds(size_t n, size_t n_chunks) {
+    std::vector<size_t> bounds(n_chunks + 1);
+    for (size_t i = 0; i <= n_chunks; ++i) bounds[i] = n * i / n_chunks;
+    return bounds;
+  }
+
+  // Hash space is split into a fixed number of shards (top bits of the hash), each with its
+  // own table, so shards can be filled in parallel without locking.
+  constexpr size_t SHARD_BITS = 6;
+  constexpr size_t N_SHARDS = size_t(1) << SHARD_BITS;
+
+  size_t shard_of(uint64_t hash) { return hash >> (64 - SHARD_BITS); }
+}
+
+VertexWelder::VertexWelder(Order order, ThreadPool* pool) : order_(order), pool_(pool) {}
+
+void VertexWelder::weld(
+  const std::vector<triangle_type>& triangles,
+  std::vector<vertex_type>& vertexes,
+  std::vector<face_type>& faces
+) const {
+  ThreadPool serial(1);
+  ThreadPool& pool = pool_ ? *pool_ : serial;
+
+  // Index of the unique vertex for each triangle corner
+  std::vector<size_t> corner_indexes(3 * triangles.size());
+
+  switch (order_) {
+    case Order::sorted:     weld_sorted(triangles, pool, vertexes, corner_indexes);     break;
+    case Order::first_seen: weld_first_seen(triangles, pool, vertexes, corner_indexes); break;
+  }
+
+  faces.resize(triangles.size());
+  const auto bounds = chunk_bounds(triangles.size(), pool.size());
+  pool.parallel_for(pool.size(), [&](size_t chunk) {
+    for (size_t t = bounds[chunk]; t < bounds[chunk+1]; ++t) {
+      faces[t] = face_type(corner_indexes[3*t + 0], corner_indexes[3*t + 1], corner_indexes[3*t + 2]);
+    }
+  });
+}
+
+void VertexWelder::weld_sorted(
+  const std::vector<triangle_type>& triangles,
+  ThreadPool& pool,
+  std::vector<vertex_type>& vertexes,
+  std::vector<size_t>& corner_indexes
+) const {
+  struct Corner {
+    vertex_type vertex;
+    size_t index;
+  };
+  const auto less = [](const Corner& lhs, const Corner& rhs) { return lhs.vertex < rhs.vertex; };
+  // Ties broken by corner so each run of equal vertexes starts with the first one inserted, as
+  // std::set would have kept (matters for -0.0 versus 0.0)
+  const auto less_then_first = [&less](const Corner& lhs, const Corner& rhs) {
+    return less(lhs, rhs) || (!less(rhs, lhs) && lhs.index < rhs.index);
+  };
+
+  const size_t n = corner_indexes.size();
+  const size_t n_chunks = pool.size();
+  const auto bounds = chunk_bounds(n, n_chunks);
+
+  // Sort each chunk, then merge neighbouring runs pairwise
+  std::vector<Corner> corners(n);
+  pool.parallel_for(n_chunks, [&](size_t chunk) {
+    for (size_t c = bounds[chunk]; c < bounds[chunk+1]; ++c) {
+      corners[c] = Corner{corner(triangles, c), c};
+    }
+    std::sort(corners.begin() + bounds[chunk], corners.begin() + bounds[chunk+1], less_then_first);
+  });
+
+  for (size_t width = 1; width < n_chunks; width *= 2) {
+    pool.parallel_for((n_chunks + 2*width - 1) / (2*width), [&](size_t merge) {
+      const size_t first  = bounds[2*width*merge];
+      const size_t middle = bounds[std::min(2*width*merge + width, n_chunks)];
+      const size_t last   = bounds[std::min(2*width*(merge + 1), n_chunks)];
+      std::inplace_merge(corners.begin() + first, corners.begin() + middle, corners.begin() + last, less_then_first);
+    });
+  }
+
+  // A new vertex starts wherever a corner compares greater than the one before it.  Count the
+  // starts per chunk first so each chunk knows the index of its first new vertex.
+  const auto is_start = [&](size_t c) { return c == 0 || less(corners[c-1], corners[c]); };
+
+  std::vector<size_t> offsets(n_chunks + 1, 0);
+  pool.parallel_for(n_chunks, [&](size_t chunk) {
+    for (size_t c = bounds[chunk]; c < bounds[chunk+1]; ++c) {
+      if (is_start(c)) ++offsets[chunk+1];
+    }
+  });
+  for (size_t chunk = 0; chunk < n_chunks; ++chunk) offsets[chunk+1] += offsets[chunk];
+
+  vertexes.resize(offsets[n_chunks]);
+  pool.parallel_for(n_chunks, [&](size_t chunk) {
+    size_t next_index = offsets[chunk];
+    for (size_t c = bounds[chunk]; c < bounds[chunk+1]; ++c) {
+      if (is_start(c)) {
+        vertexes[next_index] = corners[c].vertex;
+        ++next_index;
+      }
+      corner_indexes[corners[c].index] = next_index - 1;
+    }
+  });
+}
+
+void VertexWelder::weld_first_seen(
+  const std::vector<triangle_type>& triangles,
+  ThreadPool& pool,
+  std::vector<vertex_type>& vertexes,
+  std::vector<size_t>& corner_indexes
+) const {
+  const size_t n = corner_indexes.size();
+  const size_t n_chunks = pool.size();
+  const auto bounds = chunk_bounds(n, n_chunks);
+
+  std::vector<uint64_t> hashes(n);
+
+  // Bucket the corners by shard, keeping them in corner order within each shard
+  std::vector<size_t> shard_counts(n_chunks * N_SHARDS, 0);
+  pool.parallel_for(n_chunks, [&](size_t chunk) {
+    for (size_t c = bounds[chunk]; c < bounds[chunk+1]; ++c) {
+      hashes[c] = hash_vertex(corner(triangles, c));
+      ++shard_counts[chunk*N_SHARDS + shard_of(hashes[c])];
+    }
+  });
+
+  std::vector<size_t> shard_bounds(N_SHARDS + 1, 0);
+  {
+    size_t total = 0;
+    for (size_t shard = 0; shard < N_SHARDS; ++shard) {
+      shard_bounds[shard] = total;
+      for (size_t chunk = 0; chunk < n_chunks; ++chunk) {
+        const size_t count = shard_counts[chunk*N_SHARDS + shard];
+        shard_counts[chunk*N_SHARDS + shard] = total;
+        total += count;
+      }
+    }
+    shard_bounds[N_SHARDS] = total;
+  }
+
+  std::vector<size_t> shard_corners(n);
+  pool.parallel_for(n_chunks, [&](size_t chunk) {
+    for (size_t c = bounds[chunk]; c < bounds[chunk+1]; ++c) {
+      shard_corners[shard_counts[chunk*N_SHARDS + shard_of(hashes[c])]++] = c;
+    }
+  });
+
+  // Within each shard, give every distinct vertex a local index and remember which corner
+  // saw it first.  corner_indexes temporarily holds the local indexes.
+  std::vector<uint8_t> is_first(n, 0);
+  std::vector<std::vector<size_t>> shard_indexes(N_SHARDS);
+
+  pool.parallel_for(N_SHARDS, [&](size_t shard) {
+    const size_t begin = shard_bounds[shard];
+    const size_t end   = shard_bounds[shard+1];
+
+    size_t table_size = 16;
+    while (table_size < 2 * (end - begin)) table_size *= 2;
+    const size_t mask = table_size - 1;
+
+    // Each slot holds the first corner of a vertex, and that vertex's local index
+    std::vector<std::pair<size_t,size_t>> table(table_size, {n, 0});
+    size_t n_local = 0;
+
+    for (size_t s = begin; s < end; ++s) {
+      const size_t c = shard_corners[s];
+      const auto& vertex = corner(triangles, c);
+
+      for (size_t slot = hashes[c] & mask; ; slot = (slot + 1) & mask) {
+        if (table[slot].first == n) {
+          table[slot] = {c, n_local};
+          is_first[c] = 1;
+          corner_indexes[c] = n_local++;
+          break;
+        }
+        if (hashes[table[slot].first] == hashes[c] && corner(triangles, table[slot].first) == vertex) {
+          corner_indexes[c] = table[slot].second;
+          break;
+        }
+      }
+    }
+
+    shard_indexes[shard].resize(n_local);
+  });
+
+  // Number the first corners in corner order to get the global vertex indexes
+  std::vector<size_t> offsets(n_chunks + 1, 0);
+  pool.parallel_for(n_chunks, [&](size_t chunk) {
+    for (size_t c = bounds[chunk]; c < bounds[chunk+1]; ++c) {
+      offsets[chunk+1] += is_first[c];
+    }
+  });
+  for (size_t chunk = 0; chunk < n_chunks; ++chunk) offsets[chunk+1] += offsets[chunk];
+
+  vertexes.resize(offsets[n_chunks]);
+  pool.parallel_for(n_chunks, [&](size_t chunk) {
+    size_t next_index = offsets[chunk];
+    for (size_t c = bounds[chunk]; c < bounds[chunk+1]; ++c) {
+      if (!is_first[c]) continue;
+      vertexes[next_index] = corner(triangles, c);
+      shard_indexes[shard_of(hashes[c])][corner_indexes[c]] = next_index;
+      ++next_index;
+    }
+  });
+
+  pool.parallel_for(n_chunks, [&](size_t chunk) {
+    for (size_t c = bounds[chunk]; c < bounds[chunk+1]; ++c) {
+      corner_indexes[c] = shard_indexes[shard_of(hashes[c])][corner_indexes[c]];
+    }
+  });
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <tuple>
+#include <vector>
+
+#include "point.h"
+#include "triangle.h"
+#include "thread_pool.h"
+
+// Merges the equal vertexes of a triangle soup into a list of unique vertexes plus faces that
+// index into it.  Work is split across the given thread pool (or done inline without one), and
+// the result does not depend on the number of threads.
+class VertexWelder {
+  public:
+    using triangle_type = Triangle<double,3>;
+    using vertex_type   = triangle_type::vertex_type;
+    using face_type     = std::tuple<size_t,size_t,size_t>;
+
+    enum class Order {
+      // Parallel sort of the triangle corners.  Vertexes come out in ascending (x,y,z) order,
+      // exactly as the original std::set based welding produced them.
+      sorted,
+      // Open addressing hash tables, one per shard of the hash space.  Vertexes come out in the
+      // order they first appear in the triangles.  Usually faster than sorted.
+      first_seen
+    };
+
+  private:
+    Order order_;
+    ThreadPool* pool_;
+
+  public:
+    explicit VertexWelder(Order order = Order::sorted, ThreadPool* pool = nullptr);
+
+    void weld(
+      const std::vector<triangle_type>& triangles,
+      std::vector<vertex_type>& vertexes,
+      std::vector<face_type>& faces
+    ) const;
+
+  private:
+    void weld_sorted(const std::vector<triangle_type>& triangles, ThreadPool& pool, std::vector<vertex_type>& vertexes, std::vector<size_t>& corner_indexes) const;
+    void weld_first_seen(const std::vector<triangle_type>& triangles, ThreadPool& pool, std::vector<vertex_type>& vertexes, std::vector<size_t>& corner_indexes) const;
+};